@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+#include <system/thread_defs.h>
+#include <utils/Timers.h>
+#include "audio_tap.h"
+#include "util.h"
+#include "debug.h"
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace CPP_VERSION {
+namespace implementation {
+
+using ::android::base::GetBoolProperty;
+using ::android::base::StringPrintf;
+
+namespace {
+
+constexpr char kTapDir[] = "/data/vendor/audio_tap";
+constexpr size_t kBufferDurationS = 2;
+constexpr auto kWriterPeriod = std::chrono::milliseconds(100);
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riffSize;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmtSize;
+    uint16_t audioFormat;
+    uint16_t nChannels;
+    uint32_t sampleRateHz;
+    uint32_t byteRate;
+    uint16_t blockAlign;
+    uint16_t bitsPerSample;
+    char data[4];
+    uint32_t dataSize;
+} __attribute__((packed));
+
+size_t roundUpToPowerOfTwo(size_t x) {
+    size_t r = 1;
+    while (r < x) {
+        r <<= 1;
+    }
+    return r;
+}
+
+bool writeAll(const int fd, const uint8_t *data, size_t sz) {
+    while (sz > 0) {
+        const ssize_t n = TEMP_FAILURE_RETRY(::write(fd, data, sz));
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        sz -= n;
+    }
+    return true;
+}
+
+}  // namespace
+
+AudioTap::AudioTap(base::unique_fd fd,
+                   const unsigned nChannels,
+                   const unsigned sampleRateHz)
+        : mFd(std::move(fd))
+        , mNChannels(nChannels)
+        , mSampleRateHz(sampleRateHz)
+        , mCapacity(roundUpToPowerOfTwo(
+            kBufferDurationS * sampleRateHz * nChannels * sizeof(int16_t)))
+        , mBuffer(new uint8_t[mCapacity]) {
+    updateHeader();
+    ::lseek(mFd.get(), sizeof(WavHeader), SEEK_SET);
+    mWriterThread = std::thread(&AudioTap::writerThread, this);
+}
+
+AudioTap::~AudioTap() {
+    {
+        std::lock_guard<std::mutex> lock(mWriterMutex);
+        mWriterRunning = false;
+    }
+    mWriterCv.notify_one();
+    mWriterThread.join();
+
+    drain();
+    updateHeader();
+
+    const uint64_t dropped = mDroppedBytes;
+    if (dropped > 0) {
+        ALOGW("AudioTap::%s:%d the writer was late, %" PRIu64 " bytes are not "
+              "in the tap", __func__, __LINE__, dropped);
+    }
+}
+
+std::unique_ptr<AudioTap> AudioTap::create(const char *name,
+                                           const unsigned nChannels,
+                                           const unsigned sampleRateHz) {
+    if (!GetBoolProperty("debug.audio.tinyalsa.tap", false)) {
+        return nullptr;
+    }
+
+    const std::string path = StringPrintf("%s/%s_%" PRId64 ".wav", kTapDir, name,
+                                          systemTime(SYSTEM_TIME_MONOTONIC));
+    base::unique_fd fd(::open(path.c_str(),
+                              O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640));
+    if (!fd.ok()) {
+        ALOGE("AudioTap::%s:%d: could not create '%s': %s",
+              __func__, __LINE__, path.c_str(), strerror(errno));
+        return FAILURE(nullptr);
+    }
+
+    ALOGI("AudioTap::%s:%d: writing '%s'", __func__, __LINE__, path.c_str());
+    return std::make_unique<AudioTap>(std::move(fd), nChannels, sampleRateHz);
+}
+
+void AudioTap::push(const void *data, const size_t sz) {
+    const size_t w = mWritePos.load(std::memory_order_relaxed);
+    const size_t r = mReadPos.load(std::memory_order_acquire);
+
+    if ((mCapacity - (w - r)) < sz) {
+        mDroppedBytes.fetch_add(sz, std::memory_order_relaxed);
+        return;
+    }
+
+    const size_t offset = w & (mCapacity - 1);
+    const size_t chunk1 = std::min(sz, mCapacity - offset);
+    memcpy(&mBuffer[offset], data, chunk1);
+    memcpy(&mBuffer[0], static_cast<const uint8_t *>(data) + chunk1, sz - chunk1);
+
+    mWritePos.store(w + sz, std::memory_order_release);
+}
+
+void AudioTap::writerThread() {
+    util::setThreadPriority(SP_BACKGROUND, ANDROID_PRIORITY_BACKGROUND);
+
+    std::unique_lock<std::mutex> lock(mWriterMutex);
+    while (mWriterRunning) {
+        mWriterCv.wait_for(lock, kWriterPeriod);
+
+        lock.unlock();
+        if (drain()) {
+            updateHeader();
+        }
+        lock.lock();
+    }
+}
+
+bool AudioTap::drain() {
+    const size_t r = mReadPos.load(std::memory_order_relaxed);
+    const size_t w = mWritePos.load(std::memory_order_acquire);
+    const size_t sz = w - r;
+    if (!sz) {
+        return false;
+    }
+
+    const size_t offset = r & (mCapacity - 1);
+    const size_t chunk1 = std::min(sz, mCapacity - offset);
+    if (writeAll(mFd.get(), &mBuffer[offset], chunk1)
+            && writeAll(mFd.get(), &mBuffer[0], sz - chunk1)) {
+        mDataSize += sz;
+    }
+
+    mReadPos.store(w, std::memory_order_release);
+    return true;
+}
+
+// The header is rewritten after every drain to keep the file valid if the
+// process goes away.
+void AudioTap::updateHeader() {
+    const uint32_t dataSize = std::min<uint64_t>(mDataSize, UINT32_MAX - sizeof(WavHeader));
+    const unsigned frameSize = mNChannels * sizeof(int16_t);
+
+    const WavHeader header = {
+        .riff = {'R', 'I', 'F', 'F'},
+        .riffSize = static_cast<uint32_t>(sizeof(WavHeader) - 8 + dataSize),
+        .wave = {'W', 'A', 'V', 'E'},
+        .fmt = {'f', 'm', 't', ' '},
+        .fmtSize = 16,
+        .audioFormat = 1,  // PCM
+        .nChannels = static_cast<uint16_t>(mNChannels),
+        .sampleRateHz = mSampleRateHz,
+        .byteRate = mSampleRateHz * frameSize,
+        .blockAlign = static_cast<uint16_t>(frameSize),
+        .bitsPerSample = 16,
+        .data = {'d', 'a', 't', 'a'},
+        .dataSize = dataSize,
+    };
+
+    TEMP_FAILURE_RETRY(::pwrite(mFd.get(), &header, sizeof(header), 0));
+}
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
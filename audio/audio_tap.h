@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <android-base/unique_fd.h>
+#include <stdint.h>
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace CPP_VERSION {
+namespace implementation {
+
+// Copies 16bit PCM passing through a pcm into a WAV file, enabled by the
+// `debug.audio.tinyalsa.tap` property. `push` is safe to call from the audio
+// threads: it never blocks and drops the tap data (never the audio) if the
+// writer thread falls behind.
+struct AudioTap {
+    AudioTap(base::unique_fd fd, unsigned nChannels, unsigned sampleRateHz);
+    ~AudioTap();
+
+    // Returns nullptr if the tap is disabled or the file can't be created.
+    static std::unique_ptr<AudioTap> create(const char *name,
+                                            unsigned nChannels,
+                                            unsigned sampleRateHz);
+
+    void push(const void *data, size_t sz);
+
+    AudioTap(const AudioTap &) = delete;
+    AudioTap &operator=(const AudioTap &) = delete;
+    AudioTap(AudioTap &&) = delete;
+    AudioTap &operator=(AudioTap &&) = delete;
+
+private:
+    void writerThread();
+    bool drain();
+    void updateHeader();
+
+    const base::unique_fd mFd;
+    const unsigned mNChannels;
+    const unsigned mSampleRateHz;
+    const size_t mCapacity;  // a power of two
+    const std::unique_ptr<uint8_t[]> mBuffer;
+    std::atomic<size_t> mWritePos = 0;
+    std::atomic<size_t> mReadPos = 0;
+    std::atomic<uint64_t> mDroppedBytes = 0;
+    uint64_t mDataSize = 0;  // used by the writer thread only
+    std::thread mWriterThread;
+    std::condition_variable mWriterCv;
+    std::mutex mWriterMutex;
+    bool mWriterRunning = true;
+};
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <audio_utils/channels.h>
+#include <log/log.h>
+#include <utils/ThreadDefs.h>
+#include "capture_engine.h"
+#include "util.h"
+#include "debug.h"
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace CPP_VERSION {
+namespace implementation {
+
+namespace {
+
+std::mutex gEnginesMutex;
+std::map<std::pair<unsigned, unsigned>, std::unique_ptr<CaptureEngine>> gEngines;
+
+size_t getResampledFrames(const size_t nFrames,
+                          const unsigned srcRateHz,
+                          const unsigned dstRateHz) {
+    return (uint64_t(nFrames) * dstRateHz + srcRateHz - 1) / srcRateHz + 1;
+}
+
+// Linear interpolation between `prevFrame` and `src`. `pos` is the position
+// of the next output frame where 0 corresponds to `prevFrame` and 1 to `src[0]`.
+size_t resampleLinear(const int16_t *src, const size_t nFrames,
+                      const unsigned nChannels, const double step,
+                      int16_t *prevFrame, double &pos,
+                      int16_t *dst) {
+    const auto sample = [src, prevFrame, nChannels](size_t frame, unsigned ch) {
+        return frame ? src[(frame - 1) * nChannels + ch] : prevFrame[ch];
+    };
+
+    size_t dstFrames = 0;
+    for (; pos < nFrames; pos += step, ++dstFrames) {
+        const size_t i = pos;
+        const double frac = pos - i;
+
+        for (unsigned ch = 0; ch < nChannels; ++ch) {
+            const int a = sample(i, ch);
+            const int b = sample(i + 1, ch);
+            *dst++ = static_cast<int16_t>(std::lround(a + frac * (b - a)));
+        }
+    }
+
+    pos -= nFrames;
+    if (nFrames > 0) {
+        memcpy(prevFrame, &src[(nFrames - 1) * nChannels], nChannels * sizeof(*src));
+    }
+
+    return dstFrames;
+}
+
+}  // namespace
+
+CaptureClient::CaptureClient(const unsigned nChannels,
+                             const unsigned sampleRateHz,
+                             const size_t ringBufferSize)
+        : nChannels(nChannels)
+        , sampleRateHz(sampleRateHz)
+        , frameSize(nChannels * sizeof(int16_t))
+        , ringBuffer(ringBufferSize)
+        , resamplerPrevFrame(nChannels) {}
+
+CaptureEngine::CaptureEngine(const unsigned pcmCard, const unsigned pcmDevice,
+                             const unsigned nChannels, const unsigned sampleRateHz,
+                             const size_t readSizeFrames)
+        : mStartNs(systemTime(SYSTEM_TIME_MONOTONIC))
+        , mNChannels(nChannels)
+        , mSampleRateHz(sampleRateHz)
+        , mFrameSize(nChannels * sizeof(int16_t))
+        , mReadSizeFrames(readSizeFrames)
+        , mMixer(pcmCard)
+        , mPcm(talsa::pcmOpen(pcmCard, pcmDevice, nChannels, sampleRateHz,
+                              readSizeFrames, false /* isOut */))
+        , mTap(AudioTap::create("in", nChannels, sampleRateHz)) {
+    if (mPcm) {
+        mProduceThread = std::thread(&CaptureEngine::producerThread, this);
+    } else {
+        mProduceThread = std::thread([](){});
+    }
+}
+
+CaptureEngine::~CaptureEngine() {
+    mProduceThreadRunning = false;
+    mProduceThread.join();
+}
+
+std::shared_ptr<CaptureClient> CaptureEngine::attach(const unsigned pcmCard,
+                                                     const unsigned pcmDevice,
+                                                     const unsigned nChannels,
+                                                     const unsigned sampleRateHz,
+                                                     const size_t frameCount,
+                                                     nsecs_t &startNs) {
+    std::lock_guard<std::mutex> guard(gEnginesMutex);
+
+    const auto key = std::make_pair(pcmCard, pcmDevice);
+    auto i = gEngines.find(key);
+    if (i == gEngines.end()) {
+        auto engine = std::make_unique<CaptureEngine>(pcmCard, pcmDevice,
+                                                      nChannels, sampleRateHz,
+                                                      frameCount);
+        if (!engine->mMixer || !engine->mPcm) {
+            return FAILURE(nullptr);
+        }
+
+        i = gEngines.insert({key, std::move(engine)}).first;
+    }
+
+    CaptureEngine &engine = *i->second;
+    startNs = engine.mStartNs;
+    return engine.addClient(nChannels, sampleRateHz, frameCount);
+}
+
+void CaptureEngine::detach(const unsigned pcmCard,
+                           const unsigned pcmDevice,
+                           const CaptureClient *client) {
+    std::lock_guard<std::mutex> guard(gEnginesMutex);
+
+    const auto i = gEngines.find(std::make_pair(pcmCard, pcmDevice));
+    LOG_ALWAYS_FATAL_IF(i == gEngines.end());
+
+    if (i->second->removeClient(client) == 0) {
+        // closes the pcm, the next `attach` will open it again
+        gEngines.erase(i);
+    }
+}
+
+std::shared_ptr<CaptureClient> CaptureEngine::addClient(const unsigned nChannels,
+                                                        const unsigned sampleRateHz,
+                                                        const size_t frameCount) {
+    const size_t readFrames =
+        getResampledFrames(mReadSizeFrames, mSampleRateHz, sampleRateHz);
+    const size_t ringBufferFrames = 3 * std::max(frameCount, readFrames);
+
+    auto client = std::make_shared<CaptureClient>(
+        nChannels, sampleRateHz, ringBufferFrames * nChannels * sizeof(int16_t));
+
+    std::lock_guard<std::mutex> guard(mClientsMutex);
+    mClients.push_back(client);
+    ALOGD("CaptureEngine::%s:%d: nChannels=%u sampleRateHz=%u (pcm: %u, %u), "
+          "%zu client(s)", __func__, __LINE__, nChannels, sampleRateHz,
+          mNChannels, mSampleRateHz, mClients.size());
+    return client;
+}
+
+size_t CaptureEngine::removeClient(const CaptureClient *client) {
+    std::lock_guard<std::mutex> guard(mClientsMutex);
+
+    mClients.erase(std::remove_if(mClients.begin(), mClients.end(),
+                                  [client](const std::shared_ptr<CaptureClient> &c) {
+                                      return c.get() == client;
+                                  }),
+                   mClients.end());
+    return mClients.size();
+}
+
+void CaptureEngine::producerThread() {
+    util::setThreadPriority(SP_AUDIO_SYS, PRIORITY_AUDIO);
+    std::vector<int16_t> readBuf(mReadSizeFrames * mNChannels);
+
+    while (mProduceThreadRunning) {
+        const size_t sz = doRead(readBuf.data(), readBuf.size() * sizeof(int16_t));
+        if (sz > 0) {
+            if (mTap) {
+                mTap->push(readBuf.data(), sz);
+            }
+            fanOut(readBuf.data(), sz / mFrameSize);
+        }
+    }
+}
+
+size_t CaptureEngine::doRead(void *dst, size_t sz) {
+    const int n = talsa::pcmRead(mPcm.get(), dst, sz, mFrameSize);
+    if (n > 0) {
+        LOG_ALWAYS_FATAL_IF(static_cast<size_t>(n) > sz,
+                            "n=%d sz=%zu mFrameSize=%u", n, sz, mFrameSize);
+        return n;
+    } else {
+        return 0;
+    }
+}
+
+void CaptureEngine::fanOut(const int16_t *src, const size_t nFrames) {
+    std::lock_guard<std::mutex> guard(mClientsMutex);
+
+    for (const auto &client : mClients) {
+        deliver(*client, src, nFrames);
+    }
+}
+
+void CaptureEngine::deliver(CaptureClient &client, const int16_t *src, size_t nFrames) {
+    if (client.nChannels != mNChannels) {
+        client.channelsBuffer.resize(nFrames * client.nChannels);
+        adjust_channels(src, mNChannels,
+                        client.channelsBuffer.data(), client.nChannels,
+                        sizeof(*src), nFrames * mFrameSize);
+        src = client.channelsBuffer.data();
+    }
+
+    if (client.sampleRateHz != mSampleRateHz) {
+        client.resampleBuffer.resize(
+            getResampledFrames(nFrames, mSampleRateHz, client.sampleRateHz)
+            * client.nChannels);
+        nFrames = resampleLinear(src, nFrames, client.nChannels,
+                                 double(mSampleRateHz) / client.sampleRateHz,
+                                 client.resamplerPrevFrame.data(),
+                                 client.resamplerPos,
+                                 client.resampleBuffer.data());
+        src = client.resampleBuffer.data();
+    }
+
+    const size_t szBytes = nFrames * client.frameSize;
+    const size_t bytesLost = client.ringBuffer.makeRoomForProduce(szBytes);
+    client.framesLost += bytesLost / client.frameSize;
+    LOG_ALWAYS_FATAL_IF(client.ringBuffer.produce(src, szBytes) < szBytes);
+}
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
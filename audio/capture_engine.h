@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utils/Timers.h>
+#include "audio_tap.h"
+#include "ring_buffer.h"
+#include "talsa.h"
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace CPP_VERSION {
+namespace implementation {
+
+// One capture client of CaptureEngine, the producer thread converts frames
+// into the client's format and puts them into `ringBuffer`.
+struct CaptureClient {
+    CaptureClient(unsigned nChannels, unsigned sampleRateHz, size_t ringBufferSize);
+
+    const unsigned nChannels;
+    const unsigned sampleRateHz;
+    const unsigned frameSize;
+    RingBuffer ringBuffer;
+    std::atomic<uint32_t> framesLost = 0;
+
+    // The fields below are accessed by the producer thread only.
+    std::vector<int16_t> channelsBuffer;
+    std::vector<int16_t> resampleBuffer;
+    std::vector<int16_t> resamplerPrevFrame;
+    double resamplerPos = 0;
+};
+
+// Shares one pcm capture stream between all inputs opened on the same
+// card/device. The pcm is opened with the config of the first client, frames
+// read from it are fanned out into per client ring buffers converting the
+// sample rate and the channel count if required. All clients share the same
+// capture timeline (`getStartNs`).
+struct CaptureEngine {
+    CaptureEngine(unsigned pcmCard, unsigned pcmDevice,
+                  unsigned nChannels, unsigned sampleRateHz,
+                  size_t readSizeFrames);
+    ~CaptureEngine();
+
+    // Returns nullptr if the pcm could not be opened.
+    static std::shared_ptr<CaptureClient> attach(unsigned pcmCard,
+                                                 unsigned pcmDevice,
+                                                 unsigned nChannels,
+                                                 unsigned sampleRateHz,
+                                                 size_t frameCount,
+                                                 nsecs_t &startNs);
+    static void detach(unsigned pcmCard, unsigned pcmDevice,
+                       const CaptureClient *client);
+
+    CaptureEngine(const CaptureEngine &) = delete;
+    CaptureEngine &operator=(const CaptureEngine &) = delete;
+    CaptureEngine(CaptureEngine &&) = delete;
+    CaptureEngine &operator=(CaptureEngine &&) = delete;
+
+private:
+    std::shared_ptr<CaptureClient> addClient(unsigned nChannels,
+                                             unsigned sampleRateHz,
+                                             size_t frameCount);
+    size_t removeClient(const CaptureClient *client);
+    void producerThread();
+    size_t doRead(void *dst, size_t sz);
+    void fanOut(const int16_t *src, size_t nFrames);
+    void deliver(CaptureClient &client, const int16_t *src, size_t nFrames);
+
+    const nsecs_t mStartNs;
+    const unsigned mNChannels;
+    const unsigned mSampleRateHz;
+    const unsigned mFrameSize;
+    const unsigned mReadSizeFrames;
+    talsa::Mixer mMixer;
+    talsa::PcmPtr mPcm;
+    const std::unique_ptr<AudioTap> mTap;
+    std::vector<std::shared_ptr<CaptureClient>> mClients;
+    std::mutex mClientsMutex;
+    std::thread mProduceThread;
+    std::atomic<bool> mProduceThreadRunning = true;
+};
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
@@ -23,6 +23,7 @@
 #include <utils/Timers.h>
 #include <utils/ThreadDefs.h>
 #include "device_port_sink.h"
+#include "audio_tap.h"
 #include "talsa.h"
 #include "audio_ops.h"
 #include "ring_buffer.h"
@@ -30,6 +31,7 @@
 #include "debug.h"
 
 using ::android::base::GetBoolProperty;
+using ::android::base::GetIntProperty;
 
 namespace xsd {
 using namespace ::android::audio::policy::configuration::CPP_VERSION;
@@ -44,24 +46,54 @@ namespace implementation {
 namespace {
 
 constexpr int kMaxJitterUs = 3000;  // Enforced by CTS, should be <= 6ms
+constexpr nsecs_t kLatencyReportIntervalNs = s2ns(1);
+
+// How TinyalsaSink is configured for a particular kind of output stream.
+struct SinkProfile {
+    talsa::PcmPeriodSettings periodSettings;
+    unsigned ringBufferSizeInWrites;
+    // Wake the consume thread only when a whole write buffer is available.
+    bool batchConsume;
+    // Run the consume thread with SCHED_FIFO.
+    bool rtConsumer;
+};
+
+SinkProfile getSinkProfile(const hidl_vec<AudioInOutFlag> &flags) {
+    if (util::isFastOutput(flags)) {
+        return {talsa::pcmGetFastPcmPeriodSettings(), 2, false, true};
+    } else if (util::isDeepBufferOutput(flags)) {
+        return {talsa::pcmGetDeepBufferPcmPeriodSettings(), 3, true, false};
+    } else {
+        return {talsa::pcmGetPcmPeriodSettings(), 3, false, false};
+    }
+}
 
 struct TinyalsaSink : public DevicePortSink {
     TinyalsaSink(unsigned pcmCard, unsigned pcmDevice,
                  const AudioConfig &cfg,
+                 const SinkProfile &profile,
                  uint64_t initialFrames)
             : mStartNs(systemTime(SYSTEM_TIME_MONOTONIC))
             , mSampleRateHz(cfg.base.sampleRateHz)
             , mFrameSize(util::countChannels(cfg.base.channelMask) * sizeof(int16_t))
             , mWriteSizeFrames(cfg.frameCount)
+            , mBatchConsume(profile.batchConsume)
+            , mRtConsumer(profile.rtConsumer)
+            , mReportedLatencyMs(getLatencyMs(cfg, profile))
+            , mMeasureLatency(GetBoolProperty("debug.audio.tinyalsa.measure_latency", false))
             , mInitialFrames(initialFrames)
             , mFrames(initialFrames)
-            , mRingBuffer(mFrameSize * cfg.frameCount * 3)
+            , mRingBuffer(mFrameSize * cfg.frameCount * profile.ringBufferSizeInWrites)
             , mMixer(pcmCard)
             , mPcm(talsa::pcmOpen(pcmCard, pcmDevice,
                                   util::countChannels(cfg.base.channelMask),
                                   cfg.base.sampleRateHz,
                                   cfg.frameCount,
-                                  true /* isOut */)) {
+                                  profile.periodSettings,
+                                  true /* isOut */))
+            , mTap(AudioTap::create("out",
+                                    util::countChannels(cfg.base.channelMask),
+                                    cfg.base.sampleRateHz)) {
         if (mPcm) {
             mConsumeThread = std::thread(&TinyalsaSink::consumeThread, this);
         } else {
@@ -74,11 +106,14 @@ struct TinyalsaSink : public DevicePortSink {
         mConsumeThread.join();
     }
 
-    static int getLatencyMs(const AudioConfig &cfg) {
+    static int getLatencyMs(const AudioConfig &cfg, const SinkProfile &profile) {
         constexpr size_t inMs = 1000;
-        const talsa::PcmPeriodSettings periodSettings =
-            talsa::pcmGetPcmPeriodSettings();
-        const size_t numerator = periodSettings.periodSizeMultiplier * cfg.frameCount;
+        const talsa::PcmPeriodSettings &periodSettings = profile.periodSettings;
+        size_t numerator = periodSettings.periodSizeMultiplier * cfg.frameCount;
+        if (profile.batchConsume) {
+            // frames wait in the ring buffer until a whole write is available
+            numerator += periodSettings.periodCount * cfg.frameCount;
+        }
         const size_t denominator = periodSettings.periodCount * cfg.base.sampleRateHz / inMs;
 
         // integer division with rounding
@@ -190,14 +225,44 @@ struct TinyalsaSink : public DevicePortSink {
         return framesLost;
     }
 
+    // Logs the actual output latency (the frames queued in the ring
+    // buffer and in the pcm) next to the one reported by getLatencyMs.
+    void reportMeasuredLatency() {
+        const nsecs_t nowNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        if ((nowNs - mLastLatencyReportNs) < kLatencyReportIntervalNs) {
+            return;
+        }
+        mLastLatencyReportNs = nowNs;
+
+        const int pcmFrames = talsa::pcmGetDelayFrames(mPcm.get());
+        if (pcmFrames < 0) {
+            return;
+        }
+
+        const size_t ringFrames = mRingBuffer.availableToConsume() / mFrameSize;
+        const unsigned measuredMs =
+            (ringFrames + pcmFrames) * 1000 / mSampleRateHz + talsa::pcmGetHostLatencyMs();
+
+        ALOGI("TinyalsaSink::%s:%d measured latency: %u ms (ring: %zu frames, "
+              "pcm: %d frames), reported latency: %d ms",
+              __func__, __LINE__, measuredMs, ringFrames, pcmFrames, mReportedLatencyMs);
+    }
+
     void consumeThread() {
-        util::setThreadPriority(SP_AUDIO_SYS, PRIORITY_AUDIO);
+        if (!mRtConsumer || !util::setThreadSchedFifo(
+                GetIntProperty("ro.hardware.audio.tinyalsa.fast.rt_priority", 2))) {
+            util::setThreadPriority(SP_AUDIO_SYS, PRIORITY_AUDIO);
+        }
         std::vector<uint8_t> writeBuffer(mWriteSizeFrames * mFrameSize);
+        const size_t minConsumeBytes = mBatchConsume ? writeBuffer.size() : 1;
 
         while (mConsumeThreadRunning) {
+            // In the batch mode a partial write is consumed on the timeout
+            // to not keep the stream's tail in the ring buffer.
             if (mRingBuffer.waitForConsumeAvailable(
                     std::chrono::high_resolution_clock::now()
-                    + std::chrono::microseconds(100000))) {
+                    + std::chrono::microseconds(100000), minConsumeBytes)
+                    || (mBatchConsume && (mRingBuffer.availableToConsume() > 0))) {
                 size_t szBytes;
                 {
                     auto chunk = mRingBuffer.getConsumeChunk();
@@ -209,6 +274,10 @@ struct TinyalsaSink : public DevicePortSink {
                     LOG_ALWAYS_FATAL_IF(mRingBuffer.consume(chunk, szBytes) < szBytes);
                 }
 
+                if (mTap) {
+                    mTap->push(writeBuffer.data(), szBytes);
+                }
+
                 const uint8_t *data8 = writeBuffer.data();
                 while (szBytes > 0) {
                     const int n = talsa::pcmWrite(mPcm.get(), data8, szBytes, mFrameSize);
@@ -221,6 +290,10 @@ struct TinyalsaSink : public DevicePortSink {
                     data8 += n;
                     szBytes -= n;
                 }
+
+                if (mMeasureLatency) {
+                    reportMeasuredLatency();
+                }
             }
         }
     }
@@ -228,11 +301,12 @@ struct TinyalsaSink : public DevicePortSink {
     static std::unique_ptr<TinyalsaSink> create(unsigned pcmCard,
                                                 unsigned pcmDevice,
                                                 const AudioConfig &cfg,
+                                                const SinkProfile &profile,
                                                 size_t readerBufferSizeHint,
                                                 uint64_t initialFrames) {
         (void)readerBufferSizeHint;
         auto sink = std::make_unique<TinyalsaSink>(pcmCard, pcmDevice,
-                                                   cfg, initialFrames);
+                                                   cfg, profile, initialFrames);
         if (sink->mMixer && sink->mPcm) {
             return sink;
         } else {
@@ -245,6 +319,11 @@ private:
     const unsigned mSampleRateHz;
     const unsigned mFrameSize;
     const unsigned mWriteSizeFrames;
+    const bool mBatchConsume;
+    const bool mRtConsumer;
+    const int mReportedLatencyMs;
+    const bool mMeasureLatency;
+    nsecs_t mLastLatencyReportNs = 0;  // used by the consume thread only
     const uint64_t mInitialFrames;
     uint64_t mFrames GUARDED_BY(mFrameCountersMutex);
     uint64_t mMissedFrames GUARDED_BY(mFrameCountersMutex) = 0;
@@ -252,6 +331,7 @@ private:
     RingBuffer mRingBuffer;
     talsa::Mixer mMixer;
     talsa::PcmPtr mPcm;
+    const std::unique_ptr<AudioTap> mTap;
     std::thread mConsumeThread;
     std::atomic<bool> mConsumeThreadRunning = true;
     mutable Mutex mFrameCountersMutex;
@@ -362,8 +442,6 @@ DevicePortSink::create(size_t readerBufferSizeHint,
                        const AudioConfig &cfg,
                        const hidl_vec<AudioInOutFlag> &flags,
                        uint64_t initialFrames) {
-    (void)flags;
-
     if (xsd::stringToAudioFormat(cfg.base.format) != xsd::AudioFormat::AUDIO_FORMAT_PCM_16_BIT) {
         ALOGE("%s:%d, unexpected format: '%s'", __func__, __LINE__, cfg.base.format.c_str());
         return FAILURE(nullptr);
@@ -378,7 +456,8 @@ DevicePortSink::create(size_t readerBufferSizeHint,
     case xsd::AudioDevice::AUDIO_DEVICE_OUT_SPEAKER:
         {
             auto sinkptr = TinyalsaSink::create(talsa::kPcmCard, talsa::kPcmDevice,
-                                                cfg, readerBufferSizeHint, initialFrames);
+                                                cfg, getSinkProfile(flags),
+                                                readerBufferSizeHint, initialFrames);
             if (sinkptr != nullptr) {
                 return sinkptr;
             } else {
@@ -402,7 +481,9 @@ nullsink:
     return NullSink::create(cfg, readerBufferSizeHint, initialFrames);
 }
 
-int DevicePortSink::getLatencyMs(const DeviceAddress &address, const AudioConfig &cfg) {
+int DevicePortSink::getLatencyMs(const DeviceAddress &address,
+                                 const AudioConfig &cfg,
+                                 const hidl_vec<AudioInOutFlag> &flags) {
     switch (xsd::stringToAudioDevice(address.deviceType)) {
     default:
         ALOGW("%s:%d unsupported device: '%s'", __func__, __LINE__, address.deviceType.c_str());
@@ -410,7 +491,7 @@ int DevicePortSink::getLatencyMs(const DeviceAddress &address, const AudioConfig
 
     case xsd::AudioDevice::AUDIO_DEVICE_OUT_DEFAULT:
     case xsd::AudioDevice::AUDIO_DEVICE_OUT_SPEAKER:
-        return TinyalsaSink::getLatencyMs(cfg);
+        return TinyalsaSink::getLatencyMs(cfg, getSinkProfile(flags));
 
     case xsd::AudioDevice::AUDIO_DEVICE_OUT_TELEPHONY_TX:
     case xsd::AudioDevice::AUDIO_DEVICE_OUT_BUS:
@@ -40,7 +40,8 @@ struct DevicePortSink {
                                                   const hidl_vec<AudioInOutFlag> &,
                                                   uint64_t initialFrames);
 
-    static int getLatencyMs(const DeviceAddress &, const AudioConfig &);
+    static int getLatencyMs(const DeviceAddress &, const AudioConfig &,
+                            const hidl_vec<AudioInOutFlag> &);
     static bool validateDeviceAddress(const DeviceAddress &);
 };
 
@@ -27,6 +27,7 @@
 #include <utils/Timers.h>
 #include PATH(APM_XSD_ENUMS_H_FILENAME)
 #include "device_port_source.h"
+#include "capture_engine.h"
 #include "talsa.h"
 #include "ring_buffer.h"
 #include "audio_ops.h"
@@ -52,28 +53,28 @@ constexpr int kMaxJitterUs = 3000;  // Enforced by CTS, should be <= 6ms
 struct TinyalsaSource : public DevicePortSource {
     TinyalsaSource(unsigned pcmCard, unsigned pcmDevice,
                    const AudioConfig &cfg, uint64_t &frames)
-            : mStartNs(systemTime(SYSTEM_TIME_MONOTONIC))
+            : mPcmCard(pcmCard)
+            , mPcmDevice(pcmDevice)
             , mSampleRateHz(cfg.base.sampleRateHz)
             , mFrameSize(util::countChannels(cfg.base.channelMask) * sizeof(int16_t))
-            , mReadSizeFrames(cfg.frameCount)
             , mFrames(frames)
-            , mRingBuffer(mFrameSize * cfg.frameCount * 3)
-            , mMixer(pcmCard)
-            , mPcm(talsa::pcmOpen(pcmCard, pcmDevice,
-                                  util::countChannels(cfg.base.channelMask),
-                                  cfg.base.sampleRateHz,
-                                  cfg.frameCount,
-                                  false /* isOut */)) {
-        if (mPcm) {
-            mProduceThread = std::thread(&TinyalsaSource::producerThread, this);
-        } else {
-            mProduceThread = std::thread([](){});
+            , mClient(CaptureEngine::attach(pcmCard, pcmDevice,
+                                            util::countChannels(cfg.base.channelMask),
+                                            cfg.base.sampleRateHz,
+                                            cfg.frameCount,
+                                            mStartNs)) {
+        if (mClient) {
+            // The engine could be started by another stream earlier, our
+            // timeline starts now.
+            mPreviousFrames = getCaptureFramesLocked(systemTime(SYSTEM_TIME_MONOTONIC));
+            mSentFrames = mPreviousFrames;
         }
     }
 
     ~TinyalsaSource() {
-        mProduceThreadRunning = false;
-        mProduceThread.join();
+        if (mClient) {
+            CaptureEngine::detach(mPcmCard, mPcmDevice, mClient.get());
+        }
     }
 
     Result getCapturePosition(uint64_t &frames, uint64_t &time) override {
@@ -109,6 +110,7 @@ struct TinyalsaSource : public DevicePortSource {
 
     size_t read(float volume, size_t bytesToRead, IWriter &writer) override {
         const AutoMutex lock(mFrameCountersMutex);
+        RingBuffer &ringBuffer = mClient->ringBuffer;
 
         const size_t waitFrames = getWaitFramesNowLocked(bytesToRead / mFrameSize);
         const auto blockUntil =
@@ -116,16 +118,16 @@ struct TinyalsaSource : public DevicePortSource {
                 + std::chrono::microseconds(waitFrames * 1000000 / mSampleRateHz);
 
         while (bytesToRead > 0) {
-            if (mRingBuffer.waitForConsumeAvailable(blockUntil
+            if (ringBuffer.waitForConsumeAvailable(blockUntil
                     + std::chrono::microseconds(kMaxJitterUs))) {
-                if (mRingBuffer.availableToConsume() >= bytesToRead) {
+                if (ringBuffer.availableToConsume() >= bytesToRead) {
                     // Since the ring buffer has all bytes we need, make sure we
                     // are not too early here: tinyalsa is jittery, we don't
                     // want to go faster than SYSTEM_TIME_MONOTONIC
                     std::this_thread::sleep_until(blockUntil);
                 }
 
-                auto chunk = mRingBuffer.getConsumeChunk();
+                auto chunk = ringBuffer.getConsumeChunk();
                 const size_t writeBufSzBytes = std::min(chunk.size, bytesToRead);
 
                 aops::multiplyByVolume(volume,
@@ -133,7 +135,7 @@ struct TinyalsaSource : public DevicePortSource {
                                        writeBufSzBytes / sizeof(int16_t));
 
                 writer(chunk.data, writeBufSzBytes);
-                LOG_ALWAYS_FATAL_IF(mRingBuffer.consume(chunk, writeBufSzBytes) < writeBufSzBytes);
+                LOG_ALWAYS_FATAL_IF(ringBuffer.consume(chunk, writeBufSzBytes) < writeBufSzBytes);
 
                 bytesToRead -= writeBufSzBytes;
                 mSentFrames += writeBufSzBytes / mFrameSize;
@@ -158,41 +160,7 @@ struct TinyalsaSource : public DevicePortSource {
             }
         }
 
-        return mFramesLost.exchange(0);
-    }
-
-    void producerThread() {
-        util::setThreadPriority(SP_AUDIO_SYS, PRIORITY_AUDIO);
-        std::vector<uint8_t> readBuf(mReadSizeFrames * mFrameSize);
-
-        while (mProduceThreadRunning) {
-            const size_t bytesLost = mRingBuffer.makeRoomForProduce(readBuf.size());
-            mFramesLost += bytesLost / mFrameSize;
-
-            auto produceChunk = mRingBuffer.getProduceChunk();
-            if (produceChunk.size < readBuf.size()) {
-                const size_t sz = doRead(readBuf.data(), readBuf.size());
-                if (sz > 0) {
-                    LOG_ALWAYS_FATAL_IF(mRingBuffer.produce(readBuf.data(), sz) < sz);
-                }
-            } else {
-                const size_t sz = doRead(produceChunk.data, readBuf.size());
-                if (sz > 0) {
-                    LOG_ALWAYS_FATAL_IF(mRingBuffer.produce(readBuf.size()) < sz);
-                }
-            }
-        }
-    }
-
-    size_t doRead(void *dst, size_t sz) {
-        const int n = talsa::pcmRead(mPcm.get(), dst, sz, mFrameSize);
-        if (n > 0) {
-            LOG_ALWAYS_FATAL_IF(static_cast<size_t>(n) > sz,
-                                "n=%d sz=%zu mFrameSize=%u", n, sz, mFrameSize);
-            return n;
-        } else {
-            return 0;
-        }
+        return mClient->framesLost.exchange(0);
     }
 
     static std::unique_ptr<TinyalsaSource> create(unsigned pcmCard,
@@ -204,7 +172,7 @@ struct TinyalsaSource : public DevicePortSource {
 
         auto src = std::make_unique<TinyalsaSource>(pcmCard, pcmDevice,
                                                     cfg, frames);
-        if (src->mMixer && src->mPcm) {
+        if (src->mClient) {
             return src;
         } else {
             return FAILURE(nullptr);
@@ -212,19 +180,15 @@ struct TinyalsaSource : public DevicePortSource {
     }
 
 private:
-    const nsecs_t mStartNs;
+    const unsigned mPcmCard;
+    const unsigned mPcmDevice;
+    nsecs_t mStartNs = 0;
     const unsigned mSampleRateHz;
     const unsigned mFrameSize;
-    const unsigned mReadSizeFrames;
     uint64_t &mFrames GUARDED_BY(mFrameCountersMutex);
     uint64_t mPreviousFrames GUARDED_BY(mFrameCountersMutex) = 0;
     uint64_t mSentFrames GUARDED_BY(mFrameCountersMutex) = 0;
-    std::atomic<uint32_t> mFramesLost = 0;
-    RingBuffer mRingBuffer;
-    talsa::Mixer mMixer;
-    talsa::PcmPtr mPcm;
-    std::thread mProduceThread;
-    std::atomic<bool> mProduceThreadRunning = true;
+    const std::shared_ptr<CaptureClient> mClient;
     mutable Mutex mFrameCountersMutex;
 };
 
@@ -15,6 +15,7 @@
  */
 
 #include <log/log.h>
+#include <memaccount.h>
 #include <system/audio.h>
 #include PATH(APM_XSD_ENUMS_H_FILENAME)
 #include "primary_device.h"
@@ -36,6 +37,8 @@ namespace implementation {
 
 constexpr size_t kInBufferDurationMs = 15;
 constexpr size_t kOutBufferDurationMs = 22;
+constexpr size_t kDeepBufferOutBufferDurationMs = 80;
+constexpr size_t kFastOutBufferDurationMs = 4;
 
 using ::android::hardware::Void;
 
@@ -253,6 +256,16 @@ Return<Result> Device::removeDeviceEffect(AudioPortHandle device, uint64_t effec
     return FAILURE(Result::NOT_SUPPORTED);
 }
 
+// `dumpsys media.audio_flinger` lands here, it prints the memory held by the
+// HAL (e.g. "audio.ring").
+Return<void> Device::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    (void)options;
+    if (fd.getNativeHandle() && (fd->numFds > 0)) {
+        memaccount::dump(fd->data[0]);
+    }
+    return Void();
+}
+
 void Device::unrefDevice(StreamIn *sin) {
     std::lock_guard<std::mutex> guard(mMutex);
     LOG_ALWAYS_FATAL_IF(mInputStreams.erase(sin) < 1);
@@ -288,9 +301,22 @@ std::tuple<Result, sp<IStreamOut>, AudioConfig> Device::openOutputStreamImpl(
         return {FAILURE(Result::INVALID_ARGUMENTS), {}, {}};
     }
 
+    size_t bufferDurationMs;
+    talsa::PcmPeriodSettings periodSettings;
+    if (util::isFastOutput(flags)) {
+        bufferDurationMs = kFastOutBufferDurationMs;
+        periodSettings = talsa::pcmGetFastPcmPeriodSettings();
+    } else if (util::isDeepBufferOutput(flags)) {
+        bufferDurationMs = kDeepBufferOutBufferDurationMs;
+        periodSettings = talsa::pcmGetDeepBufferPcmPeriodSettings();
+    } else {
+        bufferDurationMs = kOutBufferDurationMs;
+        periodSettings = talsa::pcmGetPcmPeriodSettings();
+    }
+
     AudioConfig suggestedConfig;
-    if (util::checkAudioConfig(true, kOutBufferDurationMs,
-                               talsa::pcmGetPcmPeriodSettings().periodCount,
+    if (util::checkAudioConfig(true, bufferDurationMs,
+                               periodSettings.periodCount,
                                config, suggestedConfig)) {
         auto stream = std::make_unique<StreamOut>(
             this, ioHandle, device, suggestedConfig, flags, sourceMetadata);
@@ -479,6 +505,11 @@ Return<Result> PrimaryDevice::removeDeviceEffect(AudioPortHandle device, uint64_
     return mDevice->removeDeviceEffect(device, effectId);
 }
 
+Return<void> PrimaryDevice::debug(const hidl_handle& fd,
+                                  const hidl_vec<hidl_string>& options) {
+    return mDevice->debug(fd, options);
+}
+
 Return<Result> PrimaryDevice::setVoiceVolume(float volume) {
     return (volume >= 0 && volume <= 1.0) ? Result::OK : FAILURE(Result::INVALID_ARGUMENTS);
 }
@@ -28,6 +28,7 @@ namespace implementation {
 
 using ::android::sp;
 using ::android::hardware::hidl_bitfield;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
@@ -87,6 +88,7 @@ struct Device : public IDevice {
     Return<Result> close() override;
     Return<Result> addDeviceEffect(AudioPortHandle device, uint64_t effectId) override;
     Return<Result> removeDeviceEffect(AudioPortHandle device, uint64_t effectId) override;
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
 #if MAJOR_VERSION == 7 && MINOR_VERSION == 1
     Return<void> openOutputStream_7_1(int32_t ioHandle, const DeviceAddress& device,
@@ -180,6 +182,7 @@ struct PrimaryDevice : public IPrimaryDevice {
     Return<Result> close() override;
     Return<Result> addDeviceEffect(AudioPortHandle device, uint64_t effectId) override;
     Return<Result> removeDeviceEffect(AudioPortHandle device, uint64_t effectId) override;
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
     // Implementation of IPrimaryDevice.
     Return<Result> setVoiceVolume(float volume) override;
@@ -23,9 +23,14 @@ namespace audio {
 namespace CPP_VERSION {
 namespace implementation {
 
+namespace {
+memaccount::Counter gRingBufferMemory("audio.ring");
+}  // namespace
+
 RingBuffer::RingBuffer(size_t capacity)
         : mBuffer(new uint8_t[capacity])
-        , mCapacity(capacity) {}
+        , mCapacity(capacity)
+        , mCharge(gRingBufferMemory, capacity) {}
 
 size_t RingBuffer::availableToProduce() const {
     std::lock_guard<std::mutex> guard(mMutex);
@@ -84,7 +89,9 @@ size_t RingBuffer::produce(size_t size) {
     mProducePos = (mProducePos + size) % mCapacity;
     mAvailableToConsume += size;
 
-    mConsumeAvailable.notify_one();
+    if (mAvailableToConsume >= mConsumeWaitThreshold) {
+        mConsumeAvailable.notify_one();
+    }
     return size;
 }
 
@@ -108,14 +115,22 @@ size_t RingBuffer::produce(const void *srcRaw, size_t size) {
         produceSize -= chunkSz;
     }
 
-    mConsumeAvailable.notify_one();
+    if (mAvailableToConsume >= mConsumeWaitThreshold) {
+        mConsumeAvailable.notify_one();
+    }
     return size;
 }
 
 bool RingBuffer::waitForConsumeAvailable(Timepoint blockUntil) const {
+    return waitForConsumeAvailable(blockUntil, 1);
+}
+
+bool RingBuffer::waitForConsumeAvailable(Timepoint blockUntil, size_t atLeast) const {
     std::unique_lock<std::mutex> lock(mMutex);
+    const int threshold = std::max(1, std::min(int(atLeast), mCapacity));
+    mConsumeWaitThreshold = threshold;
     while (true) {
-        if (mAvailableToConsume > 0) {
+        if (mAvailableToConsume >= threshold) {
             return true;
         } else if (mConsumeAvailable.wait_until(lock, blockUntil) == std::cv_status::timeout) {
             return false;
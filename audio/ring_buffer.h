@@ -21,6 +21,7 @@
 #include <condition_variable>
 #include <mutex>
 #include <stdint.h>
+#include <memaccount.h>
 
 namespace android {
 namespace hardware {
@@ -67,6 +68,10 @@ struct RingBuffer {
 
     bool waitForConsumeAvailable(Timepoint blockUntil) const;
 
+    // Waits until at least `atLeast` bytes are available to consume, the
+    // producer does not wake the consumer for smaller amounts.
+    bool waitForConsumeAvailable(Timepoint blockUntil, size_t atLeast) const;
+
     // `getConsumeChunk` is a non-blocking function which a pointer
     // (`result.data`) inside RingBuffer's buffer, `result.size` is the
     //  size of the continious chunk (can be smaller than availableToConsume()).
@@ -93,6 +98,8 @@ private:
     int mAvailableToConsume = 0;
     int mProducePos = 0;
     int mConsumePos = 0;
+    mutable int mConsumeWaitThreshold = 1;
+    memaccount::Charge mCharge;
 };
 
 }  // namespace implementation
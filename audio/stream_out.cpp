@@ -245,7 +245,8 @@ private:
 
         const int latencyMs =
             DevicePortSink::getLatencyMs(mStream->getDeviceAddress(),
-                                         mStream->getAudioConfig());
+                                         mStream->getAudioConfig(),
+                                         mStream->getAudioOutputFlags());
 
         if (latencyMs >= 0) {
             status.retval = Result::OK;
@@ -400,7 +401,9 @@ Return<void> StreamOut::getMmapPosition(getMmapPosition_cb _hidl_cb) {
 }
 
 Return<uint32_t> StreamOut::getLatency() {
-    const int latencyMs = DevicePortSink::getLatencyMs(getDeviceAddress(), getAudioConfig());
+    const int latencyMs = DevicePortSink::getLatencyMs(getDeviceAddress(),
+                                                       getAudioConfig(),
+                                                       getAudioOutputFlags());
 
     return (latencyMs >= 0) ? latencyMs :
         (mCommon.getFrameCount() * 1000 / mCommon.getSampleRate());
@@ -33,6 +33,8 @@ struct mixer *gMixer0 = nullptr;
 int gMixerRefcounter0 = 0;
 std::mutex gMixerMutex;
 PcmPeriodSettings gPcmPeriodSettings;
+PcmPeriodSettings gDeepBufferPcmPeriodSettings;
+PcmPeriodSettings gFastPcmPeriodSettings;
 unsigned gPcmHostLatencyMs;
 
 void mixerSetValueAll(struct mixer_ctl *ctl, int value) {
@@ -117,6 +119,20 @@ void init() {
     gPcmPeriodSettings.periodSizeMultiplier =
         readUnsignedProperty("ro.hardware.audio.tinyalsa.period_size_multiplier", 1);
 
+    // Deep buffer streams are opened with kDeepBufferOutBufferDurationMs,
+    // the defaults give 20ms periods.
+    gDeepBufferPcmPeriodSettings.periodCount =
+        readUnsignedProperty("ro.hardware.audio.tinyalsa.deep_buffer.period_count", 4);
+
+    gDeepBufferPcmPeriodSettings.periodSizeMultiplier =
+        readUnsignedProperty("ro.hardware.audio.tinyalsa.deep_buffer.period_size_multiplier", 1);
+
+    gFastPcmPeriodSettings.periodCount =
+        readUnsignedProperty("ro.hardware.audio.tinyalsa.fast.period_count", 2);
+
+    gFastPcmPeriodSettings.periodSizeMultiplier =
+        readUnsignedProperty("ro.hardware.audio.tinyalsa.fast.period_size_multiplier", 1);
+
     gPcmHostLatencyMs =
         readUnsignedProperty("ro.hardware.audio.tinyalsa.host_latency_ms", 0);
 }
@@ -125,6 +141,14 @@ PcmPeriodSettings pcmGetPcmPeriodSettings() {
     return gPcmPeriodSettings;
 }
 
+PcmPeriodSettings pcmGetDeepBufferPcmPeriodSettings() {
+    return gDeepBufferPcmPeriodSettings;
+}
+
+PcmPeriodSettings pcmGetFastPcmPeriodSettings() {
+    return gFastPcmPeriodSettings;
+}
+
 unsigned pcmGetHostLatencyMs() {
     return gPcmHostLatencyMs;
 }
@@ -139,8 +163,17 @@ PcmPtr pcmOpen(const unsigned int dev,
                const size_t sampleRateHz,
                const size_t frameCount,
                const bool isOut) {
-    const PcmPeriodSettings periodSettings = pcmGetPcmPeriodSettings();
+    return pcmOpen(dev, card, nChannels, sampleRateHz, frameCount,
+                   pcmGetPcmPeriodSettings(), isOut);
+}
 
+PcmPtr pcmOpen(const unsigned int dev,
+               const unsigned int card,
+               const unsigned int nChannels,
+               const size_t sampleRateHz,
+               const size_t frameCount,
+               const PcmPeriodSettings &periodSettings,
+               const bool isOut) {
     struct pcm_config pcm_config;
     memset(&pcm_config, 0, sizeof(pcm_config));
 
@@ -263,6 +296,21 @@ int pcmWrite(pcm_t *pcm, const void *data, const int szBytes,
     }
 }
 
+int pcmGetDelayFrames(pcm_t *pcm) {
+    if (!pcm) {
+        return FAILURE(-1);
+    }
+
+    unsigned int avail;
+    struct timespec tstamp;
+    if (::pcm_get_htimestamp(pcm, &avail, &tstamp) != 0) {
+        return -1;
+    }
+
+    const unsigned int bufferSize = ::pcm_get_buffer_size(pcm);
+    return (bufferSize > avail) ? (bufferSize - avail) : 0;
+}
+
 Mixer::Mixer(unsigned card): mMixer(mixerGetOrOpen(card)) {}
 
 Mixer::~Mixer() {
@@ -35,6 +35,8 @@ struct PcmPeriodSettings {
 
 void init();
 PcmPeriodSettings pcmGetPcmPeriodSettings();
+PcmPeriodSettings pcmGetDeepBufferPcmPeriodSettings();
+PcmPeriodSettings pcmGetFastPcmPeriodSettings();
 unsigned pcmGetHostLatencyMs();
 
 typedef struct pcm pcm_t;
@@ -42,8 +44,12 @@ struct PcmDeleter { void operator()(pcm_t *x) const; };
 typedef std::unique_ptr<pcm_t, PcmDeleter> PcmPtr;
 PcmPtr pcmOpen(unsigned int dev, unsigned int card, unsigned int nChannels,
                size_t sampleRateHz, size_t frameCount, bool isOut);
+PcmPtr pcmOpen(unsigned int dev, unsigned int card, unsigned int nChannels,
+               size_t sampleRateHz, size_t frameCount,
+               const PcmPeriodSettings &periodSettings, bool isOut);
 int pcmRead(pcm_t *pcm, void *data, int szBytes, unsigned int frameSize);
 int pcmWrite(pcm_t *pcm, const void *data, int szBytes, unsigned int frameSize);
+int pcmGetDelayFrames(pcm_t *pcm);
 
 class Mixer {
 public:
@@ -19,6 +19,7 @@
 #include <cutils/sched_policy.h>
 #include <system/audio.h>
 #include <sys/resource.h>
+#include <sched.h>
 #include <pthread.h>
 #include PATH(APM_XSD_ENUMS_H_FILENAME)
 #include "util.h"
@@ -229,6 +230,20 @@ bool checkAudioPortConfig(const AudioPortConfig &cfg) {
     return true;
 }
 
+bool isDeepBufferOutput(const hidl_vec<AudioInOutFlag> &flags) {
+    return std::any_of(flags.begin(), flags.end(), [](const AudioInOutFlag &flag){
+        return xsd::stringToAudioInOutFlag(flag) ==
+            xsd::AudioInOutFlag::AUDIO_OUTPUT_FLAG_DEEP_BUFFER;
+    });
+}
+
+bool isFastOutput(const hidl_vec<AudioInOutFlag> &flags) {
+    return std::any_of(flags.begin(), flags.end(), [](const AudioInOutFlag &flag){
+        return xsd::stringToAudioInOutFlag(flag) ==
+            xsd::AudioInOutFlag::AUDIO_OUTPUT_FLAG_FAST;
+    });
+}
+
 TimeSpec nsecs2TimeSpec(nsecs_t ns) {
     TimeSpec ts;
     ts.tvSec = ns2s(ns);
@@ -254,6 +269,21 @@ bool setThreadPriority(const SchedPolicy policy, const int prio) {
     return true;
 }
 
+bool setThreadSchedFifo(const int rtPrio) {
+    struct sched_param param = {
+        .sched_priority = rtPrio,
+    };
+
+    if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) < 0) {
+        const int e = errno;
+        ALOGE("%s:%d sched_setscheduler(SCHED_FIFO, %d) failed with %s (%d)",
+              __func__, __LINE__, rtPrio, strerror(e), e);
+        return FAILURE(false);
+    }
+
+    return true;
+}
+
 }  // namespace util
 }  // namespace implementation
 }  // namespace CPP_VERSION
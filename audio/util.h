@@ -30,9 +30,11 @@ namespace util {
 
 using ::android::hardware::hidl_bitfield;
 using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
 using ::android::hardware::audio::common::COMMON_TYPES_CPP_VERSION::AudioFormat;
 using ::android::hardware::audio::common::COMMON_TYPES_CPP_VERSION::AudioChannelMask;
 using ::android::hardware::audio::common::COMMON_TYPES_CPP_VERSION::AudioConfig;
+using ::android::hardware::audio::common::COMMON_TYPES_CPP_VERSION::AudioInOutFlag;
 using ::android::hardware::audio::common::COMMON_TYPES_CPP_VERSION::AudioPortConfig;
 using ::android::hardware::audio::CORE_TYPES_CPP_VERSION::MicrophoneInfo;
 using ::android::hardware::audio::CORE_TYPES_CPP_VERSION::TimeSpec;
@@ -51,6 +53,9 @@ bool checkAudioConfig(bool isOut,
 
 bool checkAudioPortConfig(const AudioPortConfig& cfg);
 
+bool isDeepBufferOutput(const hidl_vec<AudioInOutFlag> &flags);
+bool isFastOutput(const hidl_vec<AudioInOutFlag> &flags);
+
 TimeSpec nsecs2TimeSpec(nsecs_t);
 
 inline constexpr nsecs_t timespec2Nsecs(const TimeSpec &ts) {
@@ -58,6 +63,7 @@ inline constexpr nsecs_t timespec2Nsecs(const TimeSpec &ts) {
 }
 
 bool setThreadPriority(SchedPolicy policy, int prio);
+bool setThreadSchedFifo(int rtPrio);
 
 }  // namespace util
 }  // namespace implementation
@@ -67,6 +67,14 @@ template <class T> struct BlockingQueue {
         }
     }
 
+    // Takes everything queued, `get` does not return it anymore.
+    std::deque<T> takeAll() {
+        std::lock_guard lock(mtx);
+        std::deque<T> all;
+        all.swap(queue);
+        return all;
+    }
+
     void cancel() {
         std::lock_guard lock(mtx);
         cancelled = true;
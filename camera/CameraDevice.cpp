@@ -216,7 +216,8 @@ ScopedAStatus CameraDevice::getCameraCharacteristics(CameraMetadata* metadata) {
 
         m[ANDROID_REQUEST_MAX_NUM_INPUT_STREAMS] = int32_t(0);
         m[ANDROID_REQUEST_PIPELINE_MAX_DEPTH] = uint8_t(mHwCamera->getPipelineMaxDepth());
-        m[ANDROID_REQUEST_PARTIAL_RESULT_COUNT] = int32_t(1);
+        m[ANDROID_REQUEST_PARTIAL_RESULT_COUNT] =
+            CameraDeviceSession::kPartialResultCount;
         {
             auto& availableCaps = m[ANDROID_REQUEST_AVAILABLE_CAPABILITIES];
             uint32_t availableCapsBitmap =
@@ -330,6 +331,9 @@ ScopedAStatus CameraDevice::getCameraCharacteristics(CameraMetadata* metadata) {
     {   // ANDROID_INFO_...
         m[ANDROID_INFO_SUPPORTED_HARDWARE_LEVEL] =
             uint8_t(ANDROID_INFO_SUPPORTED_HARDWARE_LEVEL_LIMITED);
+        // buffers are requested with `requestStreamBuffers`, see CameraDeviceSession
+        m[ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION] =
+            uint8_t(ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION_HIDL_DEVICE_3_5);
     }
     {   // ANDROID_SYNC_
         m[ANDROID_SYNC_MAX_LATENCY] = ANDROID_SYNC_MAX_LATENCY_UNKNOWN;
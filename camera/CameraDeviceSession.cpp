@@ -17,15 +17,21 @@
 #define FAILURE_DEBUG_PREFIX "CameraDeviceSession"
 
 #include <inttypes.h>
+#include <stdio.h>
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <memory>
 
 #include <log/log.h>
 #include <aidlcommonsupport/NativeHandle.h>
 #include <utils/ThreadDefs.h>
 
+#include <aidl/android/hardware/camera/device/BufferRequest.h>
+#include <aidl/android/hardware/camera/device/BufferRequestStatus.h>
 #include <aidl/android/hardware/camera/device/ErrorCode.h>
+#include <aidl/android/hardware/camera/device/StreamBufferRet.h>
 #include <aidl/android/hardware/graphics/common/Dataspace.h>
 
 #include "debug.h"
@@ -42,8 +48,14 @@ namespace provider {
 namespace implementation {
 
 using aidl::android::hardware::camera::common::Status;
+using aidl::android::hardware::camera::device::BufferRequest;
+using aidl::android::hardware::camera::device::BufferRequestStatus;
+using aidl::android::hardware::camera::device::BufferStatus;
 using aidl::android::hardware::camera::device::CaptureResult;
 using aidl::android::hardware::camera::device::ErrorCode;
+using aidl::android::hardware::camera::device::NotifyMsg;
+using aidl::android::hardware::camera::device::StreamBufferRet;
+using aidl::android::hardware::camera::device::StreamBuffersVal;
 using aidl::android::hardware::camera::device::StreamRotation;
 using aidl::android::hardware::camera::device::StreamType;
 
@@ -55,6 +67,29 @@ constexpr char kClass[] = "CameraDeviceSession";
 constexpr int64_t kOneSecondNs = 1000000000;
 constexpr size_t kMsgQueueSize = 256 * 1024;
 
+// All sessions, see `CameraDeviceSession::dumpStats`.
+struct FlushStats {
+    std::atomic<uint64_t> flushes = 0;
+    std::atomic<uint64_t> totalUs = 0;
+    std::atomic<uint64_t> maxUs = 0;
+    std::atomic<uint64_t> slow = 0;  // over kRecommendedDeadlineMs
+    std::atomic<uint64_t> abortedCaptures = 0;
+} gFlushStats;
+
+// From opening the camera to the first frame's final result, all sessions
+// which got one.
+struct LaunchStats {
+    std::atomic<uint64_t> launches = 0;
+    std::atomic<uint64_t> totalUs = 0;
+    std::atomic<uint64_t> maxUs = 0;
+} gLaunchStats;
+
+void atomicMax(std::atomic<uint64_t>* x, const uint64_t value) {
+    for (uint64_t current = x->load();
+         (value > current) && !x->compare_exchange_weak(current, value); ) {
+    }
+}
+
 struct timespec timespecAddNanos(const struct timespec t, const int64_t addNs) {
     const lldiv_t r = lldiv(t.tv_nsec + addNs, kOneSecondNs);
 
@@ -82,11 +117,9 @@ const char* pixelFormatToStr(const PixelFormat fmt, char* buf, int bufSz) {
     }
 }
 
-void notifyError(ICameraDeviceCallback* cb,
-                 const int32_t frameNumber,
-                 const int32_t errorStreamId,
-                 const ErrorCode err) {
-    using aidl::android::hardware::camera::device::NotifyMsg;
+NotifyMsg makeErrorNotifyMsg(const int32_t frameNumber,
+                             const int32_t errorStreamId,
+                             const ErrorCode err) {
     using aidl::android::hardware::camera::device::ErrorMsg;
     using NotifyMsgTag = NotifyMsg::Tag;
 
@@ -100,14 +133,20 @@ void notifyError(ICameraDeviceCallback* cb,
         msg.set<NotifyMsgTag::error>(errorMsg);
     }
 
-    cb->notify({msg});
+    return msg;
+}
+
+void notifyError(ICameraDeviceCallback* cb,
+                 const int32_t frameNumber,
+                 const int32_t errorStreamId,
+                 const ErrorCode err) {
+    cb->notify({makeErrorNotifyMsg(frameNumber, errorStreamId, err)});
 }
 
 void notifyShutter(ICameraDeviceCallback* cb,
                    const int32_t frameNumber,
                    const int64_t shutterTimestamp,
                    const int64_t readoutTimestamp) {
-    using aidl::android::hardware::camera::device::NotifyMsg;
     using aidl::android::hardware::camera::device::ShutterMsg;
     using NotifyMsgTag = NotifyMsg::Tag;
 
@@ -124,17 +163,87 @@ void notifyShutter(ICameraDeviceCallback* cb,
     cb->notify({msg});
 }
 
-CaptureResult makeCaptureResult(const int frameNumber,
-                                CameraMetadata metadata,
-                                std::vector<StreamBuffer> outputBuffers) {
-    CaptureResult cr;
-    cr.frameNumber = frameNumber;
-    cr.result = std::move(metadata);
-    cr.outputBuffers = std::move(outputBuffers);
-    cr.inputBuffer.streamId = -1;
-    cr.inputBuffer.bufferId = 0;
-    cr.partialResult = cr.result.metadata.empty() ? 0 : 1;
-    return cr;
+// Limits the delayed results (JPEG compression) processed at the same time
+// in all sessions, to leave CPUs to the capture threads when several cameras
+// stream together.
+struct DelayedWorkBudget {
+    explicit DelayedWorkBudget(const unsigned n) : available(n) {}
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mtx);
+        released.wait(lock, [this](){ return available > 0; });
+        --available;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mtx);
+        ++available;
+        released.notify_one();
+    }
+
+    std::mutex mtx;
+    std::condition_variable released;
+    unsigned available;
+};
+
+DelayedWorkBudget& getDelayedWorkBudget() {
+    static DelayedWorkBudget budget(std::max(1U, std::thread::hardware_concurrency() / 2));
+    return budget;
+}
+
+constexpr int32_t kEarlyPartialResult = 1;
+
+// Sent as soon as a frame is begun: the 3A state and the request's controls,
+// the sensor's timing.
+bool isEarlyResultTag(const uint32_t tag) {
+    switch (tag) {
+    case ANDROID_SENSOR_TIMESTAMP:
+    case ANDROID_SENSOR_EXPOSURE_TIME:
+    case ANDROID_SENSOR_FRAME_DURATION:
+    case ANDROID_SENSOR_SENSITIVITY:
+    case ANDROID_SENSOR_ROLLING_SHUTTER_SKEW:
+    case ANDROID_FLASH_MODE:
+    case ANDROID_FLASH_STATE:
+    case ANDROID_LENS_STATE:
+        return true;
+
+    default:
+        return (tag >> 16) == ANDROID_CONTROL;
+    }
+}
+
+// A buffer the HAL could not get from the framework (HAL buffer management)
+StreamBuffer makeFailedStreamBuffer(const int32_t streamId) {
+    StreamBuffer sb;
+    sb.streamId = streamId;
+    sb.bufferId = 0;
+    sb.status = BufferStatus::ERROR;
+    return sb;
+}
+
+// `metadata` and `outputBuffers` are swapped (not copied) into `cr` to
+// reuse their storage, `recycleCaptureResult` swaps them back.
+void fillCaptureResult(CaptureResult* cr,
+                       const int frameNumber,
+                       const int32_t partialResult,
+                       CameraMetadata* metadata,
+                       std::vector<StreamBuffer>* outputBuffers) {
+    cr->frameNumber = frameNumber;
+    cr->result.metadata.swap(metadata->metadata);
+    cr->outputBuffers.swap(*outputBuffers);
+    cr->inputBuffer.streamId = -1;
+    cr->inputBuffer.bufferId = 0;
+    cr->fmqResultSize = 0;
+    cr->partialResult = cr->result.metadata.empty() ? 0 : partialResult;
+}
+
+void recycleCaptureResult(CaptureResult* cr,
+                          CameraMetadata* metadata,
+                          std::vector<StreamBuffer>* outputBuffers) {
+    cr->result.metadata.swap(metadata->metadata);
+    metadata->metadata.clear();
+    cr->outputBuffers.swap(*outputBuffers);
+    outputBuffers->clear();
 }
 }  // namespace
 
@@ -146,7 +255,8 @@ CameraDeviceSession::CameraDeviceSession(
          , mCb(std::move(cb))
          , mHwCamera(hwCamera)
          , mRequestQueue(kMsgQueueSize, false)
-         , mResultQueue(kMsgQueueSize, false) {
+         , mResultQueue(kMsgQueueSize, false)
+         , mCaptureResults(1) {
     LOG_ALWAYS_FATAL_IF(!mRequestQueue.isValid());
     LOG_ALWAYS_FATAL_IF(!mResultQueue.isValid());
     mCaptureThread = std::thread(&CameraDeviceSession::captureThreadLoop, this);
@@ -217,7 +327,10 @@ ScopedAStatus CameraDeviceSession::configureStreams(
 
     if (mHwCamera.configure(cfg.sessionParams, nStreams,
                             cfg.streams.data(), halStreams.data())) {
+        std::lock_guard<std::mutex> guard(mStreamBufferCacheMtx);
         mStreamBufferCache.clearStreamInfo();
+        mFlushedStreamIds.clear();
+        mStreamConfigCounter = cfg.streamConfigCounter;
         *halStreamsOut = std::move(halStreams);
         return ScopedAStatus::ok();
     } else {
@@ -268,8 +381,11 @@ ScopedAStatus CameraDeviceSession::processCaptureRequest(
         const std::vector<CaptureRequest>& requests,
         const std::vector<BufferCache>& cachesToRemove,
         int32_t* countOut) {
-    for (const BufferCache& bc : cachesToRemove) {
-        mStreamBufferCache.remove(bc.bufferId);
+    {
+        std::lock_guard<std::mutex> guard(mStreamBufferCacheMtx);
+        for (const BufferCache& bc : cachesToRemove) {
+            mStreamBufferCache.remove(bc.bufferId);
+        }
     }
 
     int count = 0;
@@ -287,10 +403,25 @@ ScopedAStatus CameraDeviceSession::processCaptureRequest(
     return ScopedAStatus::ok();
 }
 
+// The session does not keep buffers between frames, they are requested
+// right before a frame is captured and returned with its result. Flushing
+// a stream means not requesting its buffers anymore, the framework is about
+// to reconfigure it.
 ScopedAStatus CameraDeviceSession::signalStreamFlush(
-        const std::vector<int32_t>& /*streamIds*/,
-        const int32_t /*streamConfigCounter*/) {
-    return toScopedAStatus(FAILURE(Status::OPERATION_NOT_SUPPORTED));
+        const std::vector<int32_t>& streamIds,
+        const int32_t streamConfigCounter) {
+    std::lock_guard<std::mutex> guard(mStreamBufferCacheMtx);
+    if (streamConfigCounter < mStreamConfigCounter) {
+        return ScopedAStatus::ok();  // for the streams configured before
+    }
+
+    for (const int32_t streamId : streamIds) {
+        if (!isStreamFlushedLocked(streamId)) {
+            mFlushedStreamIds.push_back(streamId);
+        }
+    }
+
+    return ScopedAStatus::ok();
 }
 
 ScopedAStatus CameraDeviceSession::switchToOffline(
@@ -306,6 +437,20 @@ ScopedAStatus CameraDeviceSession::repeatingRequestEnd(
     return ScopedAStatus::ok();
 }
 
+void CameraDeviceSession::dumpStats(const int fd) {
+    const uint64_t launches = gLaunchStats.launches.load();
+    dprintf(fd, "open to first frame: %" PRIu64 ", avg=%" PRIu64 "us, max=%" PRIu64 "us\n",
+            launches, launches ? (gLaunchStats.totalUs.load() / launches) : 0,
+            gLaunchStats.maxUs.load());
+
+    const uint64_t flushes = gFlushStats.flushes.load();
+    dprintf(fd, "flushes: %" PRIu64 ", avg=%" PRIu64 "us, max=%" PRIu64 "us, "
+            "slow=%" PRIu64 ", captures aborted=%" PRIu64 "\n",
+            flushes, flushes ? (gFlushStats.totalUs.load() / flushes) : 0,
+            gFlushStats.maxUs.load(), gFlushStats.slow.load(),
+            gFlushStats.abortedCaptures.load());
+}
+
 bool CameraDeviceSession::isStreamCombinationSupported(const StreamConfiguration& cfg,
                                                        hw::HwCamera& hwCamera) {
     const auto [status, unused] = configureStreamsStatic(cfg, hwCamera);
@@ -317,10 +462,82 @@ void CameraDeviceSession::closeImpl() {
     mHwCamera.close();
 }
 
+// Queued requests and delayed results not started yet are failed right away,
+// only the frame being captured and the JPEGs being compressed are waited for.
 void CameraDeviceSession::flushImpl(const std::chrono::steady_clock::time_point start) {
     mFlushing = true;
+    const size_t aborted = abortQueuedCaptures();
     waitFlushingDone(start);
     mFlushing = false;
+
+    const uint64_t tookUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    ++gFlushStats.flushes;
+    gFlushStats.totalUs += tookUs;
+    gFlushStats.abortedCaptures += aborted;
+    atomicMax(&gFlushStats.maxUs, tookUs);
+
+    ALOGD("%s:%s:%d flushing took %" PRIu64 "us, %zu captures aborted",
+          kClass, __func__, __LINE__, tookUs, aborted);
+}
+
+// Returns the number of requests and delayed results failed, all of them
+// go to the framework with one `notify` and one `processCaptureResult`.
+size_t CameraDeviceSession::abortQueuedCaptures() {
+    std::deque<HwCaptureRequest> reqs = mCaptureRequests.takeAll();
+    std::deque<DelayedCaptureResult> dcrs = mDelayedCaptureResults.takeAll();
+    if (reqs.empty() && dcrs.empty()) {
+        return 0;
+    }
+
+    std::vector<NotifyMsg> msgs;
+    msgs.reserve(reqs.size());
+    std::vector<CaptureResult> results(reqs.size() + dcrs.size());
+    auto cr = results.begin();
+    CameraMetadata noMetadata;
+    std::vector<StreamBuffer> outputBuffers;
+    size_t numBuffers = 0;
+
+    for (HwCaptureRequest& req : reqs) {
+        msgs.push_back(makeErrorNotifyMsg(req.frameNumber, -1, ErrorCode::ERROR_REQUEST));
+
+        const size_t reqBuffersSize = req.buffers.size();
+        outputBuffers.resize(reqBuffersSize);
+        for (size_t i = 0; i < reqBuffersSize; ++i) {
+            CachedStreamBuffer* csb = req.buffers[i];
+            outputBuffers[i] = csb ? csb->finish(false) : makeFailedStreamBuffer(req.streamIds[i]);
+        }
+        numBuffers += reqBuffersSize;
+
+        req.buffers.clear();
+        mRequestBuffersPool.put(std::move(req.buffers));
+        req.streamIds.clear();
+        mRequestStreamIdsPool.put(std::move(req.streamIds));
+
+        fillCaptureResult(&*cr, req.frameNumber, 0, &noMetadata, &outputBuffers);
+        ++cr;
+    }
+
+    for (DelayedCaptureResult& dcr : dcrs) {
+        // `delayedBuffer(false)` only releases the buffer (fast).
+        outputBuffers.assign(1, dcr.delayedBuffer(false));
+        ++numBuffers;
+
+        fillCaptureResult(&*cr, dcr.frameNumber, 0, &noMetadata, &outputBuffers);
+        ++cr;
+    }
+
+    if (!msgs.empty()) {
+        mCb->notify(msgs);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mResultQueueMutex);
+        mCb->processCaptureResult(results);
+    }
+
+    notifyBuffersReturned(numBuffers);
+    return results.size();
 }
 
 int CameraDeviceSession::waitFlushingDone(const std::chrono::steady_clock::time_point start) {
@@ -340,6 +557,7 @@ int CameraDeviceSession::waitFlushingDone(const std::chrono::steady_clock::time_
         const int waitedForMs = (std::chrono::steady_clock::now() - start) / 1ms;
 
         if (waitedForMs > kRecommendedDeadlineMs) {
+            ++gFlushStats.slow;
             ALOGW("%s:%s:%d: flushing took %dms, Android "
                   "recommends %dms latency and requires no more than %dms",
                   kClass, __func__, __LINE__, waitedForMs, kRecommendedDeadlineMs,
@@ -479,9 +697,18 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
         hwReq.metadataUpdate = request.settings;
     }
 
+    hwReq.buffers = mRequestBuffersPool.get();
     hwReq.buffers.resize(outputBuffersSize);
-    for (size_t i = 0; i < outputBuffersSize; ++i) {
-        hwReq.buffers[i] = mStreamBufferCache.update(request.outputBuffers[i]);
+    hwReq.streamIds = mRequestStreamIdsPool.get();
+    hwReq.streamIds.resize(outputBuffersSize);
+    {
+        std::lock_guard<std::mutex> guard(mStreamBufferCacheMtx);
+        for (size_t i = 0; i < outputBuffersSize; ++i) {
+            const StreamBuffer& sb = request.outputBuffers[i];
+            // bufferId=0 - HAL buffer management, see acquireStreamBuffers
+            hwReq.buffers[i] = sb.bufferId ? mStreamBufferCache.update(sb) : nullptr;
+            hwReq.streamIds[i] = sb.streamId;
+        }
     }
 
     {
@@ -531,30 +758,66 @@ struct timespec CameraDeviceSession::captureOneFrame(struct timespec nextFrameT,
     }
 
     const int32_t frameNumber = req.frameNumber;
+    hw::HwCaptureResult& result = mCaptureResult;
+
+    // A flush is seen before buffers are requested: the request fails as a
+    // whole (ERROR_REQUEST) and no buffer gets an ERROR_BUFFER of its own.
+    if (mFlushing) {
+        disposeCaptureRequest(std::move(req));
+        return nextFrameT;
+    }
+
+    acquireStreamBuffers(&req, &mFailedBuffers);
+
+    const auto [frameDurationNs, exposureDurationNs] =
+        mHwCamera.beginCaptureRequest(std::move(req.metadataUpdate), &result.metadata);
+
+    // The shutter and the 3A part of the metadata go before the frame is
+    // rendered, the rest goes with the buffers.
+    const int64_t shutterTimestampNs = timespec2nanos(nextFrameT);
+    notifyShutter(&*mCb, frameNumber, shutterTimestampNs, shutterTimestampNs + exposureDurationNs);
+    metadataSetShutterTimestamp(&result.metadata, shutterTimestampNs);
+    metadataSplit(&result.metadata, &mEarlyResultMetadata, &mSplitResultMetadata,
+                  &isEarlyResultTag);
+    if (!mEarlyResultMetadata.metadata.empty()) {
+        std::vector<StreamBuffer> noBuffers;
+        consumeCaptureResult(frameNumber, kEarlyPartialResult,
+                             &mEarlyResultMetadata, &noBuffers);
+    }
 
-    auto [frameDurationNs, exposureDurationNs, metadata,
-          outputBuffers, delayedOutputBuffers] =
-        mHwCamera.processCaptureRequest(std::move(req.metadataUpdate),
-                                        {req.buffers.begin(), req.buffers.end()});
+    const bool processed =
+        mHwCamera.processCaptureRequest({req.buffers.begin(), req.buffers.end()},
+                                        &result);
 
-    for (hw::DelayedStreamBuffer& dsb : delayedOutputBuffers) {
+    req.buffers.clear();
+    mRequestBuffersPool.put(std::move(req.buffers));
+    req.streamIds.clear();
+    mRequestStreamIdsPool.put(std::move(req.streamIds));
+
+    result.outputBuffers.insert(result.outputBuffers.end(),
+                                mFailedBuffers.begin(), mFailedBuffers.end());
+    mFailedBuffers.clear();
+
+    for (hw::DelayedStreamBuffer& dsb : result.delayedOutputBuffers) {
         DelayedCaptureResult dcr;
         dcr.delayedBuffer = std::move(dsb);
         dcr.frameNumber = frameNumber;
         if (!mDelayedCaptureResults.put(&dcr)) {
             // `delayedBuffer(false)` only releases the buffer (fast).
-            outputBuffers.push_back(dcr.delayedBuffer(false));
+            result.outputBuffers.push_back(dcr.delayedBuffer(false));
         }
     }
+    result.delayedOutputBuffers.clear();
 
-    const int64_t shutterTimestampNs = timespec2nanos(nextFrameT);
-    notifyShutter(&*mCb, frameNumber, shutterTimestampNs, shutterTimestampNs + exposureDurationNs);
-    metadataSetShutterTimestamp(&metadata, shutterTimestampNs);
-    consumeCaptureResult(makeCaptureResult(frameNumber,
-        std::move(metadata), std::move(outputBuffers)));
+    consumeCaptureResult(frameNumber, kPartialResultCount,
+                         &result.metadata, &result.outputBuffers);
 
-    if (frameDurationNs > 0) {
+    if ((frameDurationNs > 0) && processed) {
         nextFrameT = timespecAddNanos(nextFrameT, frameDurationNs);
+        if (!mFirstFrameCaptured) {
+            mFirstFrameCaptured = true;
+            recordLaunch();
+        }
     } else {
         notifyError(&*mCb, frameNumber, -1, ErrorCode::ERROR_DEVICE);
     }
@@ -562,55 +825,170 @@ struct timespec CameraDeviceSession::captureOneFrame(struct timespec nextFrameT,
     return nextFrameT;
 }
 
+// Requests the buffers the framework did not attach to `req`. The buffers
+// the framework could not provide are removed from `req` and put to
+// `failedBuffers` with ERROR_BUFFER notified for them.
+void CameraDeviceSession::acquireStreamBuffers(HwCaptureRequest* req,
+                                               std::vector<StreamBuffer>* failedBuffers) {
+    std::vector<CachedStreamBuffer*>& buffers = req->buffers;
+    const std::vector<int32_t>& streamIds = req->streamIds;
+    const size_t buffersSize = buffers.size();
+
+    std::vector<BufferRequest>& bufReqs = mBufferRequests;
+    bufReqs.clear();
+    {
+        std::lock_guard<std::mutex> guard(mStreamBufferCacheMtx);
+        for (size_t i = 0; i < buffersSize; ++i) {
+            if (!buffers[i] && !isStreamFlushedLocked(streamIds[i])) {
+                BufferRequest br;
+                br.streamId = streamIds[i];
+                br.numBuffersRequested = 1;
+                bufReqs.push_back(br);
+            }
+        }
+    }
+
+    std::vector<StreamBufferRet>& bufRets = mBufferRets;  // empty, see below
+    if (!bufReqs.empty()) {
+        BufferRequestStatus status;
+        const ScopedAStatus s = mCb->requestStreamBuffers(bufReqs, &bufRets, &status);
+        if (!s.isOk()) {
+            ALOGW("%s:%s:%d requestStreamBuffers failed for frameNumber=%d: %s",
+                  kClass, __func__, __LINE__, req->frameNumber, s.getDescription().c_str());
+            bufRets.clear();
+        } else if (status != BufferRequestStatus::OK) {
+            ALOGW("%s:%s:%d requestStreamBuffers returned status=%d for frameNumber=%d",
+                  kClass, __func__, __LINE__, static_cast<int>(status), req->frameNumber);
+        }
+    }
+
+    // The buffers the framework sent for no request go back right away
+    std::vector<StreamBuffer> unexpectedBuffers;
+    {
+        std::lock_guard<std::mutex> guard(mStreamBufferCacheMtx);
+        for (StreamBufferRet& bufRet : bufRets) {
+            if (bufRet.val.getTag() != StreamBuffersVal::Tag::buffers) {
+                continue;  // failed below
+            }
+
+            for (StreamBuffer& sb : bufRet.val.get<StreamBuffersVal::Tag::buffers>()) {
+                size_t i = 0;
+                while ((i < buffersSize) &&
+                        (buffers[i] || (streamIds[i] != bufRet.streamId))) {
+                    ++i;
+                }
+
+                if ((i < buffersSize) && sb.bufferId) {
+                    buffers[i] = mStreamBufferCache.update(sb);
+                } else {
+                    StreamBuffer unexpected;
+                    unexpected.streamId = bufRet.streamId;
+                    unexpected.bufferId = sb.bufferId;
+                    unexpected.status = BufferStatus::ERROR;
+                    unexpected.releaseFence = std::move(sb.acquireFence);
+                    unexpectedBuffers.push_back(std::move(unexpected));
+                }
+            }
+        }
+    }
+    bufRets.clear();  // the buffers' handles are not kept until the next frame
+
+    if (!unexpectedBuffers.empty()) {
+        ALOGW("%s:%s:%d returning %zu unexpected buffers for frameNumber=%d",
+              kClass, __func__, __LINE__, unexpectedBuffers.size(), req->frameNumber);
+        mCb->returnStreamBuffers(unexpectedBuffers);
+    }
+
+    for (size_t i = 0; i < buffersSize; ++i) {
+        if (!buffers[i]) {
+            notifyError(&*mCb, req->frameNumber, streamIds[i], ErrorCode::ERROR_BUFFER);
+            failedBuffers->push_back(makeFailedStreamBuffer(streamIds[i]));
+        }
+    }
+
+    // HwCamera expects no nullptr in the request
+    buffers.erase(std::remove(buffers.begin(), buffers.end(), nullptr), buffers.end());
+}
+
+bool CameraDeviceSession::isStreamFlushedLocked(const int32_t streamId) const {
+    return std::find(mFlushedStreamIds.begin(), mFlushedStreamIds.end(),
+                     streamId) != mFlushedStreamIds.end();
+}
+
 void CameraDeviceSession::delayedCaptureThreadLoop() {
+    CameraMetadata noMetadata;
+    std::vector<StreamBuffer> outputBuffers;
+    DelayedWorkBudget& budget = getDelayedWorkBudget();
+
     while (true) {
         std::optional<DelayedCaptureResult> maybeDCR = mDelayedCaptureResults.get();
         if (maybeDCR.has_value()) {
-            const DelayedCaptureResult& dcr = maybeDCR.value();
+            DelayedCaptureResult& dcr = maybeDCR.value();
 
             // `dcr.delayedBuffer(true)` is expected to be slow, so we do not
             // produce too much IPC traffic here. This also returns buffes to
             // the framework earlier to reuse in capture requests.
-            std::vector<StreamBuffer> outputBuffers(1);
-            outputBuffers.front() = dcr.delayedBuffer(!mFlushing);
-            consumeCaptureResult(makeCaptureResult(dcr.frameNumber,
-                {}, std::move(outputBuffers)));
+            if (mFlushing) {
+                outputBuffers.push_back(dcr.delayedBuffer(false));
+            } else {
+                budget.acquire();
+                outputBuffers.push_back(dcr.delayedBuffer(!mFlushing));
+                budget.release();
+            }
+            consumeCaptureResult(dcr.frameNumber, 0, &noMetadata, &outputBuffers);
         } else {
             break;
         }
     }
 }
 
+// The camera launch latency as the framework sees it: from `open` to the
+// first frame's final result (including configureStreams and the first
+// request coming).
+void CameraDeviceSession::recordLaunch() const {
+    const uint64_t tookUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - mOpenT).count();
+    ++gLaunchStats.launches;
+    gLaunchStats.totalUs += tookUs;
+    atomicMax(&gLaunchStats.maxUs, tookUs);
+
+    ALOGI("%s:%s:%d the first frame came %" PRIu64 "us after open",
+          kClass, __func__, __LINE__, tookUs);
+}
+
 void CameraDeviceSession::disposeCaptureRequest(HwCaptureRequest req) {
     notifyError(&*mCb, req.frameNumber, -1, ErrorCode::ERROR_REQUEST);
 
     const size_t reqBuffersSize = req.buffers.size();
+    CameraMetadata noMetadata;
+    std::vector<StreamBuffer> outputBuffers(reqBuffersSize);
 
-    {
-        std::vector<StreamBuffer> outputBuffers(reqBuffersSize);
-
-        for (size_t i = 0; i < reqBuffersSize; ++i) {
-            CachedStreamBuffer* csb = req.buffers[i];
-            LOG_ALWAYS_FATAL_IF(!csb);  // otherwise mNumBuffersInFlight will be hard
-            outputBuffers[i] = csb->finish(false);
-        }
-
-        std::vector<CaptureResult> crs(1);
-        crs.front() = makeCaptureResult(req.frameNumber, {},
-                                        std::move(outputBuffers));
-
-        std::lock_guard<std::mutex> guard(mResultQueueMutex);
-        mCb->processCaptureResult(std::move(crs));
+    for (size_t i = 0; i < reqBuffersSize; ++i) {
+        CachedStreamBuffer* csb = req.buffers[i];
+        outputBuffers[i] = csb ? csb->finish(false) : makeFailedStreamBuffer(req.streamIds[i]);
     }
 
-    notifyBuffersReturned(reqBuffersSize);
+    req.buffers.clear();
+    mRequestBuffersPool.put(std::move(req.buffers));
+    req.streamIds.clear();
+    mRequestStreamIdsPool.put(std::move(req.streamIds));
+
+    consumeCaptureResult(req.frameNumber, 0, &noMetadata, &outputBuffers);
 }
 
-void CameraDeviceSession::consumeCaptureResult(CaptureResult cr) {
-    const size_t numBuffers = cr.outputBuffers.size();
+// `metadata` and `outputBuffers` are returned empty with their storage kept
+// for the next result.
+void CameraDeviceSession::consumeCaptureResult(const int32_t frameNumber,
+                                               const int32_t partialResult,
+                                               CameraMetadata* metadata,
+                                               std::vector<StreamBuffer>* outputBuffers) {
+    const size_t numBuffers = outputBuffers->size();
 
     {
         std::lock_guard<std::mutex> guard(mResultQueueMutex);
+        CaptureResult& cr = mCaptureResults.front();
+        fillCaptureResult(&cr, frameNumber, partialResult, metadata, outputBuffers);
+
         const size_t metadataSize = cr.result.metadata.size();
         if ((metadataSize > 0) && mResultQueue.write(
                 reinterpret_cast<int8_t*>(cr.result.metadata.data()),
@@ -619,9 +997,8 @@ void CameraDeviceSession::consumeCaptureResult(CaptureResult cr) {
             cr.result.metadata.clear();
         }
 
-        std::vector<CaptureResult> crs(1);
-        crs.front() = std::move(cr);
-        mCb->processCaptureResult(std::move(crs));
+        mCb->processCaptureResult(mCaptureResults);
+        recycleCaptureResult(&cr, metadata, outputBuffers);
     }
 
     notifyBuffersReturned(numBuffers);
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <deque>
 #include <memory>
@@ -25,11 +26,14 @@
 
 #include <aidl/android/hardware/camera/common/Status.h>
 #include <aidl/android/hardware/camera/device/BnCameraDeviceSession.h>
+#include <aidl/android/hardware/camera/device/BufferRequest.h>
+#include <aidl/android/hardware/camera/device/StreamBufferRet.h>
 
 #include <fmq/AidlMessageQueue.h>
 
 #include "BlockingQueue.h"
 #include "HwCamera.h"
+#include "ObjectPool.h"
 #include "StreamBufferCache.h"
 
 namespace android {
@@ -42,6 +46,7 @@ using aidl::android::hardware::camera::common::Status;
 
 using aidl::android::hardware::camera::device::BnCameraDeviceSession;
 using aidl::android::hardware::camera::device::BufferCache;
+using aidl::android::hardware::camera::device::BufferRequest;
 using aidl::android::hardware::camera::device::CameraMetadata;
 using aidl::android::hardware::camera::device::CameraOfflineSessionInfo;
 using aidl::android::hardware::camera::device::CaptureRequest;
@@ -51,6 +56,7 @@ using aidl::android::hardware::camera::device::ICameraDeviceCallback;
 using aidl::android::hardware::camera::device::ICameraOfflineSession;
 using aidl::android::hardware::camera::device::RequestTemplate;
 using aidl::android::hardware::camera::device::StreamBuffer;
+using aidl::android::hardware::camera::device::StreamBufferRet;
 using aidl::android::hardware::camera::device::StreamConfiguration;
 
 using aidl::android::hardware::common::fmq::MQDescriptor;
@@ -64,6 +70,9 @@ using ndk::ScopedAStatus;
 struct CameraDevice;
 
 struct CameraDeviceSession : public BnCameraDeviceSession {
+    // ANDROID_REQUEST_PARTIAL_RESULT_COUNT, see `captureOneFrame`
+    static constexpr int32_t kPartialResultCount = 2;
+
     CameraDeviceSession(std::shared_ptr<CameraDevice> parent,
                         std::shared_ptr<ICameraDeviceCallback> cb,
                         hw::HwCamera& hwCamera);
@@ -95,6 +104,7 @@ struct CameraDeviceSession : public BnCameraDeviceSession {
 
     static bool isStreamCombinationSupported(const StreamConfiguration& cfg,
                                              hw::HwCamera& hwCamera);
+    static void dumpStats(int fd);
 
 private:
     using MetadataQueue = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
@@ -108,29 +118,53 @@ private:
     void closeImpl();
     void flushImpl(std::chrono::steady_clock::time_point start);
     int waitFlushingDone(std::chrono::steady_clock::time_point start);
+    size_t abortQueuedCaptures();
     static std::pair<Status, std::vector<HalStream>>
         configureStreamsStatic(const StreamConfiguration& cfg,
                                hw::HwCamera& hwCamera);
     Status processOneCaptureRequest(const CaptureRequest& request);
+    void acquireStreamBuffers(HwCaptureRequest* req,
+                              std::vector<StreamBuffer>* failedBuffers);
+    bool isStreamFlushedLocked(int32_t streamId) const;
     void captureThreadLoop();
     void delayedCaptureThreadLoop();
     bool popCaptureRequest(HwCaptureRequest* req);
     struct timespec captureOneFrame(struct timespec nextFrameT, HwCaptureRequest req);
     void disposeCaptureRequest(HwCaptureRequest req);
-    void consumeCaptureResult(CaptureResult cr);
+    void recordLaunch() const;
+    void consumeCaptureResult(int32_t frameNumber, int32_t partialResult,
+                              CameraMetadata* metadata,
+                              std::vector<StreamBuffer>* outputBuffers);
     void notifyBuffersReturned(size_t n);
 
+    const std::chrono::steady_clock::time_point mOpenT =
+        std::chrono::steady_clock::now();
     const std::shared_ptr<CameraDevice> mParent;
     const std::shared_ptr<ICameraDeviceCallback> mCb;
     hw::HwCamera& mHwCamera;
     MetadataQueue mRequestQueue;
     MetadataQueue mResultQueue;
     std::mutex mResultQueueMutex;
+    std::vector<CaptureResult> mCaptureResults;  // guarded by mResultQueueMutex
 
-    StreamBufferCache mStreamBufferCache;
+    StreamBufferCache mStreamBufferCache;  // guarded by mStreamBufferCacheMtx
+    // signalStreamFlush'ed streams, no buffers are requested for them until
+    // the next configureStreams
+    std::vector<int32_t> mFlushedStreamIds;  // guarded by mStreamBufferCacheMtx
+    int32_t mStreamConfigCounter = 0;  // guarded by mStreamBufferCacheMtx
+    std::mutex mStreamBufferCacheMtx;
 
     BlockingQueue<HwCaptureRequest> mCaptureRequests;
     BlockingQueue<DelayedCaptureResult> mDelayedCaptureResults;
+    ObjectPool<std::vector<CachedStreamBuffer*>> mRequestBuffersPool;
+    ObjectPool<std::vector<int32_t>> mRequestStreamIdsPool;
+    hw::HwCaptureResult mCaptureResult;  // used by mCaptureThread only
+    std::vector<StreamBuffer> mFailedBuffers;  // used by mCaptureThread only
+    std::vector<BufferRequest> mBufferRequests;  // used by mCaptureThread only
+    std::vector<StreamBufferRet> mBufferRets;  // used by mCaptureThread only
+    CameraMetadata mEarlyResultMetadata;  // used by mCaptureThread only
+    CameraMetadata mSplitResultMetadata;  // used by mCaptureThread only
+    bool mFirstFrameCaptured = false;  // used by mCaptureThread only
 
     size_t mNumBuffersInFlight = 0;
     std::condition_variable mNoBuffersInFlight;
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <charconv>
 
 #include <inttypes.h>
@@ -22,8 +23,10 @@
 
 #include "CameraProvider.h"
 #include "CameraDevice.h"
+#include "CameraDeviceSession.h"
 #include "HwCamera.h"
 #include "debug.h"
+#include "memory_counters.h"
 
 namespace android {
 namespace hardware {
@@ -33,6 +36,11 @@ namespace implementation {
 namespace {
 constexpr char kCameraIdPrefix[] = "device@1.0/internal/";
 
+// The largest stream size (s1440p) the framework guarantees for concurrent
+// streaming, both cameras share the renderer and the JPEG budget.
+constexpr int32_t kMaxConcurrentStreamWidth = 1920;
+constexpr int32_t kMaxConcurrentStreamHeight = 1440;
+
 std::string getLogicalCameraId(const int index) {
     char buf[sizeof(kCameraIdPrefix) + 8];
     snprintf(buf, sizeof(buf), "%s%d", kCameraIdPrefix, index);
@@ -118,19 +126,84 @@ ScopedAStatus CameraProvider::notifyDeviceStateChange(const int64_t /*deviceStat
     return ScopedAStatus::ok();
 }
 
+// Any two cameras that support it (the FakeRotatingCamera ones, they share
+// the renderer) can stream together. QemuCamera ones would need two host
+// webcams streaming at once, nothing here can tell if the host does it.
 ScopedAStatus CameraProvider::getConcurrentCameraIds(
         std::vector<ConcurrentCameraIdCombination>* concurrentCameraIds) {
-    *concurrentCameraIds = {};
+    std::vector<int> indexes;
+    for (int i = 0; i < mAvailableCameras.size(); ++i) {
+        const hw::HwCameraFactoryProduct hwCamera = mAvailableCameras[i]();
+        if (hwCamera && hwCamera->isConcurrentStreamingSupported()) {
+            indexes.push_back(i);
+        }
+    }
+
+    std::vector<ConcurrentCameraIdCombination> combinations;
+    const int n = indexes.size();
+    for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            ConcurrentCameraIdCombination c;
+            c.combination.push_back(getLogicalCameraId(mDeviceIdBase + indexes[i]));
+            c.combination.push_back(getLogicalCameraId(mDeviceIdBase + indexes[j]));
+            combinations.push_back(std::move(c));
+        }
+    }
+
+    *concurrentCameraIds = std::move(combinations);
     return ScopedAStatus::ok();
 }
 
 ScopedAStatus CameraProvider::isConcurrentStreamCombinationSupported(
-        const std::vector<CameraIdAndStreamCombination>& /*configs*/,
+        const std::vector<CameraIdAndStreamCombination>& configs,
         bool* support) {
     *support = false;
+    if (configs.size() > 2) {
+        return ScopedAStatus::ok();  // see getConcurrentCameraIds
+    }
+
+    std::vector<int> indexes;
+    for (const CameraIdAndStreamCombination& config : configs) {
+        const std::optional<int> maybeIndex = parseLogicalCameraId(config.cameraId);
+        if (!maybeIndex) {
+            return toScopedAStatus(FAILURE(Status::ILLEGAL_ARGUMENT));
+        }
+
+        const int index = maybeIndex.value() - mDeviceIdBase;
+        if ((index < 0) || (index >= mAvailableCameras.size())) {
+            return toScopedAStatus(FAILURE(Status::ILLEGAL_ARGUMENT));
+        }
+
+        if (std::find(indexes.begin(), indexes.end(), index) != indexes.end()) {
+            return ScopedAStatus::ok();
+        }
+        indexes.push_back(index);
+
+        const StreamConfiguration& cfg = config.streamConfiguration;
+        for (const auto& s : cfg.streams) {
+            if ((s.width > kMaxConcurrentStreamWidth) ||
+                    (s.height > kMaxConcurrentStreamHeight)) {
+                return ScopedAStatus::ok();
+            }
+        }
+
+        const hw::HwCameraFactoryProduct hwCamera = mAvailableCameras[index]();
+        if (!hwCamera || !hwCamera->isConcurrentStreamingSupported() ||
+                !CameraDeviceSession::isStreamCombinationSupported(cfg, *hwCamera)) {
+            return ScopedAStatus::ok();
+        }
+    }
+
+    *support = true;
     return ScopedAStatus::ok();
 }
 
+binder_status_t CameraProvider::dump(const int fd, const char**, uint32_t) {
+    memaccount::dump(fd);
+    CameraDeviceSession::dumpStats(fd);
+    return STATUS_OK;
+}
+
 }  // namespace implementation
 }  // namespace provider
 }  // namespace camera
@@ -56,6 +56,8 @@ struct CameraProvider : public BnCameraProvider {
             const std::vector<CameraIdAndStreamCombination>& in_configs,
             bool* support) override;
 
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
 private:
     const int mDeviceIdBase;
     const Span<const hw::HwCameraFactory> mAvailableCameras;
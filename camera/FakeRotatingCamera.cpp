@@ -16,6 +16,8 @@
 
 #define FAILURE_DEBUG_PREFIX "FakeRotatingCamera"
 
+#include <algorithm>
+
 #include <log/log.h>
 #include <android-base/properties.h>
 #include <system/camera_metadata.h>
@@ -25,6 +27,7 @@
 
 #include <gralloc_cb_bp.h>
 #include <qemu_pipe_bp.h>
+#include <qemud.h>
 
 #define GL_GLEXT_PROTOTYPES
 #define EGL_EGLEXT_PROTOTYPES
@@ -41,6 +44,7 @@
 #include "FakeRotatingCamera.h"
 #include "jpeg.h"
 #include "metadata_utils.h"
+#include "SoftRenderer.h"
 #include "utils.h"
 #include "yuv.h"
 
@@ -89,16 +93,38 @@ constexpr uint32_t toR8G8B8A8(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
     return uint32_t(r) | (uint32_t(g) << 8) | (uint32_t(b) << 16) | (uint32_t(a) << 24);
 }
 
+// glClearColor(0.2, 0.3, 0.2, 1.0) in `drawSceneImpl`
+constexpr uint32_t kSoftClearColor = toR8G8B8A8(51, 77, 51, 255);
+
 constexpr double degrees2rad(const double degrees) {
     return degrees * M_PI / 180.0;
 }
 
+constexpr uint32_t fromR5G6B5(const uint16_t c) {
+    return toR8G8B8A8(((c >> 11) & 31) * 255 / 31,
+                      ((c >> 5) & 63) * 255 / 63,
+                      (c & 31) * 255 / 31,
+                      255);
+}
+
+std::string getSceneProperty(const char* name) {
+    std::string valueStr =
+        base::GetProperty(std::string("vendor.qemu.FakeRotatingCamera.") + name, "");
+    if (valueStr.empty()) {
+        valueStr =
+            base::GetProperty(std::string("ro.boot.qemu.FakeRotatingCamera.") + name, "");
+    }
+
+    return valueStr;
+}
+
 // This texture is useful to debug camera orientation and image aspect ratio
-abc3d::AutoTexture loadTestPatternTextureA() {
-    constexpr uint16_t B = toR5G6B5(.4, .4, .4);
-    constexpr uint16_t R = toR5G6B5( 1, .1, .1);
+SoftRenderer::Texture loadTestPatternTextureA() {
+    constexpr uint32_t B = fromR5G6B5(toR5G6B5(.4, .4, .4));
+    constexpr uint32_t R = fromR5G6B5(toR5G6B5( 1, .1, .1));
 
-    static const uint16_t texels[] = {
+    SoftRenderer::Texture tex;
+    tex.texels = {
         B, R, R, R, R, R, B, B,
         R, B, B, B, B, B, R, B,
         B, B, B, B, B, B, R, B,
@@ -108,18 +134,17 @@ abc3d::AutoTexture loadTestPatternTextureA() {
         R, B, B, B, B, B, R, B,
         B, R, R, R, R, R, B, R,
     };
-
-    abc3d::AutoTexture tex(GL_TEXTURE_2D, GL_RGB, 8, 8,
-                           GL_RGB, GL_UNSIGNED_SHORT_5_6_5, texels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    tex.width = 8;
+    tex.height = 8;
+    tex.linear = false;
 
     return tex;
 }
 
 // This texture is useful to debug camera dataspace
-abc3d::AutoTexture loadTestPatternTextureColors() {
-    static const uint32_t texels[] = {
+SoftRenderer::Texture loadTestPatternTextureColors() {
+    SoftRenderer::Texture tex;
+    tex.texels = {
         toR8G8B8A8(32, 0, 0, 255), toR8G8B8A8(64, 0, 0, 255), toR8G8B8A8(96, 0, 0, 255), toR8G8B8A8(128, 0, 0, 255),
         toR8G8B8A8(160, 0, 0, 255), toR8G8B8A8(192, 0, 0, 255), toR8G8B8A8(224, 0, 0, 255), toR8G8B8A8(255, 0, 0, 255),
 
@@ -144,26 +169,25 @@ abc3d::AutoTexture loadTestPatternTextureColors() {
         toR8G8B8A8(0, 0, 0, 255), toR8G8B8A8(32, 32, 32, 255), toR8G8B8A8(64, 64, 64, 255), toR8G8B8A8(96, 96, 96, 255),
         toR8G8B8A8(128, 128, 128, 255), toR8G8B8A8(160, 160, 160, 255), toR8G8B8A8(192, 192, 192, 255), toR8G8B8A8(224, 224, 224, 255),
     };
-
-    abc3d::AutoTexture tex(GL_TEXTURE_2D, GL_RGBA, 8, 8,
-                           GL_RGBA, GL_UNSIGNED_BYTE, texels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    tex.width = 8;
+    tex.height = 8;
+    tex.linear = false;
 
     return tex;
 }
 
 // This texture is used to pass CtsVerifier
-abc3d::AutoTexture loadTestPatternTextureAcircles() {
-    constexpr uint16_t kPalette[] = {
-        toR5G6B5(0, 0, 0),
-        toR5G6B5(.25, .25, .25),
-        toR5G6B5(.5, .5, .5),
-        toR5G6B5(1, 1, 0),
-        toR5G6B5(1, 1, 1),
+SoftRenderer::Texture loadTestPatternTextureAcircles() {
+    constexpr uint32_t kPalette[] = {
+        fromR5G6B5(toR5G6B5(0, 0, 0)),
+        fromR5G6B5(toR5G6B5(.25, .25, .25)),
+        fromR5G6B5(toR5G6B5(.5, .5, .5)),
+        fromR5G6B5(toR5G6B5(1, 1, 0)),
+        fromR5G6B5(toR5G6B5(1, 1, 1)),
     };
 
-    std::vector<uint16_t> texels;
+    SoftRenderer::Texture tex;
+    std::vector<uint32_t>& texels = tex.texels;
     texels.reserve(kAcirclesPatternWidth * kAcirclesPatternWidth);
 
     auto i = std::begin(kAcirclesPatternRLE);
@@ -172,7 +196,7 @@ abc3d::AutoTexture loadTestPatternTextureAcircles() {
         const unsigned x = *i;
         ++i;
         unsigned n;
-        uint16_t color;
+        uint32_t color;
         if (x & 1) {
             n = (x >> 3) + 1;
             color = kPalette[(x >> 1) & 3];
@@ -188,22 +212,15 @@ abc3d::AutoTexture loadTestPatternTextureAcircles() {
         texels.insert(texels.end(), n, color);
     }
 
-    abc3d::AutoTexture tex(GL_TEXTURE_2D, GL_RGB,
-                           kAcirclesPatternWidth, kAcirclesPatternWidth,
-                           GL_RGB, GL_UNSIGNED_SHORT_5_6_5, texels.data());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    tex.width = kAcirclesPatternWidth;
+    tex.height = kAcirclesPatternWidth;
+    tex.linear = true;
 
     return tex;
 }
 
-abc3d::AutoTexture loadTestPatternTexture() {
-    std::string valueStr =
-        base::GetProperty("vendor.qemu.FakeRotatingCamera.scene", "");
-    if (valueStr.empty()) {
-        valueStr =
-            base::GetProperty("ro.boot.qemu.FakeRotatingCamera.scene", "");
-    }
+SoftRenderer::Texture loadTestPattern() {
+    const std::string valueStr = getSceneProperty("scene");
 
     if (strcmp(valueStr.c_str(), "a") == 0) {
         return loadTestPatternTextureA();
@@ -214,6 +231,39 @@ abc3d::AutoTexture loadTestPatternTexture() {
     }
 }
 
+abc3d::AutoTexture loadTestPatternTexture() {
+    const SoftRenderer::Texture pattern = loadTestPattern();
+
+    abc3d::AutoTexture tex(GL_TEXTURE_2D, GL_RGBA, pattern.width, pattern.height,
+                           GL_RGBA, GL_UNSIGNED_BYTE, pattern.texels.data());
+    const GLint filter = pattern.linear ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+    return tex;
+}
+
+// The software renderer is used if requested with the `renderer=soft`
+// property or if there is no EGL.
+bool useSoftRenderer() {
+    static const bool value = [](){
+        if (getSceneProperty("renderer") == "soft") {
+            return true;
+        }
+
+        abc3d::EglContext context;
+        if (!context.init().ok()) {
+            ALOGW("%s:%s:%d EGL is not available, using the software renderer",
+                  kClass, __func__, __LINE__);
+            return true;
+        }
+
+        return false;
+    }();
+
+    return value;
+}
+
 bool compressNV21IntoJpeg(const Rect<uint16_t> imageSize,
                           const uint8_t* nv21data,
                           const CameraMetadata& metadata,
@@ -228,8 +278,16 @@ bool compressNV21IntoJpeg(const Rect<uint16_t> imageSize,
 
 }  // namespace
 
+bool FakeRotatingCamera::RenderParams::operator==(const RenderParams& rhs) const {
+    const CameraParams& a = cameraParams;
+    const CameraParams& b = rhs.cameraParams;
+    return std::equal(std::begin(a.pos3), std::end(a.pos3), std::begin(b.pos3)) &&
+           std::equal(std::begin(a.rotXYZ3), std::end(a.rotXYZ3), std::begin(b.rotXYZ3));
+}
+
 FakeRotatingCamera::FakeRotatingCamera(const bool isBackFacing)
         : mIsBackFacing(isBackFacing)
+        , mSoftRendering(useSoftRenderer())
         , mAFStateMachine(200, 1, 2) {}
 
 FakeRotatingCamera::~FakeRotatingCamera() {
@@ -240,8 +298,9 @@ std::tuple<PixelFormat, BufferUsage, Dataspace, int32_t>
 FakeRotatingCamera::overrideStreamParams(const PixelFormat format,
                                          const BufferUsage usage,
                                          const Dataspace dataspace) const {
-    constexpr BufferUsage kRgbaExtraUsage = usageOr(BufferUsage::CAMERA_OUTPUT,
-                                                    BufferUsage::GPU_RENDER_TARGET);
+    const BufferUsage kRgbaExtraUsage = usageOr(BufferUsage::CAMERA_OUTPUT,
+                                                mSoftRendering ? BufferUsage::CPU_WRITE_OFTEN
+                                                               : BufferUsage::GPU_RENDER_TARGET);
     constexpr BufferUsage kYuvExtraUsage = usageOr(BufferUsage::CAMERA_OUTPUT,
                                                    BufferUsage::CPU_WRITE_OFTEN);
     constexpr BufferUsage kBlobExtraUsage = usageOr(BufferUsage::CAMERA_OUTPUT,
@@ -289,7 +348,7 @@ bool FakeRotatingCamera::configure(const CameraMetadata& sessionParams,
 
     if (!mQemuChannel.ok()) {
         static const char kPipeName[] = "FakeRotatingCameraSensor";
-        mQemuChannel.reset(qemu_pipe_open_ns(NULL, kPipeName, O_RDWR));
+        mQemuChannel.reset(qemud_pipe_open_ns(NULL, kPipeName, O_RDWR));
         if (!mQemuChannel.ok()) {
             ALOGE("%s:%s:%d qemu_pipe_open_ns failed for '%s'",
                   kClass, __func__, __LINE__, kPipeName);
@@ -297,9 +356,15 @@ bool FakeRotatingCamera::configure(const CameraMetadata& sessionParams,
         }
     }
 
-    const abc3d::EglCurrentContext currentContext = initOpenGL();
-    if (!currentContext.ok()) {
-        return FAILURE(false);
+    if (mSoftRendering) {
+        if (!mSoftRenderer) {
+            mSoftRenderer = getSharedSoftRenderer();
+        }
+    } else if (!mGlScene) {
+        mGlScene = getSharedGlScene();
+        if (!mGlScene) {
+            return FAILURE(false);
+        }
     }
 
     LOG_ALWAYS_FATAL_IF(!mStreamInfoCache.empty());
@@ -313,7 +378,8 @@ bool FakeRotatingCamera::configure(const CameraMetadata& sessionParams,
         si.pixelFormat = halStreams->overrideFormat;
         si.blobBufferSize = streams->bufferSize;
 
-        if (si.pixelFormat != PixelFormat::RGBA_8888) {
+        // the software renderer converts from `rgbaScratch`
+        if (!mSoftRendering && (si.pixelFormat != PixelFormat::RGBA_8888)) {
             const native_handle_t* buffer;
             GraphicBufferAllocator& gba = GraphicBufferAllocator::get();
             uint32_t stride;
@@ -325,6 +391,7 @@ bool FakeRotatingCamera::configure(const CameraMetadata& sessionParams,
                                                           BufferUsage::CAMERA_OUTPUT))),
                     &buffer, &stride, kClass) == NO_ERROR) {
                 si.rgbaBuffer.reset(buffer);
+                si.rgbaBufferCharge.set(size_t(stride) * si.size.height * 4);
             } else {
                 mStreamInfoCache.clear();
                 return FAILURE(false);
@@ -339,20 +406,34 @@ void FakeRotatingCamera::close() {
     closeImpl(true);
 }
 
-abc3d::EglCurrentContext FakeRotatingCamera::initOpenGL() {
-    if (mGlProgram.ok()) {
-        return mEglContext.getCurrentContext();
+// The cameras render in turns under `GlScene::mtx` (see `renderIntoRGBA`),
+// two cameras streaming together keep one context and one copy of the
+// texture.
+std::shared_ptr<FakeRotatingCamera::GlScene> FakeRotatingCamera::getSharedGlScene() {
+    static std::mutex mtx;
+    static std::weak_ptr<GlScene> weakScene;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    std::shared_ptr<GlScene> scene = weakScene.lock();
+    if (!scene) {
+        scene = createGlScene();
+        weakScene = scene;
     }
 
-    abc3d::EglContext context;
-    abc3d::EglCurrentContext currentContext = context.init();
+    return scene;
+}
+
+std::unique_ptr<FakeRotatingCamera::GlScene> FakeRotatingCamera::createGlScene() {
+    auto scene = std::make_unique<GlScene>();
+
+    const abc3d::EglCurrentContext currentContext = scene->eglContext.init();
     if (!currentContext.ok()) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
 
     abc3d::AutoTexture testPatternTexture = loadTestPatternTexture();
     if (!testPatternTexture.ok()) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
 
     const char kVertexShaderStr[] = R"CODE(
@@ -367,7 +448,7 @@ void main() {
 )CODE";
     abc3d::AutoShader vertexShader;
     if (!vertexShader.compile(GL_VERTEX_SHADER, kVertexShaderStr)) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
 
     const char kFragmentShaderStr[] = R"CODE(
@@ -380,75 +461,100 @@ void main() {
 )CODE";
     abc3d::AutoShader fragmentShader;
     if (!fragmentShader.compile(GL_FRAGMENT_SHADER, kFragmentShaderStr)) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
 
     abc3d::AutoProgram program;
     if (!program.link(vertexShader.get(), fragmentShader.get())) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
 
     const GLint programAttrPositionLoc = program.getAttribLocation("a_position");
     if (programAttrPositionLoc < 0) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
     const GLint programAttrTexCoordLoc = program.getAttribLocation("a_texCoord");
     if (programAttrTexCoordLoc < 0) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
     const GLint programUniformTextureLoc = program.getUniformLocation("u_texture");
     if (programUniformTextureLoc < 0) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
     const GLint programUniformPvmMatrixLoc = program.getUniformLocation("u_pvmMatrix");
     if (programUniformPvmMatrixLoc < 0) {
-        return abc3d::EglCurrentContext();
+        return nullptr;
     }
 
-    mEglContext = std::move(context);
-    mGlTestPatternTexture = std::move(testPatternTexture);
-    mGlProgramAttrPositionLoc = programAttrPositionLoc;
-    mGlProgramAttrTexCoordLoc = programAttrTexCoordLoc;
-    mGlProgramUniformTextureLoc = programUniformTextureLoc;
-    mGlProgramUniformPvmMatrixLoc = programUniformPvmMatrixLoc;
-    mGlProgram = std::move(program);
+    scene->testPatternTexture = std::move(testPatternTexture);
+    scene->programAttrPositionLoc = programAttrPositionLoc;
+    scene->programAttrTexCoordLoc = programAttrTexCoordLoc;
+    scene->programUniformTextureLoc = programUniformTextureLoc;
+    scene->programUniformPvmMatrixLoc = programUniformPvmMatrixLoc;
+    scene->program = std::move(program);
+
+    return scene;
+}
+
+FakeRotatingCamera::GlScene::~GlScene() {
+    const abc3d::EglCurrentContext currentContext = eglContext.getCurrentContext();
+    program.clear();
+    testPatternTexture.clear();
+}
+
+// Renders take turns, see `SoftRenderer::render`.
+std::shared_ptr<SoftRenderer> FakeRotatingCamera::getSharedSoftRenderer() {
+    static std::mutex mtx;
+    static std::weak_ptr<SoftRenderer> weakRenderer;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    std::shared_ptr<SoftRenderer> renderer = weakRenderer.lock();
+    if (!renderer) {
+        renderer = std::make_shared<SoftRenderer>(
+            loadTestPattern(), std::clamp(std::thread::hardware_concurrency(), 1U, 4U));
+        weakRenderer = renderer;
+    }
 
-    return std::move(currentContext);
+    return renderer;
 }
 
 void FakeRotatingCamera::closeImpl(const bool everything) {
-    {
-        const abc3d::EglCurrentContext currentContext = mEglContext.getCurrentContext();
+    if (mGlScene) {
+        std::lock_guard<std::mutex> glLock(mGlScene->mtx);
+        const abc3d::EglCurrentContext currentContext =
+            mGlScene->eglContext.getCurrentContext();
         LOG_ALWAYS_FATAL_IF(!mStreamInfoCache.empty() && !currentContext.ok());
         mStreamInfoCache.clear();
-
-        if (everything) {
-            mGlProgram.clear();
-            mGlTestPatternTexture.clear();
-        }
+    } else {
+        mStreamInfoCache.clear();
     }
 
     if (everything) {
-        mEglContext.clear();
+        mSoftRenderer.reset();
+        mGlScene.reset();
         mQemuChannel.reset();
     }
 }
 
-std::tuple<int64_t, int64_t, CameraMetadata,
-           std::vector<StreamBuffer>, std::vector<DelayedStreamBuffer>>
-FakeRotatingCamera::processCaptureRequest(CameraMetadata metadataUpdate,
-                                          Span<CachedStreamBuffer*> csbs) {
-    CameraMetadata resultMetadata = metadataUpdate.metadata.empty() ?
-        updateCaptureResultMetadata() :
-        applyMetadata(std::move(metadataUpdate));
+std::pair<int64_t, int64_t>
+FakeRotatingCamera::beginCaptureRequest(CameraMetadata metadataUpdate,
+                                        CameraMetadata* resultMetadata) {
+    if (metadataUpdate.metadata.empty()) {
+        updateCaptureResultMetadata(resultMetadata);
+    } else {
+        *resultMetadata = applyMetadata(std::move(metadataUpdate));
+    }
+
+    return {mFrameDurationNs, kDefaultSensorExposureTimeNs};
+}
 
+bool FakeRotatingCamera::processCaptureRequest(Span<CachedStreamBuffer*> csbs,
+                                               HwCaptureResult* result) {
     const size_t csbsSize = csbs.size();
-    std::vector<StreamBuffer> outputBuffers;
-    std::vector<DelayedStreamBuffer> delayedOutputBuffers;
-    outputBuffers.reserve(csbsSize);
+    std::vector<StreamBuffer>& outputBuffers = result->outputBuffers;
+    std::vector<DelayedStreamBuffer>& delayedOutputBuffers = result->delayedOutputBuffers;
 
-    const abc3d::EglCurrentContext currentContext = mEglContext.getCurrentContext();
-    if (!currentContext.ok()) {
+    if (!mSoftRendering && !mGlScene) {
         goto fail;
     }
 
@@ -496,9 +602,7 @@ FakeRotatingCamera::processCaptureRequest(CameraMetadata metadataUpdate,
         }
     }
 
-    return make_tuple(mFrameDurationNs, kDefaultSensorExposureTimeNs,
-                      std::move(resultMetadata), std::move(outputBuffers),
-                      std::move(delayedOutputBuffers));
+    return true;
 
 fail:
     for (size_t i = 0; i < csbsSize; ++i) {
@@ -507,9 +611,7 @@ fail:
         outputBuffers.push_back(csb->finish(false));
     }
 
-    return make_tuple(FAILURE(-1), 0,
-                      std::move(resultMetadata), std::move(outputBuffers),
-                      std::move(delayedOutputBuffers));
+    return FAILURE(false);
 }
 
 void FakeRotatingCamera::captureFrame(const StreamInfo& si,
@@ -545,14 +647,29 @@ bool FakeRotatingCamera::captureFrameRGBA(const StreamInfo& si,
         return FAILURE(false);
     }
 
-    return renderIntoRGBA(si, renderParams, csb->getBuffer());
+    if (mSoftRendering) {
+        return softRenderIntoRGBA(si, renderParams, csb->getBuffer());
+    } else {
+        return renderIntoRGBA(si, renderParams, csb->getBuffer());
+    }
 }
 
+// Frames of a moving scene are converted straight into the buffer, once the
+// scene stops moving the frame is converted once into the stream's cache and
+// copied from there.
 bool FakeRotatingCamera::captureFrameYUV(const StreamInfo& si,
                                          const RenderParams& renderParams,
                                          CachedStreamBuffer* csb) const {
-    LOG_ALWAYS_FATAL_IF(!si.rgbaBuffer);
-    if (!renderIntoRGBA(si, renderParams, si.rgbaBuffer.get())) {
+    const bool still = si.prevRenderParams && (*si.prevRenderParams == renderParams);
+    si.prevRenderParams = renderParams;
+
+    std::shared_ptr<CachedFrame> frame;
+    if (still) {
+        frame = getCachedFrame(si, renderParams);
+        if (!frame) {
+            return false;
+        }
+    } else if (!renderForConverting(si, renderParams)) {
         return false;
     }
 
@@ -560,46 +677,40 @@ bool FakeRotatingCamera::captureFrameYUV(const StreamInfo& si,
         return false;
     }
 
-    void* rgba = nullptr;
-    if (GraphicBufferMapper::get().lock(
-            si.rgbaBuffer.get(), static_cast<uint32_t>(BufferUsage::CPU_READ_OFTEN),
-            {si.size.width, si.size.height}, &rgba) != NO_ERROR) {
-        return FAILURE(false);
-    }
-
     android_ycbcr ycbcr;
     if (GraphicBufferMapper::get().lockYCbCr(
             csb->getBuffer(), static_cast<uint32_t>(BufferUsage::CPU_WRITE_OFTEN),
             {si.size.width, si.size.height}, &ycbcr) != NO_ERROR) {
-        LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(si.rgbaBuffer.get()) != NO_ERROR);
         return FAILURE(false);
     }
 
-    const bool converted = conv::rgba2yuv(si.size.width, si.size.height,
-                                          static_cast<const uint32_t*>(rgba),
-                                          ycbcr);
+    bool converted;
+    if (frame) {
+        yuv::copyNV21(si.size.width, si.size.height, frame->nv21data.data(), ycbcr);
+        converted = true;
+    } else {
+        converted = convertRenderedFrame(si, ycbcr);
+    }
 
     LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(csb->getBuffer()) != NO_ERROR);
-    LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(si.rgbaBuffer.get()) != NO_ERROR);
-
     return converted;
 }
 
 DelayedStreamBuffer FakeRotatingCamera::captureFrameJpeg(const StreamInfo& si,
                                                          const RenderParams& renderParams,
                                                          CachedStreamBuffer* csb) const {
-    std::vector<uint8_t> nv21data = captureFrameForCompressing(si, renderParams);
+    std::shared_ptr<CachedFrame> frame = getCachedFrame(si, renderParams);
 
     const Rect<uint16_t> imageSize = si.size;
     const uint32_t jpegBufferSize = si.blobBufferSize;
     const int64_t frameDurationNs = mFrameDurationNs;
-    CameraMetadata metadata = mCaptureResultMetadata;
+    std::shared_ptr<const CameraMetadata> metadata = mCaptureResultMetadata.snapshot();
 
-    return [csb, imageSize, nv21data = std::move(nv21data), metadata = std::move(metadata),
+    return [csb, imageSize, frame = std::move(frame), metadata = std::move(metadata),
             jpegBufferSize, frameDurationNs](const bool ok) -> StreamBuffer {
         StreamBuffer sb;
-        if (ok && !nv21data.empty() && csb->waitAcquireFence(frameDurationNs / 1000000)) {
-            sb = csb->finish(compressNV21IntoJpeg(imageSize, nv21data.data(), metadata,
+        if (ok && frame && csb->waitAcquireFence(frameDurationNs / 1000000)) {
+            sb = csb->finish(compressNV21IntoJpeg(imageSize, frame->nv21data.data(), *metadata,
                                                   csb->getBuffer(), jpegBufferSize));
         } else {
             sb = csb->finish(false);
@@ -609,78 +720,135 @@ DelayedStreamBuffer FakeRotatingCamera::captureFrameJpeg(const StreamInfo& si,
     };
 }
 
-std::vector<uint8_t>
-FakeRotatingCamera::captureFrameForCompressing(const StreamInfo& si,
-                                               const RenderParams& renderParams) const {
-    if (!renderIntoRGBA(si, renderParams, si.rgbaBuffer.get())) {
-        return {};
+// Static scenes (e.g. in UI tests) produce the same frame over and over, it is
+// rendered and converted once and then copied from the stream's cache. The
+// cache is keyed by `renderParams`, it belongs to `StreamInfo` which is
+// recreated on every `configure`. Nothing is cached over the
+// "camera.jpeg_staging" memory budget.
+std::shared_ptr<FakeRotatingCamera::CachedFrame>
+FakeRotatingCamera::getCachedFrame(const StreamInfo& si,
+                                   const RenderParams& renderParams) const {
+    if (si.cachedFrame && (si.cachedFrameRenderParams == renderParams)) {
+        return si.cachedFrame;
+    }
+
+    // JPEG tasks could still use the previous frame, it is never written again
+    si.cachedFrame.reset();
+    auto frame = std::make_shared<CachedFrame>();
+
+    if (!captureFrameForCompressing(si, renderParams, &frame->nv21data)) {
+        return nullptr;
+    }
+    frame->charge.set(frame->nv21data.capacity());
+
+    if (!frame->charge.isOverBudget()) {
+        si.cachedFrame = frame;
+        si.cachedFrameRenderParams = renderParams;
+    }
+    return frame;
+}
+
+bool FakeRotatingCamera::captureFrameForCompressing(const StreamInfo& si,
+                                                    const RenderParams& renderParams,
+                                                    std::vector<uint8_t>* nv21data) const {
+    if (!renderForConverting(si, renderParams)) {
+        return false;
+    }
+
+    nv21data->resize(yuv::NV21size(si.size.width, si.size.height));
+    return convertRenderedFrame(si, yuv::NV21init(si.size.width, si.size.height,
+                                                  nv21data->data()));
+}
+
+// Renders into `si.rgbaScratch` or `si.rgbaBuffer` for `convertRenderedFrame`.
+bool FakeRotatingCamera::renderForConverting(const StreamInfo& si,
+                                             const RenderParams& renderParams) const {
+    if (mSoftRendering) {
+        si.rgbaScratch.resize(size_t(si.size.width) * si.size.height);
+        si.rgbaScratchCharge.set(si.rgbaScratch.capacity() * sizeof(uint32_t));
+        return softRender(si.size, renderParams, si.rgbaScratch.data(), si.size.width);
+    } else {
+        LOG_ALWAYS_FATAL_IF(!si.rgbaBuffer);
+        return renderIntoRGBA(si, renderParams, si.rgbaBuffer.get());
+    }
+}
+
+bool FakeRotatingCamera::convertRenderedFrame(const StreamInfo& si,
+                                              const android_ycbcr& ycbcr) const {
+    if (mSoftRendering) {
+        const bool converted = conv::rgba2yuv(si.size.width, si.size.height,
+                                              si.rgbaScratch.data(), ycbcr);
+
+        // rendered again for the next frame, no need to keep it over budget
+        if (si.rgbaScratchCharge.isOverBudget()) {
+            std::vector<uint32_t>().swap(si.rgbaScratch);
+            si.rgbaScratchCharge.set(0);
+        }
+
+        return converted;
     }
 
     void* rgba = nullptr;
     if (GraphicBufferMapper::get().lock(
             si.rgbaBuffer.get(), static_cast<uint32_t>(BufferUsage::CPU_READ_OFTEN),
             {si.size.width, si.size.height}, &rgba) != NO_ERROR) {
-        return {};
+        return FAILURE(false);
     }
 
-    std::vector<uint8_t> nv21data(yuv::NV21size(si.size.width, si.size.height));
-    const android_ycbcr ycbcr = yuv::NV21init(si.size.width, si.size.height,
-                                              nv21data.data());
-
     const bool converted = conv::rgba2yuv(si.size.width, si.size.height,
                                           static_cast<const uint32_t*>(rgba),
                                           ycbcr);
 
     LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(si.rgbaBuffer.get()) != NO_ERROR);
+    return converted;
+}
 
-    if (converted) {
-        return nv21data;
-    } else {
-        return {};
+void FakeRotatingCamera::calculatePvMatrix44(const Rect<uint16_t> imageSize,
+                                             const RenderParams& renderParams,
+                                             const bool isHardwareBuffer,
+                                             float pvMatrix44[]) const {
+    float projectionMatrix44[16];
+    float viewMatrix44[16];
+
+    // This matrix takes into account specific behaviors below:
+    // * The Y axis if rendering int0 AHardwareBuffer goes down while it
+    //   goes up everywhere else (e.g. when rendering to `EGLSurface`).
+    // * We set `sensorOrientation=90` because a lot of places in Android and
+    //   3Ps assume this and don't work properly with `sensorOrientation=0`.
+    const float workaroundMatrix44[16] = {
+        0, (isHardwareBuffer ? -1.0f : 1.0f), 0, 0,
+       -1,                                 0, 0, 0,
+        0,                                 0, 1, 0,
+        0,                                 0, 0, 1,
+    };
+
+    {
+        constexpr double kNear = 1.0;
+        constexpr double kFar = 10.0;
+
+        // We use `height` to calculate `right` because the image is 90degrees
+        // rotated (sensorOrientation=90).
+        const double right = kNear * (.5 * getSensorSize().height / getSensorDPI() / getDefaultFocalLength());
+        const double top = right / imageSize.width * imageSize.height;
+        abc3d::frustum(pvMatrix44, -right, right, -top, top,
+                       kNear, kFar);
+    }
+
+    abc3d::mulM44(projectionMatrix44, pvMatrix44, workaroundMatrix44);
+
+    {
+        const auto& cam = renderParams.cameraParams;
+        abc3d::lookAtXyzRot(viewMatrix44, cam.pos3, cam.rotXYZ3);
     }
+
+    abc3d::mulM44(pvMatrix44, projectionMatrix44, viewMatrix44);
 }
 
 bool FakeRotatingCamera::drawScene(const Rect<uint16_t> imageSize,
                                    const RenderParams& renderParams,
                                    const bool isHardwareBuffer) const {
     float pvMatrix44[16];
-    {
-        float projectionMatrix44[16];
-        float viewMatrix44[16];
-
-        // This matrix takes into account specific behaviors below:
-        // * The Y axis if rendering int0 AHardwareBuffer goes down while it
-        //   goes up everywhere else (e.g. when rendering to `EGLSurface`).
-        // * We set `sensorOrientation=90` because a lot of places in Android and
-        //   3Ps assume this and don't work properly with `sensorOrientation=0`.
-        const float workaroundMatrix44[16] = {
-            0, (isHardwareBuffer ? -1.0f : 1.0f), 0, 0,
-           -1,                                 0, 0, 0,
-            0,                                 0, 1, 0,
-            0,                                 0, 0, 1,
-        };
-
-        {
-            constexpr double kNear = 1.0;
-            constexpr double kFar = 10.0;
-
-            // We use `height` to calculate `right` because the image is 90degrees
-            // rotated (sensorOrientation=90).
-            const double right = kNear * (.5 * getSensorSize().height / getSensorDPI() / getDefaultFocalLength());
-            const double top = right / imageSize.width * imageSize.height;
-            abc3d::frustum(pvMatrix44, -right, right, -top, top,
-                           kNear, kFar);
-        }
-
-        abc3d::mulM44(projectionMatrix44, pvMatrix44, workaroundMatrix44);
-
-        {
-            const auto& cam = renderParams.cameraParams;
-            abc3d::lookAtXyzRot(viewMatrix44, cam.pos3, cam.rotXYZ3);
-        }
-
-        abc3d::mulM44(pvMatrix44, projectionMatrix44, viewMatrix44);
-    }
+    calculatePvMatrix44(imageSize, renderParams, isHardwareBuffer, pvMatrix44);
 
     glViewport(0, 0, imageSize.width, imageSize.height);
     const bool result = drawSceneImpl(pvMatrix44);
@@ -710,18 +878,19 @@ bool FakeRotatingCamera::drawSceneImpl(const float pvMatrix44[]) const {
     glClearColor(0.2, 0.3, 0.2, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glUseProgram(mGlProgram.get());
-    glVertexAttribPointer(mGlProgramAttrPositionLoc, 3, GL_FLOAT, GL_FALSE,
+    const GlScene& scene = *mGlScene;
+    glUseProgram(scene.program.get());
+    glVertexAttribPointer(scene.programAttrPositionLoc, 3, GL_FLOAT, GL_FALSE,
                           5 * sizeof(GLfloat), &vVertices[0]);
-    glEnableVertexAttribArray(mGlProgramAttrPositionLoc);
-    glVertexAttribPointer(mGlProgramAttrTexCoordLoc, 2, GL_FLOAT, GL_FALSE,
+    glEnableVertexAttribArray(scene.programAttrPositionLoc);
+    glVertexAttribPointer(scene.programAttrTexCoordLoc, 2, GL_FLOAT, GL_FALSE,
                           5 * sizeof(GLfloat), &vVertices[3]);
-    glEnableVertexAttribArray(mGlProgramAttrTexCoordLoc);
-    glUniformMatrix4fv(mGlProgramUniformPvmMatrixLoc, 1, true, pvMatrix44);
+    glEnableVertexAttribArray(scene.programAttrTexCoordLoc);
+    glUniformMatrix4fv(scene.programUniformPvmMatrixLoc, 1, true, pvMatrix44);
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, mGlTestPatternTexture.get());
-    glUniform1i(mGlProgramUniformTextureLoc, 0);
+    glBindTexture(GL_TEXTURE_2D, scene.testPatternTexture.get());
+    glUniform1i(scene.programUniformTextureLoc, 0);
 
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
 
@@ -747,7 +916,16 @@ bool FakeRotatingCamera::renderIntoRGBA(const StreamInfo& si,
         return FAILURE(false);
     }
 
-    const abc3d::AutoImageKHR eglImage(mEglContext.getDisplay(), clientBuf);
+    // Only drawing takes turns with the other cameras, see `getSharedGlScene`.
+    // `glLock` is released after `currentContext`.
+    std::lock_guard<std::mutex> glLock(mGlScene->mtx);
+    const abc3d::EglCurrentContext currentContext =
+        mGlScene->eglContext.getCurrentContext();
+    if (!currentContext.ok()) {
+        return FAILURE(false);
+    }
+
+    const abc3d::AutoImageKHR eglImage(mGlScene->eglContext.getDisplay(), clientBuf);
     if (!eglImage.ok()) {
         return false;
     }
@@ -763,6 +941,40 @@ bool FakeRotatingCamera::renderIntoRGBA(const StreamInfo& si,
     return drawScene(si.size, renderParams, true);
 }
 
+bool FakeRotatingCamera::softRenderIntoRGBA(const StreamInfo& si,
+                                            const RenderParams& renderParams,
+                                            const native_handle_t* rgbaBuffer) const {
+    const cb_handle_t* const cb = cb_handle_t::from(rgbaBuffer);
+    if (!cb) {
+        return FAILURE(false);
+    }
+
+    void* rgba = nullptr;
+    if (GraphicBufferMapper::get().lock(
+            rgbaBuffer, static_cast<uint32_t>(BufferUsage::CPU_WRITE_OFTEN),
+            {si.size.width, si.size.height}, &rgba) != NO_ERROR) {
+        return FAILURE(false);
+    }
+
+    const bool result = softRender(si.size, renderParams,
+                                   static_cast<uint32_t*>(rgba), cb->stride);
+
+    LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(rgbaBuffer) != NO_ERROR);
+    return result;
+}
+
+bool FakeRotatingCamera::softRender(const Rect<uint16_t> imageSize,
+                                    const RenderParams& renderParams,
+                                    uint32_t* dst, const size_t stride) const {
+    LOG_ALWAYS_FATAL_IF(!mSoftRenderer);
+
+    // `SoftRenderer` lays out rows the same way as GL does in AHardwareBuffer
+    float pvMatrix44[16];
+    calculatePvMatrix44(imageSize, renderParams, true, pvMatrix44);
+
+    return mSoftRenderer->render(pvMatrix44, imageSize, dst, stride, kSoftClearColor);
+}
+
 bool FakeRotatingCamera::readSensors(SensorValues* vals) {
     static const char kReadCommand[] = "get";
 
@@ -827,24 +1039,27 @@ CameraMetadata FakeRotatingCamera::applyMetadata(const CameraMetadata& metadata)
         serializeCameraMetadataMap(m);
 
     if (maybeSerialized) {
-        mCaptureResultMetadata = std::move(maybeSerialized.value());
+        mCaptureResultMetadata.set(std::move(maybeSerialized.value()));
     }
 
     {   // reset ANDROID_CONTROL_AF_TRIGGER to IDLE
-        camera_metadata_t* const raw =
-            reinterpret_cast<camera_metadata_t*>(mCaptureResultMetadata.metadata.data());
+        const camera_metadata_t* const raw = reinterpret_cast<const camera_metadata_t*>(
+            mCaptureResultMetadata.get().metadata.data());
 
         camera_metadata_ro_entry_t entry;
         const auto newTriggerValue = ANDROID_CONTROL_AF_TRIGGER_IDLE;
 
         if (find_camera_metadata_ro_entry(raw, ANDROID_CONTROL_AF_TRIGGER, &entry)) {
-            return mCaptureResultMetadata;
+            return mCaptureResultMetadata.get();
         } else if (entry.data.i32[0] == newTriggerValue) {
-            return mCaptureResultMetadata;
+            return mCaptureResultMetadata.get();
         } else {
-            CameraMetadata result = mCaptureResultMetadata;
+            CameraMetadata result = mCaptureResultMetadata.get();
+            camera_metadata_t* const mutableRaw = reinterpret_cast<camera_metadata_t*>(
+                mCaptureResultMetadata.edit()->metadata.data());
 
-            if (update_camera_metadata_entry(raw, entry.index, &newTriggerValue, 1, nullptr)) {
+            if (update_camera_metadata_entry(mutableRaw, entry.index,
+                                             &newTriggerValue, 1, nullptr)) {
                 ALOGW("%s:%s:%d: update_camera_metadata_entry(ANDROID_CONTROL_AF_TRIGGER) "
                       "failed", kClass, __func__, __LINE__);
             }
@@ -854,9 +1069,9 @@ CameraMetadata FakeRotatingCamera::applyMetadata(const CameraMetadata& metadata)
     }
 }
 
-CameraMetadata FakeRotatingCamera::updateCaptureResultMetadata() {
+void FakeRotatingCamera::updateCaptureResultMetadata(CameraMetadata* result) {
     camera_metadata_t* const raw =
-        reinterpret_cast<camera_metadata_t*>(mCaptureResultMetadata.metadata.data());
+        reinterpret_cast<camera_metadata_t*>(mCaptureResultMetadata.edit()->metadata.data());
 
     const auto af = mAFStateMachine();
 
@@ -878,7 +1093,7 @@ CameraMetadata FakeRotatingCamera::updateCaptureResultMetadata() {
               kClass, __func__, __LINE__);
     }
 
-    return metadataCompact(mCaptureResultMetadata);
+    metadataCompact(mCaptureResultMetadata.get(), result);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -910,6 +1125,11 @@ bool FakeRotatingCamera::isBackFacing() const {
     return mIsBackFacing;
 }
 
+// The instances share the renderer and take turns, see `getSharedGlScene`.
+bool FakeRotatingCamera::isConcurrentStreamingSupported() const {
+    return true;
+}
+
 Span<const float> FakeRotatingCamera::getAvailableFocalLength() const {
     static const float availableFocalLengths[] = {
         kDefaultFocalLength
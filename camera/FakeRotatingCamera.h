@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
 
 #include <android-base/unique_fd.h>
@@ -25,6 +28,9 @@
 #include "AutoNativeHandle.h"
 #include "AFStateMachine.h"
 #include "HwCamera.h"
+#include "memory_counters.h"
+#include "metadata_utils.h"
+#include "SoftRenderer.h"
 
 namespace android {
 namespace hardware {
@@ -44,14 +50,17 @@ struct FakeRotatingCamera : public HwCamera {
                    const Stream* streams, const HalStream* halStreams) override;
     void close() override;
 
-    std::tuple<int64_t, int64_t, CameraMetadata, std::vector<StreamBuffer>,
-               std::vector<DelayedStreamBuffer>>
-        processCaptureRequest(CameraMetadata, Span<CachedStreamBuffer*>) override;
+    std::pair<int64_t, int64_t>
+        beginCaptureRequest(CameraMetadata metadataUpdate,
+                            CameraMetadata* resultMetadata) override;
+    bool processCaptureRequest(Span<CachedStreamBuffer*>,
+                               HwCaptureResult* result) override;
 
     // metadata
     Span<const std::pair<int32_t, int32_t>> getTargetFpsRanges() const override;
     Span<const Rect<uint16_t>> getAvailableThumbnailSizes() const override;
     bool isBackFacing() const override;
+    bool isConcurrentStreamingSupported() const override;
     Span<const float> getAvailableFocalLength() const override;
     std::tuple<int32_t, int32_t, int32_t> getMaxNumOutputStreams() const override;
     Span<const PixelFormat> getSupportedPixelFormats() const override;
@@ -66,15 +75,6 @@ struct FakeRotatingCamera : public HwCamera {
     float getDefaultFocalLength() const override;
 
 private:
-    struct StreamInfo {
-        std::unique_ptr<const native_handle_t,
-                        AutoAllocatorNativeHandleDeleter> rgbaBuffer;
-        BufferUsage usage;
-        Rect<uint16_t> size;
-        PixelFormat pixelFormat;
-        uint32_t blobBufferSize;
-    };
-
     struct SensorValues {
         float accel[3];
         float magnetic[3];
@@ -87,9 +87,57 @@ private:
             float rotXYZ3[3];
         };
         CameraParams cameraParams;
+
+        // by value, -0.0 matches 0.0 and NaN matches nothing
+        bool operator==(const RenderParams& rhs) const;
+    };
+
+    // The last frame rendered for a stream, in NV21. JPEG tasks keep a
+    // reference to it and compress it for every capture, the EXIF data
+    // (e.g. DateTime) differs between captures.
+    struct CachedFrame {
+        std::vector<uint8_t> nv21data;
+        memaccount::Charge charge{gCameraJpegStagingMemory};
+    };
+
+    // The GL context, the test pattern texture and the program, one for all
+    // FakeRotatingCamera instances, see `getSharedGlScene`.
+    struct GlScene {
+        ~GlScene();
+
+        abc3d::EglContext eglContext;
+        abc3d::AutoTexture testPatternTexture;
+        GLint programAttrPositionLoc;
+        GLint programAttrTexCoordLoc;
+        GLint programUniformTextureLoc;
+        GLint programUniformPvmMatrixLoc;
+        abc3d::AutoProgram program;
+        std::mutex mtx;  // `eglContext` is current on one thread at a time
+    };
+
+    struct StreamInfo {
+        std::unique_ptr<const native_handle_t,
+                        AutoAllocatorNativeHandleDeleter> rgbaBuffer;
+        memaccount::Charge rgbaBufferCharge{gCameraRenderMemory};
+        BufferUsage usage;
+        Rect<uint16_t> size;
+        PixelFormat pixelFormat;
+        uint32_t blobBufferSize;
+
+        // see `getCachedFrame`
+        mutable std::shared_ptr<CachedFrame> cachedFrame;
+        mutable RenderParams cachedFrameRenderParams;
+        // the previous YUV frame's, see `captureFrameYUV`
+        mutable std::optional<RenderParams> prevRenderParams;
+
+        // the software renderer draws here before converting into YUV
+        mutable std::vector<uint32_t> rgbaScratch;
+        mutable memaccount::Charge rgbaScratchCharge{gCameraRenderMemory};
     };
 
-    abc3d::EglCurrentContext initOpenGL();
+    static std::shared_ptr<GlScene> getSharedGlScene();
+    static std::unique_ptr<GlScene> createGlScene();
+    static std::shared_ptr<SoftRenderer> getSharedSoftRenderer();
     void closeImpl(bool everything);
 
     void captureFrame(const StreamInfo& si,
@@ -106,33 +154,45 @@ private:
     DelayedStreamBuffer captureFrameJpeg(const StreamInfo& si,
                                          const RenderParams& renderParams,
                                          CachedStreamBuffer* csb) const;
-    std::vector<uint8_t> captureFrameForCompressing(const StreamInfo& si,
-                                                    const RenderParams& renderParams) const;
+    std::shared_ptr<CachedFrame> getCachedFrame(const StreamInfo& si,
+                                                const RenderParams& renderParams) const;
+    bool captureFrameForCompressing(const StreamInfo& si,
+                                    const RenderParams& renderParams,
+                                    std::vector<uint8_t>* nv21data) const;
+    bool renderForConverting(const StreamInfo& si,
+                             const RenderParams& renderParams) const;
+    bool convertRenderedFrame(const StreamInfo& si, const android_ycbcr& ycbcr) const;
     bool renderIntoRGBA(const StreamInfo& si,
                         const RenderParams& renderParams,
                         const native_handle_t* rgbaBuffer) const;
+    bool softRenderIntoRGBA(const StreamInfo& si,
+                            const RenderParams& renderParams,
+                            const native_handle_t* rgbaBuffer) const;
+    bool softRender(Rect<uint16_t> imageSize,
+                    const RenderParams& renderParams,
+                    uint32_t* dst, size_t stride) const;
+    void calculatePvMatrix44(Rect<uint16_t> imageSize,
+                             const RenderParams& renderParams,
+                             bool isHardwareBuffer,
+                             float pvMatrix44[]) const;
     bool drawScene(Rect<uint16_t> imageSize,
                    const RenderParams& renderParams,
                    bool isHardwareBuffer) const;
     bool drawSceneImpl(const float pvMatrix44[]) const;
     CameraMetadata applyMetadata(const CameraMetadata& metadata);
-    CameraMetadata updateCaptureResultMetadata();
+    void updateCaptureResultMetadata(CameraMetadata* result);
     bool readSensors(SensorValues* vals);
 
     const bool mIsBackFacing;
+    const bool mSoftRendering;  // see `useSoftRenderer`
     AFStateMachine mAFStateMachine;
     std::unordered_map<int32_t, StreamInfo> mStreamInfoCache;
     base::unique_fd mQemuChannel;
 
-    abc3d::EglContext mEglContext;
-    abc3d::AutoTexture mGlTestPatternTexture;
-    GLint mGlProgramAttrPositionLoc;
-    GLint mGlProgramAttrTexCoordLoc;
-    GLint mGlProgramUniformTextureLoc;
-    GLint mGlProgramUniformPvmMatrixLoc;
-    abc3d::AutoProgram mGlProgram;
+    std::shared_ptr<GlScene> mGlScene;
+    std::shared_ptr<SoftRenderer> mSoftRenderer;
 
-    CameraMetadata mCaptureResultMetadata;
+    CaptureResultMetadata mCaptureResultMetadata;
     int64_t mFrameDurationNs = 0;
 };
 
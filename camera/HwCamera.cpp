@@ -119,6 +119,10 @@ int32_t HwCamera::getJpegMaxSize() const {
     return int32_t(size.width) * int32_t(size.height) + sizeof(camera3_jpeg_blob);
 }
 
+bool HwCamera::isConcurrentStreamingSupported() const {
+    return false;
+}
+
 Span<const float> HwCamera::getAvailableApertures() const {
     static const float availableApertures[] = {
         kDefaultAperture
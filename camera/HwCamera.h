@@ -39,6 +39,7 @@
 #include "Rect.h"
 #include "Span.h"
 #include "CachedStreamBuffer.h"
+#include "InplaceFunction.h"
 
 namespace android {
 namespace hardware {
@@ -58,13 +59,26 @@ using aidl::android::hardware::graphics::common::PixelFormat;
 
 struct HwCaptureRequest {
     CameraMetadata metadataUpdate;
+    // nullptr for the buffers the framework did not attach (HAL buffer
+    // management), they are requested right before the frame is captured.
     std::vector<CachedStreamBuffer*> buffers;
+    std::vector<int32_t> streamIds;  // for each of `buffers`
     int32_t frameNumber;
 };
 
 // pass `true` to process the buffer, pass `false` to return an error asap to
 // release the underlying buffer to the framework.
-using DelayedStreamBuffer = std::function<StreamBuffer(bool)>;
+using DelayedStreamBuffer = InplaceFunction<StreamBuffer(bool), 96>;
+
+// Filled by `HwCamera::beginCaptureRequest` (`metadata`) and
+// `HwCamera::processCaptureRequest` (the buffers). Sessions reuse it between
+// requests (the containers are cleared, not freed) to avoid allocations
+// for every frame.
+struct HwCaptureResult {
+    CameraMetadata metadata;
+    std::vector<StreamBuffer> outputBuffers;
+    std::vector<DelayedStreamBuffer> delayedOutputBuffers;
+};
 
 struct HwCamera {
     static constexpr int32_t kErrorBadFormat = -1;
@@ -80,9 +94,17 @@ struct HwCamera {
                            const Stream* streams, const HalStream* halStreams) = 0;
     virtual void close() = 0;
 
-    virtual std::tuple<int64_t, int64_t, CameraMetadata, std::vector<StreamBuffer>,
-                       std::vector<DelayedStreamBuffer>>
-        processCaptureRequest(CameraMetadata, Span<CachedStreamBuffer*>) = 0;
+    // Applies the request's settings (`metadataUpdate` is empty if they did
+    // not change) and puts the frame's result metadata to `resultMetadata`
+    // before anything is rendered, returns {frameDurationNs, exposureDurationNs}.
+    virtual std::pair<int64_t, int64_t>
+        beginCaptureRequest(CameraMetadata metadataUpdate,
+                            CameraMetadata* resultMetadata) = 0;
+
+    // Renders the frame begun with `beginCaptureRequest`, `result` is
+    // expected to have no buffers. Returns false if the device failed.
+    virtual bool processCaptureRequest(Span<CachedStreamBuffer*>,
+                                       HwCaptureResult* result) = 0;
 
     static int64_t getFrameDuration(const camera_metadata_t*, int64_t def,
                                     int64_t min, int64_t max);
@@ -101,6 +123,9 @@ struct HwCamera {
     virtual Span<const Rect<uint16_t>> getAvailableThumbnailSizes() const = 0;
     virtual int32_t getJpegMaxSize() const;
     virtual bool isBackFacing() const = 0;
+    // Streams together with other cameras that return true, see
+    // `CameraProvider::getConcurrentCameraIds`.
+    virtual bool isConcurrentStreamingSupported() const;
     virtual Span<const float> getAvailableApertures() const;
     virtual Span<const float> getAvailableFocalLength() const;
     virtual float getHyperfocalDistance() const;
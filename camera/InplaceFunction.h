@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace provider {
+namespace implementation {
+
+template <class Signature, size_t Capacity> struct InplaceFunction;
+
+// A move-only replacement for std::function which never allocates: the
+// callable is stored inside the object, callables larger than `Capacity` do
+// not compile.
+template <class R, class... Args, size_t Capacity>
+struct InplaceFunction<R(Args...), Capacity> {
+    InplaceFunction() = default;
+
+    template <class F, class = std::enable_if_t<
+        !std::is_same_v<std::decay_t<F>, InplaceFunction>>>
+    InplaceFunction(F&& f) {
+        using T = std::decay_t<F>;
+        static_assert(sizeof(T) <= Capacity, "increase Capacity");
+        static_assert(alignof(T) <= alignof(std::max_align_t));
+
+        new (mStorage) T(std::forward<F>(f));
+        mOps = &kOps<T>;
+    }
+
+    InplaceFunction(InplaceFunction&& rhs) noexcept {
+        moveFrom(&rhs);
+    }
+
+    InplaceFunction& operator=(InplaceFunction&& rhs) noexcept {
+        if (this != &rhs) {
+            reset();
+            moveFrom(&rhs);
+        }
+        return *this;
+    }
+
+    ~InplaceFunction() {
+        reset();
+    }
+
+    R operator()(Args... args) {
+        LOG_ALWAYS_FATAL_IF(!mOps);
+        return mOps->invoke(mStorage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const { return mOps != nullptr; }
+
+    void reset() {
+        if (mOps) {
+            mOps->destroy(mStorage);
+            mOps = nullptr;
+        }
+    }
+
+    InplaceFunction(const InplaceFunction&) = delete;
+    InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+private:
+    struct Ops {
+        R (*invoke)(void*, Args&&...);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+
+    template <class T> static constexpr Ops kOps = {
+        [](void* f, Args&&... args) -> R {
+            return (*static_cast<T*>(f))(std::forward<Args>(args)...);
+        },
+        [](void* dst, void* src) {
+            new (dst) T(std::move(*static_cast<T*>(src)));
+            static_cast<T*>(src)->~T();
+        },
+        [](void* f) {
+            static_cast<T*>(f)->~T();
+        },
+    };
+
+    void moveFrom(InplaceFunction* rhs) {
+        if (rhs->mOps) {
+            rhs->mOps->move(mStorage, rhs->mStorage);
+            mOps = rhs->mOps;
+            rhs->mOps = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char mStorage[Capacity];
+    const Ops* mOps = nullptr;
+};
+
+}  // namespace implementation
+}  // namespace provider
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace provider {
+namespace implementation {
+
+// Keeps objects (e.g. vectors with their capacity) to reuse them instead of
+// allocating new ones. `get` returns a default constructed object if the pool
+// is empty.
+template <class T> struct ObjectPool {
+    ObjectPool() = default;
+
+    T get() {
+        std::lock_guard lock(mtx);
+        if (pool.empty()) {
+            return T();
+        } else {
+            T x = std::move(pool.back());
+            pool.pop_back();
+            return x;
+        }
+    }
+
+    void put(T x) {
+        std::lock_guard lock(mtx);
+        pool.push_back(std::move(x));
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool(ObjectPool&&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+    ObjectPool& operator=(ObjectPool&&) = delete;
+
+private:
+    std::vector<T> pool;
+    std::mutex mtx;
+};
+
+}  // namespace implementation
+}  // namespace provider
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -17,8 +17,15 @@
 #define FAILURE_DEBUG_PREFIX "QemuCamera"
 
 #include <inttypes.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
+#include <android-base/properties.h>
 #include <log/log.h>
 #include <system/camera_metadata.h>
 #include <linux/videodev2.h>
@@ -32,6 +39,7 @@
 #include "metadata_utils.h"
 #include "QemuCamera.h"
 #include "qemu_channel.h"
+#include "yuv.h"
 
 namespace android {
 namespace hardware {
@@ -68,6 +76,15 @@ constexpr float   kDefaultAperture = 4.0;
 
 constexpr int32_t kDefaultJpegQuality = 85;
 
+// Largest frames the shared memory holds, a frame is copied out of it
+// before the next one is queried.
+constexpr size_t kShmFrames = 1;
+
+// How long the host channel stays connected after `close`, 0 disconnects
+// it at once.
+constexpr char kWarmMsProperty[] = "vendor.qemu.camera.warm_ms";
+constexpr int kDefaultWarmMs = 5000;
+
 constexpr BufferUsage usageOr(const BufferUsage a, const BufferUsage b) {
     return static_cast<BufferUsage>(static_cast<uint64_t>(a) | static_cast<uint64_t>(b));
 }
@@ -76,12 +93,143 @@ constexpr bool usageTest(const BufferUsage a, const BufferUsage b) {
     return (static_cast<uint64_t>(a) & static_cast<uint64_t>(b)) != 0;
 }
 
+// The host writes frames without padding
+size_t getQemuFrameSize(const Rect<uint16_t> dim, const uint32_t pixelFormat) {
+    const size_t nPixels = size_t(dim.width) * dim.height;
+
+    switch (pixelFormat) {
+    case V4L2_PIX_FMT_YUV420: return nPixels * 3 / 2;
+    case V4L2_PIX_FMT_RGB32: return nPixels * 4;
+    default: return 0;
+    }
+}
+
+// Host channels of the closed cameras, connected but stopped, by the camera
+// name. Opening the same camera again within the grace period needs only
+// "start", the channels nobody took are disconnected when it ends.
+struct WarmChannels {
+    // Returns false if the channels are not kept, `channel` and `shm` are
+    // left as they were then.
+    bool put(const std::string& name, unique_fd* channel, qemud_shm* shm) {
+        static const int warmMs =
+            std::max(0, base::GetIntProperty(kWarmMsProperty, kDefaultWarmMs));
+        if (warmMs == 0) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mMtx);
+        Entry& e = mEntries[name];
+        disconnect(&e);  // the same camera is not opened twice, just in case
+        e.channel = std::move(*channel);
+        e.shm = *shm;
+        *shm = {};
+        e.shmCharge.set(e.shm.size);
+        e.expiresAt = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(warmMs);
+
+        if (!mExpireThreadStarted) {
+            // `this` is never destroyed, see `getWarmChannels`
+            std::thread(&WarmChannels::expireThreadLoop, this).detach();
+            mExpireThreadStarted = true;
+        }
+        mEntriesChanged.notify_one();
+        return true;
+    }
+
+    bool take(const std::string& name, unique_fd* channel, qemud_shm* shm) {
+        std::lock_guard<std::mutex> lock(mMtx);
+        const auto i = mEntries.find(name);
+        if (i == mEntries.end()) {
+            return false;
+        }
+
+        *channel = std::move(i->second.channel);
+        *shm = i->second.shm;
+        mEntries.erase(i);
+        return true;
+    }
+
+private:
+    struct Entry {
+        unique_fd channel;
+        qemud_shm shm = {};
+        memaccount::Charge shmCharge{gCameraShmMemory};
+        std::chrono::steady_clock::time_point expiresAt;
+    };
+
+    static void disconnect(Entry* e) {
+        if (e->channel.ok()) {
+            static const char kDisconnectQuery[] = "disconnect";
+            qemuRunQuery(e->channel.get(), kDisconnectQuery, sizeof(kDisconnectQuery));
+            e->channel.reset();
+        }
+        qemud_shm_release(&e->shm);
+        e->shmCharge.set(0);
+    }
+
+    void expireThreadLoop() {
+        std::unique_lock<std::mutex> lock(mMtx);
+        while (true) {
+            const auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+
+            for (auto i = mEntries.begin(); i != mEntries.end(); ) {
+                if (i->second.expiresAt <= now) {
+                    disconnect(&i->second);
+                    i = mEntries.erase(i);
+                } else {
+                    next = std::min(next, i->second.expiresAt);
+                    ++i;
+                }
+            }
+
+            if (mEntries.empty()) {
+                mEntriesChanged.wait(lock);
+            } else {
+                mEntriesChanged.wait_until(lock, next);
+            }
+        }
+    }
+
+    std::mutex mMtx;
+    std::condition_variable mEntriesChanged;
+    std::unordered_map<std::string, Entry> mEntries;
+    bool mExpireThreadStarted = false;
+};
+
+WarmChannels& getWarmChannels() {
+    // Outlives the cameras and the detached expiring thread
+    static WarmChannels* const channels = new WarmChannels();
+    return *channels;
+}
+
+// V4L2_PIX_FMT_YUV420 frames have the layout of `yuv::NV21init`
+void copyQemuFrameYUV(const Rect<uint16_t> dim, const void* frame,
+                      const android_ycbcr& dst) {
+    yuv::copyNV21(dim.width, dim.height, frame, dst);
+}
+
+// `dstStride` is in pixels
+void copyQemuFrameRGBA(const Rect<uint16_t> dim, const void* frame,
+                       void* dst, const size_t dstStride) {
+    const size_t rowSize = size_t(dim.width) * 4;
+    const uint8_t* src8 = static_cast<const uint8_t*>(frame);
+    uint8_t* dst8 = static_cast<uint8_t*>(dst);
+    for (unsigned row = 0; row < dim.height; ++row, src8 += rowSize, dst8 += dstStride * 4) {
+        memcpy(dst8, src8, rowSize);
+    }
+}
+
 }  // namespace
 
 QemuCamera::QemuCamera(const Parameters& params)
         : mParams(params)
         , mAFStateMachine(200, 1, 2) {}
 
+QemuCamera::~QemuCamera() {
+    qemud_shm_release(&mShm);
+}
+
 std::tuple<PixelFormat, BufferUsage, Dataspace, int32_t>
 QemuCamera::overrideStreamParams(const PixelFormat format,
                                  const BufferUsage usage,
@@ -127,23 +275,8 @@ bool QemuCamera::configure(const CameraMetadata& sessionParams,
                            const HalStream* halStreams) {
     applyMetadata(sessionParams);
 
-    if (!mQemuChannel.ok()) {
-        auto qemuChannel = qemuOpenChannel(std::string("name=") + mParams.name);
-        if (!qemuChannel.ok()) {
-            return false;
-        }
-
-        static const char kConnectQuery[] = "connect";
-        if (qemuRunQuery(qemuChannel.get(), kConnectQuery, sizeof(kConnectQuery)) < 0) {
-            return false;
-        }
-
-        static const char kStartQuery[] = "start";
-        if (qemuRunQuery(qemuChannel.get(), kStartQuery, sizeof(kStartQuery)) < 0) {
-            return false;
-        }
-
-        mQemuChannel = std::move(qemuChannel);
+    if (!mQemuChannel.ok() && !connectQemuChannel()) {
+        return false;
     }
 
     mStreamInfoCache.clear();
@@ -165,27 +298,101 @@ void QemuCamera::close() {
 
     if (mQemuChannel.ok()) {
         static const char kStopQuery[] = "stop";
-        if (qemuRunQuery(mQemuChannel.get(), kStopQuery, sizeof(kStopQuery)) >= 0) {
+        if ((qemuRunQuery(mQemuChannel.get(), kStopQuery, sizeof(kStopQuery)) >= 0) &&
+                !getWarmChannels().put(mParams.name, &mQemuChannel, &mShm)) {
             static const char kDisconnectQuery[] = "disconnect";
             qemuRunQuery(mQemuChannel.get(), kDisconnectQuery, sizeof(kDisconnectQuery));
         }
 
         mQemuChannel.reset();
     }
+
+    qemud_shm_release(&mShm);
+    mShmCharge.set(0);
+}
+
+// Takes the channel `close` left connected if it is still there, the
+// "connect" query (the host opens its webcam) is the most of the time
+// spent here.
+bool QemuCamera::connectQemuChannel() {
+    static const char kStartQuery[] = "start";
+    const auto t0 = std::chrono::steady_clock::now();
+
+    bool warm = getWarmChannels().take(mParams.name, &mQemuChannel, &mShm);
+    if (warm) {
+        mShmCharge.set(mShm.size);
+        if (qemuRunQuery(mQemuChannel.get(), kStartQuery, sizeof(kStartQuery)) < 0) {
+            ALOGW("%s:%s:%d the warm channel for '%s' did not start, reconnecting",
+                  kClass, __func__, __LINE__, mParams.name.c_str());
+            mQemuChannel.reset();
+            qemud_shm_release(&mShm);
+            mShmCharge.set(0);
+            warm = false;
+        }
+    }
+
+    if (!warm) {
+        auto qemuChannel = qemuOpenChannel(std::string("name=") + mParams.name);
+        if (!qemuChannel.ok()) {
+            return false;
+        }
+
+        static const char kConnectQuery[] = "connect";
+        if (qemuRunQuery(qemuChannel.get(), kConnectQuery, sizeof(kConnectQuery)) < 0) {
+            return false;
+        }
+
+        if (qemuRunQuery(qemuChannel.get(), kStartQuery, sizeof(kStartQuery)) < 0) {
+            return false;
+        }
+
+        mQemuChannel = std::move(qemuChannel);
+        attachShm();
+    }
+
+    ALOGI("%s:%s:%d '%s' started in %" PRId64 "us (%s)",
+          kClass, __func__, __LINE__, mParams.name.c_str(),
+          int64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - t0).count()),
+          (warm ? "warm" : "cold"));
+    return true;
 }
 
-std::tuple<int64_t, int64_t, CameraMetadata,
-           std::vector<StreamBuffer>, std::vector<DelayedStreamBuffer>>
-QemuCamera::processCaptureRequest(CameraMetadata metadataUpdate,
-                                  Span<CachedStreamBuffer*> csbs) {
-    CameraMetadata resultMetadata = metadataUpdate.metadata.empty() ?
-        updateCaptureResultMetadata() :
-        applyMetadata(std::move(metadataUpdate));
+// Frames are copied by the host into the buffers' mmaped offsets (the
+// goldfish address space), this is not available if the channel is not a
+// goldfish pipe (e.g. the host services stand-in). The host is offered
+// shared memory to write frames into instead of sending them through the
+// channel, the replies to frame queries tell when they are there.
+void QemuCamera::attachShm() {
+    size_t maxFrameSize = 0;
+    for (const auto& r : mParams.supportedResolutions) {
+        maxFrameSize = std::max(maxFrameSize, getQemuFrameSize(r, V4L2_PIX_FMT_RGB32));
+    }
+
+    if (qemuAttachShm(mQemuChannel.get(), maxFrameSize * kShmFrames, &mShm) < 0) {
+        qemud_shm_release(&mShm);
+    }
+    mShmCharge.set(mShm.size);
+}
+
+std::pair<int64_t, int64_t>
+QemuCamera::beginCaptureRequest(CameraMetadata metadataUpdate,
+                                CameraMetadata* resultMetadata) {
+    if (metadataUpdate.metadata.empty()) {
+        updateCaptureResultMetadata(resultMetadata);
+    } else {
+        *resultMetadata = applyMetadata(std::move(metadataUpdate));
+    }
 
+    return {(mQemuChannel.ok() ? mFrameDurationNs : FAILURE(-1)),
+            mSensorExposureDurationNs};
+}
+
+bool QemuCamera::processCaptureRequest(Span<CachedStreamBuffer*> csbs,
+                                       HwCaptureResult* result) {
     const size_t csbsSize = csbs.size();
-    std::vector<StreamBuffer> outputBuffers;
-    std::vector<DelayedStreamBuffer> delayedOutputBuffers;
-    outputBuffers.reserve(csbsSize);
+    std::vector<StreamBuffer>& outputBuffers = result->outputBuffers;
+    std::vector<DelayedStreamBuffer>& delayedOutputBuffers = result->delayedOutputBuffers;
 
     for (size_t i = 0; i < csbsSize; ++i) {
         CachedStreamBuffer* csb = csbs[i];
@@ -210,10 +417,7 @@ QemuCamera::processCaptureRequest(CameraMetadata metadataUpdate,
         }
     }
 
-    return make_tuple((mQemuChannel.ok() ? mFrameDurationNs : FAILURE(-1)),
-                      mSensorExposureDurationNs,
-                      std::move(resultMetadata), std::move(outputBuffers),
-                      std::move(delayedOutputBuffers));
+    return mQemuChannel.ok();
 }
 
 void QemuCamera::captureFrame(const StreamInfo& si,
@@ -261,8 +465,12 @@ bool QemuCamera::captureFrameYUV(const StreamInfo& si,
         return FAILURE(false);
     }
 
+    const void* shmFrame = nullptr;
     bool const res = queryFrame(si.size, V4L2_PIX_FMT_YUV420,
-                                mExposureComp, cb->getMmapedOffset());
+                                mExposureComp, cb->getMmapedOffset(), &shmFrame);
+    if (res && shmFrame) {
+        copyQemuFrameYUV(si.size, shmFrame, ycbcr);
+    }
 
     LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(cb) != NO_ERROR);
     return res;
@@ -287,8 +495,12 @@ bool QemuCamera::captureFrameRGBA(const StreamInfo& si,
         return FAILURE(false);
     }
 
+    const void* shmFrame = nullptr;
     bool const res = queryFrame(si.size, V4L2_PIX_FMT_RGB32,
-                                mExposureComp, cb->getMmapedOffset());
+                                mExposureComp, cb->getMmapedOffset(), &shmFrame);
+    if (res && shmFrame) {
+        copyQemuFrameRGBA(si.size, shmFrame, mem, cb->stride);
+    }
     LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(cb) != NO_ERROR);
     return res;
 }
@@ -297,21 +509,24 @@ DelayedStreamBuffer QemuCamera::captureFrameJpeg(const StreamInfo& si,
                                                  CachedStreamBuffer* csb) const {
     const native_handle_t* const image = captureFrameForCompressing(
         si.size, PixelFormat::YCBCR_420_888, V4L2_PIX_FMT_YUV420);
+    memaccount::Charge imageCharge(gCameraJpegStagingMemory,
+                                   image ? getQemuFrameSize(si.size, V4L2_PIX_FMT_YUV420) : 0);
 
     const Rect<uint16_t> imageSize = si.size;
     const uint32_t jpegBufferSize = si.blobBufferSize;
     const int64_t frameDurationNs = mFrameDurationNs;
-    CameraMetadata metadata = mCaptureResultMetadata;
+    std::shared_ptr<const CameraMetadata> metadata = mCaptureResultMetadata.snapshot();
 
-    return [csb, image, imageSize, metadata = std::move(metadata), jpegBufferSize,
-            frameDurationNs](const bool ok) -> StreamBuffer {
+    return [csb, image, imageCharge = std::move(imageCharge), imageSize,
+            metadata = std::move(metadata), jpegBufferSize,
+            frameDurationNs](const bool ok) mutable -> StreamBuffer {
         StreamBuffer sb;
         if (ok && image && csb->waitAcquireFence(frameDurationNs / 1000000)) {
             android_ycbcr imageYcbcr;
             if (GraphicBufferMapper::get().lockYCbCr(
                     image, static_cast<uint32_t>(BufferUsage::CPU_READ_OFTEN),
                     {imageSize.width, imageSize.height}, &imageYcbcr) == NO_ERROR) {
-                sb = csb->finish(compressJpeg(imageSize, imageYcbcr, metadata,
+                sb = csb->finish(compressJpeg(imageSize, imageYcbcr, *metadata,
                                               csb->getBuffer(), jpegBufferSize));
                 LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(image) != NO_ERROR);
             } else {
@@ -323,6 +538,7 @@ DelayedStreamBuffer QemuCamera::captureFrameJpeg(const StreamInfo& si,
 
         if (image) {
             GraphicBufferAllocator::get().free(image);
+            imageCharge.set(0);
         }
 
         return sb;
@@ -335,13 +551,17 @@ const native_handle_t* QemuCamera::captureFrameForCompressing(
         const uint32_t qemuFormat) const {
     constexpr BufferUsage kUsage = usageOr(BufferUsage::CAMERA_OUTPUT,
                                            BufferUsage::CPU_READ_OFTEN);
+    // The frame is copied in from `mShm`, the goldfish host writes it
+    // directly.
+    const BufferUsage usage = mShm.addr ? usageOr(kUsage, BufferUsage::CPU_WRITE_OFTEN)
+                                        : kUsage;
 
     GraphicBufferAllocator& gba = GraphicBufferAllocator::get();
     const native_handle_t* image = nullptr;
     uint32_t stride;
 
     if (gba.allocate(dim.width, dim.height, static_cast<int>(bufferFormat), 1,
-                     static_cast<uint64_t>(kUsage), &image, &stride,
+                     static_cast<uint64_t>(usage), &image, &stride,
                      "QemuCamera") != NO_ERROR) {
         return FAILURE(nullptr);
     }
@@ -352,7 +572,30 @@ const native_handle_t* QemuCamera::captureFrameForCompressing(
         return FAILURE(nullptr);
     }
 
-    if (!queryFrame(dim, qemuFormat, mExposureComp, cb->getMmapedOffset())) {
+    bool res;
+    if (mShm.addr) {
+        android_ycbcr ycbcr;
+        if (GraphicBufferMapper::get().lockYCbCr(
+                image, static_cast<uint32_t>(BufferUsage::CPU_WRITE_OFTEN),
+                {dim.width, dim.height}, &ycbcr) != NO_ERROR) {
+            gba.free(image);
+            return FAILURE(nullptr);
+        }
+
+        const void* shmFrame = nullptr;
+        res = queryFrame(dim, qemuFormat, mExposureComp,
+                         cb->getMmapedOffset(), &shmFrame);
+        if (res && shmFrame) {
+            copyQemuFrameYUV(dim, shmFrame, ycbcr);
+        }
+        LOG_ALWAYS_FATAL_IF(GraphicBufferMapper::get().unlock(image) != NO_ERROR);
+    } else {
+        const void* shmFrame = nullptr;
+        res = queryFrame(dim, qemuFormat, mExposureComp,
+                         cb->getMmapedOffset(), &shmFrame);
+    }
+
+    if (!res) {
         gba.free(image);
         return FAILURE(nullptr);
     }
@@ -363,19 +606,45 @@ const native_handle_t* QemuCamera::captureFrameForCompressing(
 bool QemuCamera::queryFrame(const Rect<uint16_t> dim,
                             const uint32_t pixelFormat,
                             const float exposureComp,
-                            const uint64_t dataOffset) const {
+                            const uint64_t dataOffset,
+                            const void** const shmFrame) const {
     constexpr float scaleR = 1;
     constexpr float scaleG = 1;
     constexpr float scaleB = 1;
 
+    // The host writes frames either to `dataOffset` in the goldfish address
+    // space or to `mShm`. In the latter case `*shmFrame` points to the packed
+    // frame there until the next query, the caller copies it into the buffer
+    // honoring the buffer's strides.
+    size_t frameSize = 0;
+    long shmOffset = -1;
+    char location[48];
+    if (mShm.addr) {
+        frameSize = getQemuFrameSize(dim, pixelFormat);
+        shmOffset = qemud_shm_reserve(&mShm, frameSize);
+        if (!frameSize || (shmOffset < 0)) {
+            return FAILURE(false);
+        }
+        snprintf(location, sizeof(location), "shmoffset=%ld", shmOffset);
+    } else {
+        snprintf(location, sizeof(location), "offset=%" PRIu64, dataOffset);
+    }
+
     char queryStr[128];
     const int querySize = snprintf(queryStr, sizeof(queryStr),
-        "frame dim=%" PRIu32 "x%" PRIu32 " pix=%" PRIu32 " offset=%" PRIu64
+        "frame dim=%" PRIu32 "x%" PRIu32 " pix=%" PRIu32 " %s"
         " whiteb=%g,%g,%g expcomp=%g time=%d",
-        dim.width, dim.height, static_cast<uint32_t>(pixelFormat), dataOffset,
+        dim.width, dim.height, static_cast<uint32_t>(pixelFormat), location,
         scaleR, scaleG, scaleB, exposureComp, 0);
 
-    return qemuRunQuery(mQemuChannel.get(), queryStr, querySize + 1) >= 0;
+    if (qemuRunQuery(mQemuChannel.get(), queryStr, querySize + 1) < 0) {
+        return false;
+    }
+
+    if (shmOffset >= 0) {
+        *shmFrame = static_cast<const uint8_t*>(mShm.addr) + shmOffset;
+    }
+    return true;
 }
 
 float QemuCamera::calculateExposureComp(const int64_t exposureNs,
@@ -449,24 +718,27 @@ CameraMetadata QemuCamera::applyMetadata(const CameraMetadata& metadata) {
         serializeCameraMetadataMap(m);
 
     if (maybeSerialized) {
-        mCaptureResultMetadata = std::move(maybeSerialized.value());
+        mCaptureResultMetadata.set(std::move(maybeSerialized.value()));
     }
 
     {   // reset ANDROID_CONTROL_AF_TRIGGER to IDLE
-        camera_metadata_t* const raw =
-            reinterpret_cast<camera_metadata_t*>(mCaptureResultMetadata.metadata.data());
+        const camera_metadata_t* const raw = reinterpret_cast<const camera_metadata_t*>(
+            mCaptureResultMetadata.get().metadata.data());
 
         camera_metadata_ro_entry_t entry;
         const auto newTriggerValue = ANDROID_CONTROL_AF_TRIGGER_IDLE;
 
         if (find_camera_metadata_ro_entry(raw, ANDROID_CONTROL_AF_TRIGGER, &entry)) {
-            return mCaptureResultMetadata;
+            return mCaptureResultMetadata.get();
         } else if (entry.data.i32[0] == newTriggerValue) {
-            return mCaptureResultMetadata;
+            return mCaptureResultMetadata.get();
         } else {
-            CameraMetadata result = mCaptureResultMetadata;
+            CameraMetadata result = mCaptureResultMetadata.get();
+            camera_metadata_t* const mutableRaw = reinterpret_cast<camera_metadata_t*>(
+                mCaptureResultMetadata.edit()->metadata.data());
 
-            if (update_camera_metadata_entry(raw, entry.index, &newTriggerValue, 1, nullptr)) {
+            if (update_camera_metadata_entry(mutableRaw, entry.index,
+                                             &newTriggerValue, 1, nullptr)) {
                 ALOGW("%s:%s:%d: update_camera_metadata_entry(ANDROID_CONTROL_AF_TRIGGER) "
                       "failed", kClass, __func__, __LINE__);
             }
@@ -476,9 +748,9 @@ CameraMetadata QemuCamera::applyMetadata(const CameraMetadata& metadata) {
     }
 }
 
-CameraMetadata QemuCamera::updateCaptureResultMetadata() {
+void QemuCamera::updateCaptureResultMetadata(CameraMetadata* result) {
     camera_metadata_t* const raw =
-        reinterpret_cast<camera_metadata_t*>(mCaptureResultMetadata.metadata.data());
+        reinterpret_cast<camera_metadata_t*>(mCaptureResultMetadata.edit()->metadata.data());
 
     const auto af = mAFStateMachine();
 
@@ -500,7 +772,7 @@ CameraMetadata QemuCamera::updateCaptureResultMetadata() {
               kClass, __func__, __LINE__);
     }
 
-    return metadataCompact(mCaptureResultMetadata);
+    metadataCompact(mCaptureResultMetadata.get(), result);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -20,9 +20,12 @@
 #include <unordered_map>
 
 #include <android-base/unique_fd.h>
+#include <qemud.h>
 
 #include "HwCamera.h"
 #include "AFStateMachine.h"
+#include "memory_counters.h"
+#include "metadata_utils.h"
 
 namespace android {
 namespace hardware {
@@ -41,6 +44,7 @@ struct QemuCamera : public HwCamera {
     };
 
     explicit QemuCamera(const Parameters& params);
+    ~QemuCamera() override;
 
     std::tuple<PixelFormat, BufferUsage, Dataspace, int32_t>
         overrideStreamParams(PixelFormat, BufferUsage, Dataspace) const override;
@@ -49,9 +53,11 @@ struct QemuCamera : public HwCamera {
                    const Stream* streams, const HalStream* halStreams) override;
     void close() override;
 
-    std::tuple<int64_t, int64_t, CameraMetadata, std::vector<StreamBuffer>,
-               std::vector<DelayedStreamBuffer>>
-        processCaptureRequest(CameraMetadata, Span<CachedStreamBuffer*>) override;
+    std::pair<int64_t, int64_t>
+        beginCaptureRequest(CameraMetadata metadataUpdate,
+                            CameraMetadata* resultMetadata) override;
+    bool processCaptureRequest(Span<CachedStreamBuffer*>,
+                               HwCaptureResult* result) override;
 
     // metadata
     Span<const std::pair<int32_t, int32_t>> getTargetFpsRanges() const override;
@@ -92,17 +98,23 @@ private:
                                                       PixelFormat bufferFormat,
                                                       uint32_t qemuFormat) const;
     bool queryFrame(Rect<uint16_t> dim, uint32_t pixelFormat,
-                    float exposureComp, uint64_t dataOffset) const;
+                    float exposureComp, uint64_t dataOffset,
+                    const void** shmFrame) const;
+    bool connectQemuChannel();
+    void attachShm();
     static float calculateExposureComp(int64_t exposureNs, int sensorSensitivity,
                                        float aperture);
     CameraMetadata applyMetadata(const CameraMetadata& metadata);
-    CameraMetadata updateCaptureResultMetadata();
+    void updateCaptureResultMetadata(CameraMetadata* result);
 
     const Parameters& mParams;
     AFStateMachine mAFStateMachine;
     std::unordered_map<int32_t, StreamInfo> mStreamInfoCache;
     base::unique_fd mQemuChannel;
-    CameraMetadata mCaptureResultMetadata;
+    // frames from the host if it is not a goldfish pipe, see `attachShm`
+    mutable qemud_shm mShm = {};
+    memaccount::Charge mShmCharge{gCameraShmMemory};
+    CaptureResultMetadata mCaptureResultMetadata;
 
     int64_t mFrameDurationNs = 0;
     int64_t mSensorExposureDurationNs = 0;
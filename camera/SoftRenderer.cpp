@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <log/log.h>
+
+#include "SoftRenderer.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace provider {
+namespace implementation {
+namespace hw {
+namespace {
+constexpr unsigned kRowsPerBand = 16;
+
+// GCC and clang lower these into SSE or NEON instructions, a lane is a
+// pixel. Comparisons give -1 in the lanes where they are true.
+typedef float float4 __attribute__((vector_size(16)));
+typedef int32_t int4 __attribute__((vector_size(16)));
+typedef uint32_t uint4 __attribute__((vector_size(16)));
+
+// `w` is in [0, 256], all four channels of a pixel are interpolated at once.
+uint4 lerpRGBA(const uint4 a, const uint4 b, const uint4 w) {
+    const uint4 w1 = 256 - w;
+    const uint4 rb = ((((a & 0x00FF00FFU) * w1) + ((b & 0x00FF00FFU) * w)) >> 8) & 0x00FF00FFU;
+    const uint4 ag = ((((a >> 8) & 0x00FF00FFU) * w1) + (((b >> 8) & 0x00FF00FFU) * w)) & 0xFF00FF00U;
+    return rb | ag;
+}
+
+int4 clampInt(int4 x, const int hi) {
+    x &= ~(x < 0);
+    const int4 over = x > hi;
+    return (x & ~over) | (hi & over);
+}
+
+int4 floorInt(const float4 x) {
+    const int4 i = __builtin_convertvector(x, int4);
+    return i + (x < __builtin_convertvector(i, float4));
+}
+
+uint4 gather(const uint32_t* const texels, const int4 index) {
+    return uint4{texels[index[0]], texels[index[1]], texels[index[2]], texels[index[3]]};
+}
+
+// `u` and `v` are in [0, 1]
+uint4 sample(const SoftRenderer::Texture& texture, const float4 u, const float4 v) {
+    const int width = texture.width;
+    const int height = texture.height;
+    const uint32_t* const texels = texture.texels.data();
+
+    if (!texture.linear) {
+        const int4 x = clampInt(__builtin_convertvector(u * float(width), int4), width - 1);
+        const int4 y = clampInt(__builtin_convertvector(v * float(height), int4), height - 1);
+        return gather(texels, y * width + x);
+    }
+
+    const float4 fx = u * float(width) - 0.5f;
+    const float4 fy = v * float(height) - 0.5f;
+    const int4 fx0 = floorInt(fx);
+    const int4 fy0 = floorInt(fy);
+    const uint4 wx = __builtin_convertvector((fx - __builtin_convertvector(fx0, float4)) * 256.0f,
+                                             uint4);
+    const uint4 wy = __builtin_convertvector((fy - __builtin_convertvector(fy0, float4)) * 256.0f,
+                                             uint4);
+    const int4 x0 = clampInt(fx0, width - 1);
+    const int4 x1 = clampInt(fx0 + 1, width - 1);
+    const int4 row0 = clampInt(fy0, height - 1) * width;
+    const int4 row1 = clampInt(fy0 + 1, height - 1) * width;
+
+    return lerpRGBA(lerpRGBA(gather(texels, row0 + x0), gather(texels, row0 + x1), wx),
+                    lerpRGBA(gather(texels, row1 + x0), gather(texels, row1 + x1), wx),
+                    wy);
+}
+
+}  // namespace
+
+SoftRenderer::SoftRenderer(Texture texture, const unsigned nThreads)
+        : mTexture(std::move(texture)) {
+    LOG_ALWAYS_FATAL_IF(mTexture.texels.size() != size_t(mTexture.width) * mTexture.height);
+
+    // the calling thread renders too
+    for (unsigned i = 1; i < nThreads; ++i) {
+        mWorkers.push_back(std::thread(&SoftRenderer::workerThread, this));
+    }
+}
+
+SoftRenderer::~SoftRenderer() {
+    {
+        std::lock_guard<std::mutex> lock(mMtx);
+        mRunning = false;
+        mWorkAvailable.notify_all();
+    }
+
+    for (std::thread& t : mWorkers) {
+        t.join();
+    }
+}
+
+bool SoftRenderer::render(const float pvMatrix44[], const Rect<uint16_t> imageSize,
+                          uint32_t* const dst, const size_t stride,
+                          const uint32_t clearColor) {
+    // The square is in the y=0 plane, so {x, z, 1} goes into
+    // {clipX, clipY, clipW} with the 3x3 matrix below (clipZ is not used,
+    // the square is always between the near and far planes).
+    const double m[9] = {
+        pvMatrix44[0],  pvMatrix44[2],  pvMatrix44[3],
+        pvMatrix44[4],  pvMatrix44[6],  pvMatrix44[7],
+        pvMatrix44[12], pvMatrix44[14], pvMatrix44[15],
+    };
+
+    const double adj[9] = {
+        m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+        m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+        m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3],
+    };
+
+    const double det = m[0] * adj[0] + m[1] * adj[3] + m[2] * adj[6];
+
+    std::lock_guard<std::mutex> renderLock(mRenderMtx);
+
+    Job job;
+    for (unsigned i = 0; i < 9; ++i) {
+        // the plane is seen edge-on if `det` is zero, all pixels get `clearColor`
+        job.planeFromNdc33[i] = (std::fabs(det) > 1e-12) ? (adj[i] / det) : 0;
+    }
+    job.imageSize = imageSize;
+    job.dst = dst;
+    job.stride = stride;
+    job.clearColor = clearColor;
+    job.rowsPerBand = kRowsPerBand;
+
+    std::unique_lock<std::mutex> lock(mMtx);
+    mJob = &job;
+    mNumBands = (imageSize.height + kRowsPerBand - 1) / kRowsPerBand;
+    mNextBand = 0;
+    mBandsDone = 0;
+    mWorkAvailable.notify_all();
+
+    while (mNextBand < mNumBands) {
+        const unsigned band = mNextBand++;
+        lock.unlock();
+        renderBand(job, band);
+        lock.lock();
+        ++mBandsDone;
+    }
+
+    mJobDone.wait(lock, [this](){ return mBandsDone == mNumBands; });
+    mJob = nullptr;
+    mNumBands = 0;
+    return true;
+}
+
+void SoftRenderer::workerThread() {
+    std::unique_lock<std::mutex> lock(mMtx);
+    while (true) {
+        mWorkAvailable.wait(lock, [this](){
+            return !mRunning || (mNextBand < mNumBands);
+        });
+
+        if (!mRunning) {
+            break;
+        }
+
+        const unsigned band = mNextBand++;
+        const Job* job = mJob;
+        lock.unlock();
+        renderBand(*job, band);
+        lock.lock();
+
+        if (++mBandsDone == mNumBands) {
+            mJobDone.notify_one();
+        }
+    }
+}
+
+void SoftRenderer::renderBand(const Job& job, const unsigned band) const {
+    const unsigned rowBegin = band * job.rowsPerBand;
+    const unsigned rowEnd = std::min(rowBegin + job.rowsPerBand,
+                                     unsigned(job.imageSize.height));
+
+    for (unsigned row = rowBegin; row < rowEnd; ++row) {
+        renderRow(job, row);
+    }
+}
+
+void SoftRenderer::renderRow(const Job& job, const unsigned row) const {
+    const unsigned width = job.imageSize.width;
+    const float* const h = job.planeFromNdc33;
+    const float dx = 2.0f / width;
+    const float ndcX0 = dx / 2 - 1;
+    const float ndcY = (row + 0.5f) * 2.0f / job.imageSize.height - 1;
+
+    // {x, z, 1/w} are linear in ndcX along the row, four pixels at once
+    const float4 ndcX = {ndcX0, ndcX0 + dx, ndcX0 + 2 * dx, ndcX0 + 3 * dx};
+    const float bx = h[1] * ndcY + h[2];
+    const float bz = h[4] * ndcY + h[5];
+    const float bw = h[7] * ndcY + h[8];
+    const float step = 4 * dx;
+
+    float4 xw = h[0] * ndcX + bx;
+    float4 zw = h[3] * ndcX + bz;
+    float4 w = h[6] * ndcX + bw;
+
+    uint32_t* dst = job.dst + size_t(row) * job.stride;
+    for (unsigned col = 0; col < width; col += 4, dst += 4,
+                                        xw += h[0] * step, zw += h[3] * step,
+                                        w += h[6] * step) {
+        const float4 invW = 1.0f / w;
+        const float4 u = (xw * invW + 1.0f) * 0.5f;
+        const float4 v = (zw * invW + 1.0f) * 0.5f;
+
+        // `w` is `1/clipW`, it is negative behind the camera. The lanes
+        // outside of the square sample at {0, 0} and get `clearColor`.
+        const int4 inside = (w > 0.0f) & (u >= 0.0f) & (u <= 1.0f) & (v >= 0.0f) & (v <= 1.0f);
+        const uint4 texel = sample(mTexture, (float4)((int4)u & inside),
+                                   (float4)((int4)v & inside));
+        const uint4 color = (texel & (uint4)inside) | (job.clearColor & ~(uint4)inside);
+
+        const unsigned n = std::min(4U, width - col);
+        for (unsigned i = 0; i < n; ++i) {
+            dst[i] = color[i];
+        }
+    }
+}
+
+}  // namespace hw
+}  // namespace implementation
+}  // namespace provider
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "Rect.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace provider {
+namespace implementation {
+namespace hw {
+
+// Renders the FakeRotatingCamera scene (one textured square in the y=0 plane,
+// x and z are in [-1, 1]) on the CPU. This is used where GL is not available
+// or is a slow general purpose software implementation. Each pixel is mapped
+// back into the square's plane (perspective correct) and the texture is
+// sampled with a bilinear filter, four pixels at a time in vector lanes with
+// the four channels of a pixel blended in one register. Rows are rendered in
+// bands by a pool of threads.
+struct SoftRenderer {
+    struct Texture {
+        std::vector<uint32_t> texels;  // RGBA8888, the first row is v=0
+        uint16_t width = 0;
+        uint16_t height = 0;
+        bool linear = false;  // bilinear or nearest
+    };
+
+    SoftRenderer(Texture texture, unsigned nThreads);
+    ~SoftRenderer();
+
+    // `pvMatrix44` is the same row major matrix as GL uses, `stride` is in
+    // pixels. The first row in `dst` is y=-1 in the normalized device
+    // coordinates (the same as rendering into AHardwareBuffer). Several
+    // cameras can share one SoftRenderer, their renders take turns.
+    bool render(const float pvMatrix44[], Rect<uint16_t> imageSize,
+                uint32_t* dst, size_t stride, uint32_t clearColor);
+
+    SoftRenderer(const SoftRenderer&) = delete;
+    SoftRenderer(SoftRenderer&&) = delete;
+    SoftRenderer& operator=(const SoftRenderer&) = delete;
+    SoftRenderer& operator=(SoftRenderer&&) = delete;
+
+private:
+    struct Job {
+        float planeFromNdc33[9];  // maps {ndcX, ndcY, 1} into {x, z, 1/w}
+        Rect<uint16_t> imageSize;
+        uint32_t* dst;
+        size_t stride;
+        uint32_t clearColor;
+        unsigned rowsPerBand;
+    };
+
+    void workerThread();
+    void renderBand(const Job& job, unsigned band) const;
+    void renderRow(const Job& job, unsigned row) const;
+
+    const Texture mTexture;
+    std::vector<std::thread> mWorkers;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mJobDone;
+    std::mutex mRenderMtx;  // one `render` at a time
+    std::mutex mMtx;
+    const Job* mJob = nullptr;
+    unsigned mNumBands = 0;
+    unsigned mNextBand = 0;
+    unsigned mBandsDone = 0;
+    bool mRunning = true;
+};
+
+}  // namespace hw
+}  // namespace implementation
+}  // namespace provider
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
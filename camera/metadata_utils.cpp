@@ -18,6 +18,7 @@
 
 #include <memory>
 #include <numeric>
+#include <utility>
 
 #include <system/camera_metadata.h>
 
@@ -53,6 +54,14 @@ CameraMetadata metadataCompact(const CameraMetadata& m) {
     return metadataCompactRaw(reinterpret_cast<const camera_metadata_t*>(m.metadata.data()));
 }
 
+void metadataCompact(const CameraMetadata& src, CameraMetadata* dst) {
+    const camera_metadata_t* const raw =
+        reinterpret_cast<const camera_metadata_t*>(src.metadata.data());
+    const size_t size = get_camera_metadata_compact_size(raw);
+    dst->metadata.resize(size);
+    copy_camera_metadata(dst->metadata.data(), size, raw);
+}
+
 std::optional<CameraMetadata> serializeCameraMetadataMap(const CameraMetadataMap& m) {
     const size_t dataSize = std::accumulate(m.begin(), m.end(), 0,
         [](const size_t z, const CameraMetadataMap::value_type& kv) {
@@ -138,6 +147,73 @@ void metadataSetShutterTimestamp(CameraMetadata* m, const int64_t shutterTimesta
     }
 }
 
+void metadataSplit(CameraMetadata* m, CameraMetadata* selected,
+                   CameraMetadata* scratch, bool (*select)(uint32_t tag)) {
+    selected->metadata.clear();
+    if (m->metadata.empty()) {
+        return;
+    }
+
+    const camera_metadata_t* const raw =
+        reinterpret_cast<const camera_metadata_t*>(m->metadata.data());
+    const size_t n = get_camera_metadata_entry_count(raw);
+
+    // Both parts are sized exactly first, this makes them compact as they
+    // are filled.
+    size_t selEntries = 0;
+    size_t selData = 0;
+    size_t restEntries = 0;
+    size_t restData = 0;
+    for (size_t i = 0; i < n; ++i) {
+        camera_metadata_ro_entry_t e;
+        if (get_camera_metadata_ro_entry(raw, i, &e)) {
+            ALOGW("%s:%d get_camera_metadata_ro_entry(%zu) failed",
+                  __func__, __LINE__, i);
+            return;
+        }
+
+        const size_t dataSize = calculate_camera_metadata_entry_data_size(e.type, e.count);
+        if (select(e.tag)) {
+            ++selEntries;
+            selData += dataSize;
+        } else {
+            ++restEntries;
+            restData += dataSize;
+        }
+    }
+
+    if (!selEntries) {
+        return;
+    }
+
+    selected->metadata.resize(calculate_camera_metadata_size(selEntries, selData));
+    scratch->metadata.resize(calculate_camera_metadata_size(restEntries, restData));
+    camera_metadata_t* const sel = place_camera_metadata(
+        selected->metadata.data(), selected->metadata.size(), selEntries, selData);
+    camera_metadata_t* const rest = place_camera_metadata(
+        scratch->metadata.data(), scratch->metadata.size(), restEntries, restData);
+    if (!sel || !rest) {
+        ALOGW("%s:%d place_camera_metadata failed", __func__, __LINE__);
+        selected->metadata.clear();
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        camera_metadata_ro_entry_t e;
+        get_camera_metadata_ro_entry(raw, i, &e);
+        if (add_camera_metadata_entry(select(e.tag) ? sel : rest,
+                                      e.tag, e.data.u8, e.count)) {
+            ALOGW("%s:%d add_camera_metadata_entry(%s.%s) failed", __func__, __LINE__,
+                  get_camera_metadata_section_name(e.tag),
+                  get_camera_metadata_tag_name(e.tag));
+            selected->metadata.clear();
+            return;
+        }
+    }
+
+    std::swap(m->metadata, scratch->metadata);
+}
+
 void prettyPrintCameraMetadata(const CameraMetadata& m) {
     const camera_metadata_t* const raw =
         reinterpret_cast<const camera_metadata_t*>(m.metadata.data());
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <type_traits>
 #include <unordered_map>
@@ -63,6 +64,8 @@ struct CameraMetadataValue {
 using CameraMetadataMap = std::unordered_map<uint32_t, CameraMetadataValue>;
 
 CameraMetadata metadataCompact(const CameraMetadata&);
+// reuses `dst`'s storage
+void metadataCompact(const CameraMetadata& src, CameraMetadata* dst);
 
 std::optional<CameraMetadata> serializeCameraMetadataMap(const CameraMetadataMap& m);
 
@@ -70,8 +73,43 @@ CameraMetadataMap parseCameraMetadataMap(const CameraMetadata& m);
 
 void metadataSetShutterTimestamp(CameraMetadata* metadata, int64_t shutterTimestampNs);
 
+// Moves the entries `select` returns true for from `metadata` to `selected`.
+// `selected` is left empty if nothing is selected. Reuses `selected`'s and
+// `scratch`'s storage, `scratch` gets the storage `metadata` had.
+void metadataSplit(CameraMetadata* metadata, CameraMetadata* selected,
+                   CameraMetadata* scratch, bool (*select)(uint32_t tag));
+
 void prettyPrintCameraMetadata(const CameraMetadata&);
 
+// The capture result metadata a camera updates for every frame on the
+// capture thread. JPEG tasks run on another thread and get an immutable
+// snapshot, it is copied only once after every change.
+class CaptureResultMetadata {
+public:
+    const CameraMetadata& get() const { return mMetadata; }
+
+    CameraMetadata* edit() {
+        mSnapshot.reset();  // the tasks keep their snapshots
+        return &mMetadata;
+    }
+
+    void set(CameraMetadata metadata) {
+        mMetadata = std::move(metadata);
+        mSnapshot.reset();
+    }
+
+    std::shared_ptr<const CameraMetadata> snapshot() const {
+        if (!mSnapshot) {
+            mSnapshot = std::make_shared<const CameraMetadata>(mMetadata);
+        }
+        return mSnapshot;
+    }
+
+private:
+    CameraMetadata mMetadata;
+    mutable std::shared_ptr<const CameraMetadata> mSnapshot;
+};
+
 }  // namespace implementation
 }  // namespace provider
 }  // namespace camera
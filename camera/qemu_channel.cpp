@@ -51,37 +51,13 @@ int qemuReceiveMessage(const int fd, std::vector<uint8_t>* data) {
     return 0;
 }
 
-} // namespace
-
-base::unique_fd qemuOpenChannel() {
-    return base::unique_fd(qemud_channel_open(kServiceName));
-}
-
-base::unique_fd qemuOpenChannel(const std::string_view param) {
-    if (param.empty()) {
-        return qemuOpenChannel();
-    } else {
-        return base::unique_fd(qemud_channel_open(
-            (std::string(kServiceName) + ":" +
-             std::string(param.begin(), param.end())).c_str()));
-    }
-}
-
-int qemuRunQuery(const int fd,
-                 const char* const query,
-                 const size_t querySize,
-                 std::vector<uint8_t>* result) {
+int qemuReceiveReply(const int fd, const char* const query,
+                     std::vector<uint8_t>* result) {
     static const uint8_t kZero = 0;
-    static const uint8_t kSeparator = ' ';
     static const uint8_t kColon = ':';
 
-    int e = qemu_pipe_write_fully(fd, query, querySize);
-    if (e < 0) {
-        return FAILURE(e);
-    }
-
     std::vector<uint8_t> reply;
-    e = qemuReceiveMessage(fd, &reply);
+    int e = qemuReceiveMessage(fd, &reply);
     if (e < 0) {
         return e;
     }
@@ -126,6 +102,52 @@ int qemuRunQuery(const int fd,
     }
 }
 
+} // namespace
+
+base::unique_fd qemuOpenChannel() {
+    return base::unique_fd(qemud_channel_open(kServiceName));
+}
+
+base::unique_fd qemuOpenChannel(const std::string_view param) {
+    if (param.empty()) {
+        return qemuOpenChannel();
+    } else {
+        return base::unique_fd(qemud_channel_open(
+            (std::string(kServiceName) + ":" +
+             std::string(param.begin(), param.end())).c_str()));
+    }
+}
+
+int qemuRunQuery(const int fd,
+                 const char* const query,
+                 const size_t querySize,
+                 std::vector<uint8_t>* result) {
+    int e = qemu_pipe_write_fully(fd, query, querySize);
+    if (e < 0) {
+        return FAILURE(e);
+    }
+
+    return qemuReceiveReply(fd, query, result);
+}
+
+int qemuAttachShm(const int fd, const size_t size, qemud_shm* shm) {
+    char query[64];
+    const int querySize = snprintf(query, sizeof(query), "shm size=%zu", size);
+
+    if (qemud_shm_attach(fd, size, query, querySize + 1, shm)) {
+        const int e = -errno;
+        return (e == -EOPNOTSUPP) ? e : FAILURE(e);
+    }
+
+    const int e = qemuReceiveReply(fd, query, nullptr);
+    if (e < 0) {
+        qemud_shm_release(shm);
+        return e;
+    }
+
+    return 0;
+}
+
 }  // namespace hw
 }  // namespace implementation
 }  // namespace provider
@@ -19,6 +19,7 @@
 #include <vector>
 #include <string_view>
 #include <android-base/unique_fd.h>
+#include <qemud.h>
 
 namespace android {
 namespace hardware {
@@ -34,6 +35,11 @@ base::unique_fd qemuOpenChannel(std::string_view arg);
 int qemuRunQuery(int fd, const char* query, size_t querySise,
                  std::vector<uint8_t>* data = nullptr);
 
+// Hands `size` bytes of shared memory to the host to receive frames in, see
+// `qemud_shm_attach`. Returns -EOPNOTSUPP if the channel can not carry it
+// (goldfish pipes), frames then go to the buffers' mmaped offsets.
+int qemuAttachShm(int fd, size_t size, qemud_shm* shm);
+
 }  // namespace hw
 }  // namespace implementation
 }  // namespace provider
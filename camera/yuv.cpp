@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <string.h>
 #include <log/log.h>
 #include "yuv.h"
 
@@ -55,6 +56,25 @@ void copyCbCrPlane(uint8_t* dst, const size_t width, size_t height,
     }
 }
 
+void scatterCbCrPlane(void* dst, const size_t dstStride, const size_t dstStep,
+                      const uint8_t* src, const size_t width, size_t height) {
+    uint8_t* dst8 = static_cast<uint8_t*>(dst);
+    for (; height > 0; --height, dst8 += dstStride) {
+        uint8_t* p = dst8;
+        for (size_t col = width; col > 0; --col, ++src, p += dstStep) {
+            *p = *src;
+        }
+    }
+}
+
+void copyPlane(void* dst, const size_t dstStride,
+               const uint8_t* src, const size_t width, size_t height) {
+    uint8_t* dst8 = static_cast<uint8_t*>(dst);
+    for (; height > 0; --height, dst8 += dstStride, src += width) {
+        memcpy(dst8, src, width);
+    }
+}
+
 }  // namespace
 
 size_t NV21size(const size_t width, const size_t height) {
@@ -105,6 +125,25 @@ android_ycbcr toNV21Shallow(const size_t width, const size_t height,
     return nv21;
 }
 
+void copyNV21(const size_t width, const size_t height, const void* nv21data,
+              const android_ycbcr& dst) {
+    LOG_ALWAYS_FATAL_IF((width & 1) || (height & 1));
+    const uint8_t* const src8 = static_cast<const uint8_t*>(nv21data);
+    const size_t area = width * height;
+
+    copyPlane(dst.y, dst.ystride, src8, width, height);
+
+    if (dst.chroma_step == 1) {
+        copyPlane(dst.cb, dst.cstride, src8 + area, width / 2, height / 2);
+        copyPlane(dst.cr, dst.cstride, src8 + area + (area >> 2), width / 2, height / 2);
+    } else {
+        scatterCbCrPlane(dst.cb, dst.cstride, dst.chroma_step,
+                         src8 + area, width / 2, height / 2);
+        scatterCbCrPlane(dst.cr, dst.cstride, dst.chroma_step,
+                         src8 + area + (area >> 2), width / 2, height / 2);
+    }
+}
+
 }  // namespace yuv
 }  // namespace implementation
 }  // namespace provider
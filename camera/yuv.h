@@ -34,6 +34,9 @@ android_ycbcr NV21init(size_t width, size_t height, void* data);
 android_ycbcr toNV21Shallow(size_t width, size_t height, const android_ycbcr& ycbcr,
                             std::vector<uint8_t>* data);
 
+void copyNV21(size_t width, size_t height, const void* nv21data,
+              const android_ycbcr& dst);
+
 }  // namespace yuv
 }  // namespace implementation
 }  // namespace provider
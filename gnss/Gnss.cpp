@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <log/log.h>
 #include <debug.h>
 
@@ -38,11 +39,22 @@ namespace gnss {
 namespace implementation {
 namespace {
 constexpr char kGnssDeviceName[] = "Android Studio Emulator GPS";
+constexpr char kAidingDataPath[] = "/data/vendor/gnss/aiding_data";
+
+// The host sends NMEA sentences once a second, parsing starts this early to
+// have the GPGGA (altitude and satellites) before the GPRMC of the next fix.
+constexpr std::chrono::milliseconds kFixLeadTime(1500);
+
+// A receiver between fixes keeps its ephemeris and time, it only has to
+// reacquire the satellites it was tracking to produce the next fix.
+constexpr std::chrono::milliseconds kFixActiveTime = kFixLeadTime + std::chrono::seconds(1);
 }  // namespace
 
 Gnss::Gnss()
-        : mGnssBatching(ndk::SharedRefBase::make<GnssBatching>())
-        , mGnssConfiguration(ndk::SharedRefBase::make<GnssConfiguration>()) {
+        : mEnergyModel(std::make_shared<GnssEnergyModel>())
+        , mGnssBatching(ndk::SharedRefBase::make<GnssBatching>(mEnergyModel))
+        , mGnssConfiguration(ndk::SharedRefBase::make<GnssConfiguration>())
+        , mAidingStore(kAidingDataPath) {
 }
 
 Gnss::~Gnss() {
@@ -65,10 +77,17 @@ ndk::ScopedAStatus Gnss::setCallback(const std::shared_ptr<IGnssCallback>& callb
 }
 
 ndk::ScopedAStatus Gnss::close() {
-    mGnssHwConn.reset();
+    std::unique_ptr<GnssHwConn> gnssHwConn;  // destroyed after `lock` is released
 
     std::lock_guard<std::mutex> lock(mMtx);
+    gnssHwConn = std::move(mGnssHwConn);
+    if (mCallback && isSessionActiveLocked()) {
+        mCallback->gnssStatusCb(IGnssCallback::GnssStatusValue::ENGINE_OFF);
+    }
+    mSessionState = SessionState::OFF;
     mCallback.reset();
+    updateEnergyModelLocked();
+    mAidingStore.save();
 
     return ndk::ScopedAStatus::ok();
 }
@@ -86,14 +105,13 @@ ndk::ScopedAStatus Gnss::getExtensionGnssConfiguration(
 
 ndk::ScopedAStatus Gnss::getExtensionGnssMeasurement(
         std::shared_ptr<IGnssMeasurementInterface>* iGnssMeasurement) {
-    *iGnssMeasurement = ndk::SharedRefBase::make<GnssMeasurementInterface>();
+    *iGnssMeasurement = ndk::SharedRefBase::make<GnssMeasurementInterface>(mEnergyModel);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Gnss::getExtensionGnssPowerIndication(
         std::shared_ptr<IGnssPowerIndication>* iGnssPowerIndication) {
-    *iGnssPowerIndication = ndk::SharedRefBase::make<GnssPowerIndication>(
-        std::bind(&Gnss::getRunningTime, this));
+    *iGnssPowerIndication = ndk::SharedRefBase::make<GnssPowerIndication>(mEnergyModel);
     return ndk::ScopedAStatus::ok();
 }
 
@@ -137,65 +155,86 @@ ndk::ScopedAStatus Gnss::getExtensionGnssVisibilityControl(
 }
 
 ndk::ScopedAStatus Gnss::start() {
+    std::shared_ptr<IGnssCallback> callback;
+    bool needGnssHwConn;
     {
         std::lock_guard<std::mutex> lock(mMtx);
-        if (!mCallback) {
-            return ndk::ScopedAStatus::fromExceptionCode(FAILURE(IGnss::ERROR_INVALID_ARGUMENT));
-        }
+        callback = mCallback;
+        needGnssHwConn = !mGnssHwConn;
+    }
+    if (!callback) {
+        return ndk::ScopedAStatus::fromExceptionCode(FAILURE(IGnss::ERROR_INVALID_ARGUMENT));
     }
 
-    if (!mGnssHwConn) {
-        auto conn = std::make_unique<GnssHwConn>(*this);
-        if (!conn->ok()) {
+    // Opened without mMtx, the connection calls back into `this`. If another
+    // `start` was faster, this one is closed after `lock` is released.
+    std::unique_ptr<GnssHwConn> gnssHwConn;
+    if (needGnssHwConn) {
+        gnssHwConn = std::make_unique<GnssHwConn>(*this);
+        if (!gnssHwConn->ok()) {
             return ndk::ScopedAStatus::fromExceptionCode(FAILURE(IGnss::ERROR_GENERIC));
         }
+    }
 
-        std::lock_guard<std::mutex> lock(mMtx);
+    std::lock_guard<std::mutex> lock(mMtx);
+    if (mCallback != callback) {  // `close` or `setCallback` came meanwhile
+        return ndk::ScopedAStatus::fromExceptionCode(FAILURE(IGnss::ERROR_GENERIC));
+    }
+    if (gnssHwConn && !mGnssHwConn) {
+        mGnssHwConn = std::move(gnssHwConn);
+    }
+
+    if (!isSessionActiveLocked()) {
+        callback->gnssStatusCb(IGnssCallback::GnssStatusValue::ENGINE_ON);
         mSessionState = SessionState::STARTING;
         mStartT = std::chrono::steady_clock::now();
-        mGnssHwConn = std::move(conn);
+        mTimeToFirstFix = mAidingStore.getTimeToFirstFix();
+        mHaveFix = false;
+        updateEnergyModelLocked();
     }
 
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Gnss::stop() {
-    if (!mGnssHwConn) {
+    std::lock_guard<std::mutex> lock(mMtx);
+    if (!mGnssHwConn || !mCallback) {
         return ndk::ScopedAStatus::fromExceptionCode(FAILURE(IGnss::ERROR_INVALID_ARGUMENT));
     }
 
-    {
-        std::lock_guard<std::mutex> lock(mMtx);
-        if (mCallback) {
-            if (mSessionState == SessionState::STARTED) {
-                mCallback->gnssStatusCb(IGnssCallback::GnssStatusValue::SESSION_END);
-                mSessionState = SessionState::STOPPED;
-            }
-        } else {
-            return ndk::ScopedAStatus::fromExceptionCode(FAILURE(IGnss::ERROR_INVALID_ARGUMENT));
-        }
+    if (mSessionState == SessionState::STARTED) {
+        mCallback->gnssStatusCb(IGnssCallback::GnssStatusValue::SESSION_END);
+    }
+    if (isSessionActiveLocked()) {
+        // mGnssHwConn stays open, the next `start` does not reopen the pipe
+        mCallback->gnssStatusCb(IGnssCallback::GnssStatusValue::ENGINE_OFF);
+        mSessionState = SessionState::STOPPED;
+        updateEnergyModelLocked();
+        mAidingStore.save();
     }
-
-    mGnssHwConn.reset();
 
     return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Gnss::injectTime(int64_t /*timeMs*/,
-                                    int64_t /*timeReferenceMs*/,
-                                    int /*uncertaintyMs*/) {
+ndk::ScopedAStatus Gnss::injectTime(const int64_t timeMs,
+                                    const int64_t timeReferenceMs,
+                                    const int uncertaintyMs) {
+    mAidingStore.injectTime(timeMs, timeReferenceMs, uncertaintyMs);
     return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Gnss::injectLocation(const GnssLocation& /*location*/) {
+ndk::ScopedAStatus Gnss::injectLocation(const GnssLocation& location) {
+    mAidingStore.injectLocation(location);
     return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Gnss::injectBestLocation(const GnssLocation& /*location*/) {
+ndk::ScopedAStatus Gnss::injectBestLocation(const GnssLocation& location) {
+    mAidingStore.injectLocation(location);
     return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Gnss::deleteAidingData(const GnssAidingData /*aidingDataFlags*/) {
+ndk::ScopedAStatus Gnss::deleteAidingData(const GnssAidingData aidingDataFlags) {
+    mAidingStore.deleteAidingData(aidingDataFlags);
     return ndk::ScopedAStatus::ok();
 }
 
@@ -212,6 +251,7 @@ ndk::ScopedAStatus Gnss::setPositionMode(const PositionModeOptions& options) {
     mFirstFix = Clock::now();
     mLastFix = mFirstFix - mMinInterval;
     mLowPowerMode = options.lowPowerMode;
+    updateEnergyModelLocked();
 
     return ndk::ScopedAStatus::ok();
 }
@@ -243,12 +283,14 @@ ndk::ScopedAStatus Gnss::stopSvStatus() {
 ndk::ScopedAStatus Gnss::startNmea() {
     std::lock_guard<std::mutex> lock(mMtx);
     mSendNmea = true;
+    updateEnergyModelLocked();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Gnss::stopNmea() {
     std::lock_guard<std::mutex> lock(mMtx);
     mSendNmea = false;
+    updateEnergyModelLocked();
     return ndk::ScopedAStatus::ok();
 }
 
@@ -269,6 +311,7 @@ void Gnss::onGnssSvStatusCb(std::vector<IGnssCallback::GnssSvInfo> svInfo) {
     case SessionState::STARTING:
         mCallback->gnssStatusCb(IGnssCallback::GnssStatusValue::SESSION_BEGIN);
         mSessionState = SessionState::STARTED;
+        updateEnergyModelLocked();
         break;
 
     case SessionState::STARTED:
@@ -295,6 +338,7 @@ void Gnss::onGnssNmeaCb(const int64_t timestampMs, std::string nmea) {
     case SessionState::STARTING:
         mCallback->gnssStatusCb(IGnssCallback::GnssStatusValue::SESSION_BEGIN);
         mSessionState = SessionState::STARTED;
+        updateEnergyModelLocked();
         break;
 
     case SessionState::STARTED:
@@ -327,6 +371,7 @@ void Gnss::onGnssLocationCb(GnssLocation location) {
         ALOGD("%s:%s:%d", "Gnss", __func__, __LINE__);
         mCallback->gnssStatusCb(IGnssCallback::GnssStatusValue::SESSION_BEGIN);
         mSessionState = SessionState::STARTED;
+        updateEnergyModelLocked();
         break;
 
     case SessionState::STARTED:
@@ -342,28 +387,87 @@ void Gnss::onGnssLocationCb(GnssLocation location) {
         return;
     } else if (mRecurrence > 0) {
         --mRecurrence;
+        updateEnergyModelLocked();
+    }
+
+    if (!mHaveFix) {
+        mHaveFix = true;
+        updateEnergyModelLocked();
     }
 
     mLastFix = now;
+    mAidingStore.onGnssLocationCb(location);
     mCallback->gnssLocationCb(location);
     mGnssBatching->onGnssLocationCb(std::move(location));
 }
 
-double Gnss::getRunningTime() const {
+// With long intervals between fixes only the sentences right before the next
+// fix are parsed, the rest is dropped as it comes from the pipe. NMEA
+// listeners get every sentence.
+bool Gnss::isDataNeeded(const Clock::time_point now) {
     std::lock_guard<std::mutex> lock(mMtx);
-    return getRunningTimeLocked(Clock::now());
+    if (!mCallback || !isSessionActiveLocked()) {
+        return false;
+    }
+
+    if (mSendNmea) {
+        return true;
+    }
+
+    if (mRecurrence == 0) {
+        return false;  // the single fix was sent
+    }
+
+    return isWarmedUpLocked(now + kFixLeadTime) &&
+           ((now + kFixLeadTime) >= std::max(mFirstFix, mLastFix + mMinInterval));
 }
 
-double Gnss::getRunningTimeLocked(const Clock::time_point now) const {
-    if (mStartT.has_value()) {
-        return std::chrono::duration<double>(now - mStartT.value()).count();
+// Feeds what the HAL does to the energy model: no fix yet means the
+// receiver searches for satellites (the coarse fix from the aiding data does
+// not count), after the first fix it tracks them and with long intervals it
+// only wakes up to produce the next fix.
+void Gnss::updateEnergyModelLocked() {
+    using EngineMode = GnssEnergyModel::EngineMode;
+
+    EngineMode mode;
+    switch (mSessionState) {
+    case SessionState::STARTING:
+        mode = EngineMode::ACQUISITION;
+        break;
+
+    case SessionState::STARTED:
+        if (mRecurrence == 0) {
+            mode = EngineMode::OFF;
+        } else {
+            mode = mHaveFix ? EngineMode::TRACKING : EngineMode::ACQUISITION;
+        }
+        break;
+
+    default:
+        mode = EngineMode::OFF;
+        break;
+    }
+
+    double dutyCycle;
+    if (mSendNmea || (mMinInterval <= kFixActiveTime)) {
+        dutyCycle = 1.0;
     } else {
-        return 0.0;
+        dutyCycle = std::chrono::duration<double>(kFixActiveTime) /
+                    std::chrono::duration<double>(mMinInterval);
     }
+
+    // The low power mode allows to turn off the L5 band
+    mEnergyModel->setEngineState(mode, !mLowPowerMode, dutyCycle);
 }
 
+// The time to first fix depends on the aiding data at `start`
 bool Gnss::isWarmedUpLocked(const Clock::time_point now) const {
-    return getRunningTimeLocked(now) >= 3.5;   // CTS requires warming up time
+    return mStartT.has_value() && ((now - mStartT.value()) >= mTimeToFirstFix);
+}
+
+bool Gnss::isSessionActiveLocked() const {
+    return (mSessionState == SessionState::STARTING) ||
+           (mSessionState == SessionState::STARTED);
 }
 
 }  // namespace implementation
@@ -19,8 +19,10 @@
 #include <memory>
 #include <mutex>
 #include <aidl/android/hardware/gnss/BnGnss.h>
+#include "GnssAidingStore.h"
 #include "GnssBatching.h"
 #include "GnssConfiguration.h"
+#include "GnssEnergyModel.h"
 #include "GnssHwConn.h"
 #include "IDataSink.h"
 
@@ -84,6 +86,7 @@ struct Gnss : public BnGnss, public IDataSink {
     void onGnssSvStatusCb(std::vector<IGnssCallback::GnssSvInfo>) override;
     void onGnssNmeaCb(int64_t timestampMs, std::string nmea) override;
     void onGnssLocationCb(GnssLocation location) override;
+    bool isDataNeeded(std::chrono::steady_clock::time_point now) override;
 
 private:
     enum class SessionState {
@@ -92,17 +95,21 @@ private:
 
     using Clock = std::chrono::steady_clock;
 
-    double getRunningTime() const;
-    double getRunningTimeLocked(Clock::time_point now) const;
+    void updateEnergyModelLocked();
     bool isWarmedUpLocked(Clock::time_point now) const;
+    bool isSessionActiveLocked() const;
 
+    const std::shared_ptr<GnssEnergyModel> mEnergyModel;
     const std::shared_ptr<GnssBatching> mGnssBatching;
     const std::shared_ptr<GnssConfiguration> mGnssConfiguration;
+    GnssAidingStore mAidingStore;
 
     std::shared_ptr<IGnssCallback> mCallback;        // protected by mMtx
     std::optional<Clock::time_point> mStartT;        // protected by mMtx
+    Clock::duration mTimeToFirstFix{};               // protected by mMtx
+    bool mHaveFix = false;                           // protected by mMtx
     int mRecurrence = -1;                            // protected by mMtx
-    Clock::duration mMinInterval;                    // protected by mMtx
+    Clock::duration mMinInterval{};                  // protected by mMtx
     Clock::time_point mFirstFix;                     // protected by mMtx
     Clock::time_point mLastFix;                      // protected by mMtx
     SessionState mSessionState = SessionState::OFF;  // protected by mMtx
@@ -111,6 +118,8 @@ private:
     bool mSendNmea = false;                          // protected by mMtx
     mutable std::mutex mMtx;
 
+    // stays open between sessions, see `isDataNeeded`; protected by mMtx,
+    // but created and destroyed without holding it
     std::unique_ptr<GnssHwConn> mGnssHwConn;
 };
 
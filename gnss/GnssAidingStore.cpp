@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include "GnssAidingStore.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace implementation {
+namespace {
+using namespace std::chrono_literals;
+
+// Broadcast ephemeris is good for about four hours, receivers stop using it
+// for hot starts well before that.
+constexpr int64_t kEphemerisValidityMs = std::chrono::milliseconds(2h).count();
+constexpr int64_t kAlmanacValidityMs = std::chrono::milliseconds(24h * 30).count();
+
+// Time worse than this does not help to find satellites
+constexpr int kMaxTimeUncertaintyMs = 10000;
+
+// Assumed for an injected position that comes without an accuracy
+constexpr double kMaxCoarseAccuracyMeters = 50000.0;
+
+// Fixes come once a second, they are written to the file less often
+constexpr int64_t kSaveIntervalMs = std::chrono::milliseconds(1min).count();
+
+// A cold start takes no longer than the former fixed warm-up, CTS waits for
+// the first fix with it. This is much shorter than a real receiver, the
+// vendor.qemu.gnss.ttff_{hot,warm,cold}_ms properties can raise it.
+constexpr std::chrono::milliseconds kHotTtff(1000);
+constexpr std::chrono::milliseconds kWarmTtff(2000);
+constexpr std::chrono::milliseconds kColdTtff(3500);
+
+int64_t getUtcMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::chrono::milliseconds getTtffProperty(const char* name,
+                                          const std::chrono::milliseconds defaultValue) {
+    using ::android::base::GetIntProperty;
+
+    int64_t value = GetIntProperty(std::string("vendor.qemu.gnss.") + name, int64_t(-1));
+    if (value < 0) {
+        value = GetIntProperty(std::string("ro.boot.qemu.gnss.") + name, int64_t(-1));
+    }
+
+    return (value < 0) ? defaultValue : std::chrono::milliseconds(value);
+}
+
+bool hasFlag(const IGnss::GnssAidingData flags, const IGnss::GnssAidingData flag) {
+    return (static_cast<int>(flags) & static_cast<int>(flag)) != 0;
+}
+
+bool isFresh(const std::optional<int64_t>& utcMs, const int64_t nowUtcMs,
+             const int64_t validityMs) {
+    return utcMs.has_value() && (nowUtcMs >= utcMs.value()) &&
+           ((nowUtcMs - utcMs.value()) < validityMs);
+}
+}  // namespace
+
+GnssAidingStore::GnssAidingStore(std::string path) : mPath(std::move(path)) {
+    std::lock_guard<std::mutex> lock(mMtx);
+    loadLocked();
+}
+
+void GnssAidingStore::injectTime(const int64_t timeMs, const int64_t timeReferenceMs,
+                                 const int uncertaintyMs) {
+    if ((uncertaintyMs < 0) || (uncertaintyMs > kMaxTimeUncertaintyMs)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mMtx);
+    mTimeUtcMs = timeMs + (::android::elapsedRealtime() - timeReferenceMs);
+    saveLocked();
+}
+
+void GnssAidingStore::injectLocation(const GnssLocation& location) {
+    if (!(location.gnssLocationFlags & GnssLocation::HAS_LAT_LONG)) {
+        return;
+    }
+
+    const double accuracy = (location.gnssLocationFlags & GnssLocation::HAS_HORIZONTAL_ACCURACY) ?
+        location.horizontalAccuracyMeters : kMaxCoarseAccuracyMeters;
+
+    std::lock_guard<std::mutex> lock(mMtx);
+    mPosition = {
+        .latitudeDegrees = location.latitudeDegrees,
+        .longitudeDegrees = location.longitudeDegrees,
+        .horizontalAccuracyMeters = accuracy,
+        .utcMs = getUtcMs(),
+    };
+    saveLocked();
+}
+
+void GnssAidingStore::deleteAidingData(const IGnss::GnssAidingData flags) {
+    std::lock_guard<std::mutex> lock(mMtx);
+    if (hasFlag(flags, IGnss::GnssAidingData::EPHEMERIS)) {
+        mEphemerisUtcMs.reset();
+    }
+    if (hasFlag(flags, IGnss::GnssAidingData::ALMANAC)) {
+        mAlmanacUtcMs.reset();
+    }
+    if (hasFlag(flags, IGnss::GnssAidingData::POSITION)) {
+        mPosition.reset();
+    }
+    if (hasFlag(flags, IGnss::GnssAidingData::TIME)) {
+        mTimeUtcMs.reset();
+    }
+    saveLocked();
+}
+
+// A fix means the receiver has decoded the navigation message of the
+// satellites it tracks.
+void GnssAidingStore::onGnssLocationCb(const GnssLocation& location) {
+    const int64_t nowUtcMs = getUtcMs();
+
+    std::lock_guard<std::mutex> lock(mMtx);
+    mTimeUtcMs = nowUtcMs;
+    mEphemerisUtcMs = nowUtcMs;
+    mAlmanacUtcMs = nowUtcMs;
+    if (location.gnssLocationFlags & GnssLocation::HAS_LAT_LONG) {
+        mPosition = {
+            .latitudeDegrees = location.latitudeDegrees,
+            .longitudeDegrees = location.longitudeDegrees,
+            .horizontalAccuracyMeters =
+                (location.gnssLocationFlags & GnssLocation::HAS_HORIZONTAL_ACCURACY) ?
+                    location.horizontalAccuracyMeters : 0.0,
+            .utcMs = nowUtcMs,
+        };
+    }
+
+    if ((nowUtcMs - mLastSaveUtcMs) >= kSaveIntervalMs) {
+        saveLocked();
+    }
+}
+
+void GnssAidingStore::save() {
+    std::lock_guard<std::mutex> lock(mMtx);
+    saveLocked();
+}
+
+GnssAidingStore::StartType GnssAidingStore::getStartType() const {
+    std::lock_guard<std::mutex> lock(mMtx);
+    return getStartTypeLocked(getUtcMs());
+}
+
+std::chrono::milliseconds GnssAidingStore::getTimeToFirstFix() const {
+    switch (getStartType()) {
+    case StartType::HOT:
+        return getTtffProperty("ttff_hot_ms", kHotTtff);
+
+    case StartType::WARM:
+        return getTtffProperty("ttff_warm_ms", kWarmTtff);
+
+    default:
+        return getTtffProperty("ttff_cold_ms", kColdTtff);
+    }
+}
+
+GnssAidingStore::StartType GnssAidingStore::getStartTypeLocked(const int64_t nowUtcMs) const {
+    if (!mTimeUtcMs.has_value()) {
+        return StartType::COLD;
+    } else if (mPosition.has_value() &&
+               isFresh(mEphemerisUtcMs, nowUtcMs, kEphemerisValidityMs)) {
+        return StartType::HOT;
+    } else if (mPosition.has_value() ||
+               isFresh(mAlmanacUtcMs, nowUtcMs, kAlmanacValidityMs)) {
+        return StartType::WARM;
+    } else {
+        return StartType::COLD;
+    }
+}
+
+// One item per line: "time <utcMs>", "ephemeris <utcMs>", "almanac <utcMs>"
+// or "position <lat> <lon> <accuracy> <utcMs>".
+void GnssAidingStore::loadLocked() {
+    std::string content;
+    if (!::android::base::ReadFileToString(mPath, &content)) {
+        return;  // nothing was saved yet
+    }
+
+    for (const std::string& line : ::android::base::Split(content, "\n")) {
+        int64_t utcMs;
+        Position position;
+
+        if (sscanf(line.c_str(), "time %" SCNd64, &utcMs) == 1) {
+            mTimeUtcMs = utcMs;
+        } else if (sscanf(line.c_str(), "ephemeris %" SCNd64, &utcMs) == 1) {
+            mEphemerisUtcMs = utcMs;
+        } else if (sscanf(line.c_str(), "almanac %" SCNd64, &utcMs) == 1) {
+            mAlmanacUtcMs = utcMs;
+        } else if (sscanf(line.c_str(), "position %lf %lf %lf %" SCNd64,
+                          &position.latitudeDegrees, &position.longitudeDegrees,
+                          &position.horizontalAccuracyMeters, &position.utcMs) == 4) {
+            mPosition = position;
+        } else if (!line.empty()) {
+            ALOGW("%s:%d: unexpected line in '%s': '%s'",
+                  __func__, __LINE__, mPath.c_str(), line.c_str());
+        }
+    }
+}
+
+void GnssAidingStore::saveLocked() {
+    using ::android::base::StringPrintf;
+
+    std::string content;
+    if (mTimeUtcMs.has_value()) {
+        content += StringPrintf("time %" PRId64 "\n", mTimeUtcMs.value());
+    }
+    if (mEphemerisUtcMs.has_value()) {
+        content += StringPrintf("ephemeris %" PRId64 "\n", mEphemerisUtcMs.value());
+    }
+    if (mAlmanacUtcMs.has_value()) {
+        content += StringPrintf("almanac %" PRId64 "\n", mAlmanacUtcMs.value());
+    }
+    if (mPosition.has_value()) {
+        const Position& p = mPosition.value();
+        content += StringPrintf("position %.7f %.7f %.1f %" PRId64 "\n",
+                                p.latitudeDegrees, p.longitudeDegrees,
+                                p.horizontalAccuracyMeters, p.utcMs);
+    }
+
+    // The file is replaced at once, the HAL could be killed while writing
+    const std::string tmpPath = mPath + ".tmp";
+    if (!::android::base::WriteStringToFile(content, tmpPath) ||
+            (rename(tmpPath.c_str(), mPath.c_str()) != 0)) {
+        ALOGW("%s:%d: could not write '%s'", __func__, __LINE__, mPath.c_str());
+        return;
+    }
+
+    mLastSaveUtcMs = getUtcMs();
+}
+
+}  // namespace implementation
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
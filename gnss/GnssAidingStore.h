@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <aidl/android/hardware/gnss/GnssLocation.h>
+#include <aidl/android/hardware/gnss/IGnss.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace implementation {
+
+// Keeps what a receiver knows between sessions (time, position, ephemeris
+// and almanac age) in a file to survive HAL restarts. What is known decides
+// how fast the next session gets its first fix.
+struct GnssAidingStore {
+    enum class StartType {
+        HOT, WARM, COLD
+    };
+
+    explicit GnssAidingStore(std::string path);
+
+    void injectTime(int64_t timeMs, int64_t timeReferenceMs, int uncertaintyMs);
+    void injectLocation(const GnssLocation& location);
+    void deleteAidingData(IGnss::GnssAidingData flags);
+    void onGnssLocationCb(const GnssLocation& location);
+    void save();
+
+    StartType getStartType() const;
+    std::chrono::milliseconds getTimeToFirstFix() const;
+
+private:
+    struct Position {
+        double latitudeDegrees;
+        double longitudeDegrees;
+        double horizontalAccuracyMeters;
+        int64_t utcMs;
+    };
+
+    StartType getStartTypeLocked(int64_t nowUtcMs) const;
+    void loadLocked();
+    void saveLocked();
+
+    const std::string mPath;
+    std::optional<int64_t> mTimeUtcMs;        // protected by mMtx
+    std::optional<Position> mPosition;        // protected by mMtx
+    std::optional<int64_t> mEphemerisUtcMs;   // protected by mMtx
+    std::optional<int64_t> mAlmanacUtcMs;     // protected by mMtx
+    int64_t mLastSaveUtcMs = 0;               // protected by mMtx
+    mutable std::mutex mMtx;
+};
+
+}  // namespace implementation
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -31,6 +31,9 @@ using Clock = std::chrono::steady_clock;
 constexpr size_t kBatchSize = 4;
 }  // namsepace
 
+GnssBatching::GnssBatching(std::shared_ptr<GnssEnergyModel> energyModel)
+        : mEnergyModel(std::move(energyModel)) {}
+
 GnssBatching::~GnssBatching() {
     stopImpl();
 }
@@ -66,6 +69,7 @@ ndk::ScopedAStatus GnssBatching::start(const Options& options) {
 
     std::lock_guard<std::mutex> lock(mMtx);
     mRunning = true;
+    mEnergyModel->setBatchingActive(true);
     mThread = std::thread([this, interval, wakeUpOnFifoFull](){
         Clock::time_point wakeupT = Clock::now() + interval;
 
@@ -129,6 +133,7 @@ void GnssBatching::stopImpl() {
 
     if (needJoin) {
         mThread.join();
+        mEnergyModel->setBatchingActive(false);
     }
 }
 
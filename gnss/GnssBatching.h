@@ -20,6 +20,7 @@
 #include <mutex>
 #include <thread>
 #include <aidl/android/hardware/gnss/BnGnssBatching.h>
+#include "GnssEnergyModel.h"
 
 namespace aidl {
 namespace android {
@@ -28,6 +29,7 @@ namespace gnss {
 namespace implementation {
 
 struct GnssBatching : public BnGnssBatching {
+    GnssBatching(std::shared_ptr<GnssEnergyModel> energyModel);
     ~GnssBatching();
 
     ndk::ScopedAStatus init(const std::shared_ptr<IGnssBatchingCallback>& callback) override;
@@ -44,6 +46,7 @@ private:
     void batchLocationLocked(GnssLocation location, bool wakeUpOnFifoFull);
     bool flushLocked();
 
+    const std::shared_ptr<GnssEnergyModel> mEnergyModel;
     std::shared_ptr<IGnssBatchingCallback> mCallback;
     std::deque<GnssLocation> mBatchedLocations;
     std::optional<GnssLocation> mLocation;
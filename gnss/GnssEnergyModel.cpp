@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <utils/SystemClock.h>
+
+#include "GnssEnergyModel.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace implementation {
+namespace {
+// Typical power draw of a smartphone GNSS chipset, in mW (mJ per second).
+// The second band (L5/E5a) costs another RF chain and more correlators.
+constexpr double kSinglebandAcquisitionMw = 30.0;
+constexpr double kMultibandAcquisitionMw = 45.0;
+constexpr double kSinglebandTrackingMw = 12.0;
+constexpr double kMultibandTrackingMw = 20.0;
+// Raw measurements keep the baseband busy and the AP reading them
+constexpr double kMeasurementsMw = 4.0;
+// Locations are batched by the chip while the AP sleeps
+constexpr double kBatchingMw = 1.5;
+}  // namespace
+
+void GnssEnergyModel::setEngineState(const EngineMode mode,
+                                     const bool multiband,
+                                     const double dutyCycle) {
+    std::lock_guard<std::mutex> lock(mMtx);
+    accumulateLocked(Clock::now());
+    mEngineMode = mode;
+    mMultiband = multiband;
+    mDutyCycle = std::clamp(dutyCycle, 0.0, 1.0);
+}
+
+void GnssEnergyModel::setMeasurementsActive(const bool active) {
+    std::lock_guard<std::mutex> lock(mMtx);
+    accumulateLocked(Clock::now());
+    mMeasurementsActive = active;
+}
+
+void GnssEnergyModel::setBatchingActive(const bool active) {
+    std::lock_guard<std::mutex> lock(mMtx);
+    accumulateLocked(Clock::now());
+    mBatchingActive = active;
+}
+
+GnssPowerStats GnssEnergyModel::getPowerStats() {
+    std::lock_guard<std::mutex> lock(mMtx);
+    accumulateLocked(Clock::now());
+
+    GnssPowerStats stats;
+    stats.elapsedRealtime = {
+            .flags = ElapsedRealtime::HAS_TIMESTAMP_NS |
+                     ElapsedRealtime::HAS_TIME_UNCERTAINTY_NS,
+            .timestampNs = ::android::elapsedRealtimeNano(),
+            .timeUncertaintyNs = 1000,
+    };
+    stats.singlebandTrackingModeEnergyMilliJoule = mSinglebandTrackingMj;
+    stats.multibandTrackingModeEnergyMilliJoule = mMultibandTrackingMj;
+    stats.singlebandAcquisitionModeEnergyMilliJoule = mSinglebandAcquisitionMj;
+    stats.multibandAcquisitionModeEnergyMilliJoule = mMultibandAcquisitionMj;
+    stats.otherModesEnergyMilliJoule = {mMeasurementsMj, mBatchingMj};
+    stats.totalEnergyMilliJoule = mSinglebandTrackingMj + mMultibandTrackingMj +
+                                  mSinglebandAcquisitionMj + mMultibandAcquisitionMj +
+                                  mMeasurementsMj + mBatchingMj;
+    return stats;
+}
+
+void GnssEnergyModel::accumulateLocked(const Clock::time_point now) {
+    const double dt = std::chrono::duration<double>(now - mLastUpdate).count();
+    mLastUpdate = now;
+    if (dt <= 0) {
+        return;
+    }
+
+    // Raw measurements need continuous tracking, there is no duty cycling
+    const double dutyCycle = mMeasurementsActive ? 1.0 : mDutyCycle;
+
+    switch (mEngineMode) {
+    case EngineMode::ACQUISITION:
+        if (mMultiband) {
+            mMultibandAcquisitionMj += kMultibandAcquisitionMw * dt;
+        } else {
+            mSinglebandAcquisitionMj += kSinglebandAcquisitionMw * dt;
+        }
+        break;
+
+    case EngineMode::TRACKING:
+        if (mMultiband) {
+            mMultibandTrackingMj += kMultibandTrackingMw * dutyCycle * dt;
+        } else {
+            mSinglebandTrackingMj += kSinglebandTrackingMw * dutyCycle * dt;
+        }
+        break;
+
+    case EngineMode::OFF:
+        break;
+    }
+
+    if (mMeasurementsActive && (mEngineMode != EngineMode::OFF)) {
+        mMeasurementsMj += kMeasurementsMw * dt;
+    }
+    if (mBatchingActive) {
+        mBatchingMj += kBatchingMw * dt;
+    }
+}
+
+}  // namespace implementation
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <aidl/android/hardware/gnss/GnssPowerStats.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace implementation {
+
+// Integrates the power a real receiver would draw doing what the HAL is doing
+// into per-mode energy counters. Every change of activity first accumulates
+// the energy spent in the previous one.
+struct GnssEnergyModel {
+    enum class EngineMode {
+        OFF, ACQUISITION, TRACKING
+    };
+
+    // `dutyCycle` is the fraction of the time the engine runs between fixes
+    void setEngineState(EngineMode mode, bool multiband, double dutyCycle);
+    void setMeasurementsActive(bool active);
+    void setBatchingActive(bool active);
+
+    GnssPowerStats getPowerStats();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void accumulateLocked(Clock::time_point now);
+
+    Clock::time_point mLastUpdate = Clock::now();            // protected by mMtx
+    EngineMode mEngineMode = EngineMode::OFF;                // protected by mMtx
+    bool mMultiband = false;                                 // protected by mMtx
+    double mDutyCycle = 1.0;                                 // protected by mMtx
+    bool mMeasurementsActive = false;                        // protected by mMtx
+    bool mBatchingActive = false;                            // protected by mMtx
+
+    double mSinglebandTrackingMj = 0;                        // protected by mMtx
+    double mMultibandTrackingMj = 0;                         // protected by mMtx
+    double mSinglebandAcquisitionMj = 0;                     // protected by mMtx
+    double mMultibandAcquisitionMj = 0;                      // protected by mMtx
+    double mMeasurementsMj = 0;                              // protected by mMtx
+    double mBatchingMj = 0;                                  // protected by mMtx
+    mutable std::mutex mMtx;
+};
+
+}  // namespace implementation
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -137,9 +137,9 @@ void workerThread(const int devFd, const int threadsFd, GnssHwListener& listener
 }  // namespace
 
 GnssHwConn::GnssHwConn(IDataSink& sink) {
-    mDevFd.reset(qemu_pipe_open_ns("qemud", "gps", O_RDWR));
+    mDevFd.reset(qemud_pipe_open_ns("qemud", "gps", O_RDWR));
     if (!mDevFd.ok()) {
-        ALOGE("%s:%d: qemu_pipe_open_ns failed", __func__, __LINE__);
+        ALOGE("%s:%d: qemud_pipe_open_ns failed", __func__, __LINE__);
         return;
     }
 
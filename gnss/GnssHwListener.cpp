@@ -76,14 +76,14 @@ ElapsedRealtime makeElapsedRealtime(const int64_t timestampNs) {
 
 GnssHwListener::GnssHwListener(IDataSink& sink): mSink(sink) {
     mBuffer.reserve(256);
-    mSink.onGnssStatusCb(IGnssCallback::GnssStatusValue::ENGINE_ON);
-}
-
-GnssHwListener::~GnssHwListener() {
-    mSink.onGnssStatusCb(IGnssCallback::GnssStatusValue::ENGINE_OFF);
 }
 
 void GnssHwListener::consume(const char* buf, size_t sz) {
+    if (!mSink.isDataNeeded(std::chrono::steady_clock::now())) {
+        mBuffer.clear();  // the next sentence will start from '$'
+        return;
+    }
+
     ALOGD("%s:%s:%d sz=%zu", "GnssHwListener", __func__, __LINE__, sz);
 
     for (; sz > 0; ++buf, --sz) {
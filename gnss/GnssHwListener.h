@@ -32,7 +32,6 @@ namespace implementation {
 class GnssHwListener {
 public:
     explicit GnssHwListener(IDataSink& sink);
-    ~GnssHwListener();
 
     void consume(const char* buf, size_t sz);
 
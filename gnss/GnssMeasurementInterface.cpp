@@ -99,6 +99,9 @@ GnssMeasurement makeGnssMeasurement(const bool enableCorrVecOutputs,
 
 }  // namsepace
 
+GnssMeasurementInterface::GnssMeasurementInterface(std::shared_ptr<GnssEnergyModel> energyModel)
+        : mEnergyModel(std::move(energyModel)) {}
+
 GnssMeasurementInterface::~GnssMeasurementInterface() {
     closeImpl();
 }
@@ -137,6 +140,7 @@ void GnssMeasurementInterface::closeImpl() {
 
     if (needJoin) {
         mThread.join();
+        mEnergyModel->setMeasurementsActive(false);
     }
 }
 
@@ -169,6 +173,7 @@ ndk::ScopedAStatus GnssMeasurementInterface::setCallbackImpl(
 
     std::lock_guard<std::mutex> lock(mMtx);
     mRunning = true;
+    mEnergyModel->setMeasurementsActive(true);
 
     mThread = std::thread([this, callback, interval](){
         Clock::time_point wakeupT = Clock::now() + interval;
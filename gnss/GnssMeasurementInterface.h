@@ -19,6 +19,7 @@
 #include <mutex>
 #include <thread>
 #include <aidl/android/hardware/gnss/BnGnssMeasurementInterface.h>
+#include "GnssEnergyModel.h"
 
 namespace aidl {
 namespace android {
@@ -27,7 +28,7 @@ namespace gnss {
 namespace implementation {
 
 struct GnssMeasurementInterface : public BnGnssMeasurementInterface {
-    GnssMeasurementInterface() = default;
+    GnssMeasurementInterface(std::shared_ptr<GnssEnergyModel> energyModel);
     ~GnssMeasurementInterface();
 
     ndk::ScopedAStatus setCallback(const std::shared_ptr<IGnssMeasurementCallback>& callback,
@@ -46,6 +47,7 @@ private:
     void stopLocked();
     void update();
 
+    const std::shared_ptr<GnssEnergyModel>    mEnergyModel;
     std::shared_ptr<IGnssMeasurementCallback> mCallback;
     std::vector<GnssData>                     mGnssData;
     int                                       mGnssDataIndex = 0;
@@ -14,7 +14,6 @@
  * limitations under the License.
  */
 
-#include <utils/SystemClock.h>
 #include <aidl/android/hardware/gnss/IGnss.h>
 
 #include "GnssPowerIndication.h"
@@ -26,8 +25,8 @@ namespace hardware {
 namespace gnss {
 namespace implementation {
 
-GnssPowerIndication::GnssPowerIndication(std::function<double()> getRunningTime)
-        : mGetRunningTime(std::move(getRunningTime)) {}
+GnssPowerIndication::GnssPowerIndication(std::shared_ptr<GnssEnergyModel> energyModel)
+        : mEnergyModel(std::move(energyModel)) {}
 
 ndk::ScopedAStatus GnssPowerIndication::setCallback(
         const std::shared_ptr<IGnssPowerIndicationCallback>& callback) {
@@ -53,28 +52,7 @@ ndk::ScopedAStatus GnssPowerIndication::requestGnssPowerStats() {
 
 ndk::ScopedAStatus GnssPowerIndication::doRequestGnssPowerStats(
         IGnssPowerIndicationCallback& cb) {
-    GnssPowerStats gnssPowerStats;
-
-    const double d = mGetRunningTime();
-
-    if (d > 0.0) {
-        ElapsedRealtime elapsedRealtime = {
-                .flags = ElapsedRealtime::HAS_TIMESTAMP_NS |
-                         ElapsedRealtime::HAS_TIME_UNCERTAINTY_NS,
-                .timestampNs = ::android::elapsedRealtimeNano(),
-                .timeUncertaintyNs = 1000,
-        };
-
-        gnssPowerStats.elapsedRealtime = elapsedRealtime;
-        gnssPowerStats.totalEnergyMilliJoule = 1.500e+3 + d * 22.0;
-        gnssPowerStats.singlebandTrackingModeEnergyMilliJoule = 0.0;
-        gnssPowerStats.multibandTrackingModeEnergyMilliJoule = 1.28e+2 + d * 4.0;
-        gnssPowerStats.singlebandAcquisitionModeEnergyMilliJoule = 0.0;
-        gnssPowerStats.multibandAcquisitionModeEnergyMilliJoule = 3.65e+2 + d * 15.0;
-        gnssPowerStats.otherModesEnergyMilliJoule = {1.232e+2, 3.234e+3};
-    }
-
-    cb.gnssPowerStatsCb(gnssPowerStats);
+    cb.gnssPowerStatsCb(mEnergyModel->getPowerStats());
 
     return ndk::ScopedAStatus::ok();
 }
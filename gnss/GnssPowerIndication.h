@@ -15,8 +15,8 @@
  */
 
 #pragma once
-#include <functional>
 #include <aidl/android/hardware/gnss/BnGnssPowerIndication.h>
+#include "GnssEnergyModel.h"
 
 namespace aidl {
 namespace android {
@@ -25,7 +25,7 @@ namespace gnss {
 namespace implementation {
 
 struct GnssPowerIndication : public BnGnssPowerIndication {
-    GnssPowerIndication(std::function<double()> getRunningTime);
+    GnssPowerIndication(std::shared_ptr<GnssEnergyModel> energyModel);
 
     ndk::ScopedAStatus setCallback(
             const std::shared_ptr<IGnssPowerIndicationCallback>& callback) override;
@@ -34,7 +34,7 @@ struct GnssPowerIndication : public BnGnssPowerIndication {
 private:
     ndk::ScopedAStatus doRequestGnssPowerStats(IGnssPowerIndicationCallback&);
 
-    const std::function<double()> mGetRunningTime;
+    const std::shared_ptr<GnssEnergyModel> mEnergyModel;
     std::shared_ptr<IGnssPowerIndicationCallback> mCb;
 };
 
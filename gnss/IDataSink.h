@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -35,6 +36,10 @@ struct IDataSink {
     virtual void onGnssSvStatusCb(std::vector<IGnssCallback::GnssSvInfo>) = 0;
     virtual void onGnssNmeaCb(int64_t timestampMs, std::string nmea) = 0;
     virtual void onGnssLocationCb(GnssLocation location) = 0;
+
+    // The host's data is dropped without parsing while this returns false,
+    // e.g. between sessions or between fixes far apart.
+    virtual bool isDataNeeded(std::chrono::steady_clock::time_point now) = 0;
 };
 
 }  // namespace implementation
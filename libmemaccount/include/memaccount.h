@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace memaccount {
+
+// Bytes held by one kind of buffers (`tag`, e.g. "camera.jpeg_staging") in
+// this process. Counters are meant to be static objects, they are listed by
+// `dump` from their construction on.
+//
+// The `vendor.qemu.mem_budget.<tag>` property (read once, at construction)
+// sets a soft budget in bytes: caches and pools charged to a counter over
+// its budget release what they keep instead of holding it for later.
+struct Counter {
+    explicit Counter(const char* tag);
+
+    void add(size_t size);
+    void sub(size_t size);
+    bool isOverBudget() const;
+
+    const char* const tag;
+    const int64_t budget;   // 0 if there is none
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> peakBytes{0};
+    std::atomic<int64_t> allocations{0};
+    Counter* next = nullptr;
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+};
+
+// Charges `Counter` for as long as it lives, `set` replaces the amount
+// (e.g. with a vector's capacity after it grew).
+struct Charge {
+    explicit Charge(Counter& counter, size_t size = 0);
+    Charge(Charge&& rhs) noexcept;
+    ~Charge();
+
+    Charge& operator=(Charge&& rhs) noexcept;
+    void set(size_t size);
+    size_t get() const { return mSize; }
+    bool isOverBudget() const { return mCounter->isOverBudget(); }
+
+private:
+    Counter* mCounter;
+    size_t mSize;
+
+    Charge(const Charge&) = delete;
+    Charge& operator=(const Charge&) = delete;
+};
+
+// Prints every counter in the process, e.g. from `dump` or `debug`.
+void dump(int fd);
+
+}  // namespace memaccount
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/system_properties.h>
+#include <string>
+#include <utility>
+#include <memaccount.h>
+
+namespace memaccount {
+namespace {
+std::atomic<Counter*>& getCounters() {
+    static std::atomic<Counter*> head = nullptr;
+    return head;
+}
+
+int64_t getBudget(const char* tag) {
+    const std::string name = std::string("vendor.qemu.mem_budget.") + tag;
+    char value[PROP_VALUE_MAX];
+    if (__system_property_get(name.c_str(), value) > 0) {
+        const long long budget = strtoll(value, nullptr, 10);
+        return (budget > 0) ? budget : 0;
+    } else {
+        return 0;
+    }
+}
+}  // namespace
+
+Counter::Counter(const char* tag) : tag(tag), budget(getBudget(tag)) {
+    std::atomic<Counter*>& head = getCounters();
+    next = head.load();
+    while (!head.compare_exchange_weak(next, this)) {}
+}
+
+void Counter::add(const size_t size) {
+    const int64_t now = (bytes += size);
+    ++allocations;
+
+    int64_t peak = peakBytes.load();
+    while ((now > peak) && !peakBytes.compare_exchange_weak(peak, now)) {}
+}
+
+void Counter::sub(const size_t size) {
+    bytes -= size;
+    --allocations;
+}
+
+bool Counter::isOverBudget() const {
+    return budget && (bytes.load() > budget);
+}
+
+Charge::Charge(Counter& counter, const size_t size) : mCounter(&counter), mSize(size) {
+    if (size) {
+        counter.add(size);
+    }
+}
+
+Charge::Charge(Charge&& rhs) noexcept
+        : mCounter(rhs.mCounter)
+        , mSize(std::exchange(rhs.mSize, 0)) {}
+
+Charge::~Charge() {
+    set(0);
+}
+
+Charge& Charge::operator=(Charge&& rhs) noexcept {
+    if (this != &rhs) {
+        set(0);
+        mCounter = rhs.mCounter;
+        mSize = std::exchange(rhs.mSize, 0);
+    }
+    return *this;
+}
+
+void Charge::set(const size_t size) {
+    if (size != mSize) {
+        if (mSize) {
+            mCounter->sub(mSize);
+        }
+        if (size) {
+            mCounter->add(size);
+        }
+        mSize = size;
+    }
+}
+
+void dump(const int fd) {
+    int64_t total = 0;
+
+    dprintf(fd, "%-28s %12s %12s %8s %12s\n", "memory", "bytes", "peak", "charges", "budget");
+    for (const Counter* c = getCounters().load(); c; c = c->next) {
+        const int64_t bytes = c->bytes.load();
+        dprintf(fd, "%-28s %12" PRId64 " %12" PRId64 " %8" PRId64 " %12" PRId64 "%s\n",
+                c->tag, bytes, c->peakBytes.load(), c->allocations.load(), c->budget,
+                c->isOverBudget() ? " over" : "");
+        total += bytes;
+    }
+    dprintf(fd, "%-28s %12" PRId64 "\n", "total", total);
+}
+
+}  // namespace memaccount
@@ -181,7 +181,7 @@ void sendHeartBeat() {
 
 void sendMessage(const char* mesg) {
    if (s_QemuMiscPipe < 0) {
-        s_QemuMiscPipe = qemu_pipe_open_ns(NULL, kHeartbeatService, O_RDWR);
+        s_QemuMiscPipe = qemud_pipe_open_ns(NULL, kHeartbeatService, O_RDWR);
         if (s_QemuMiscPipe < 0) {
             ALOGE("failed to open %s", kHeartbeatService);
             return;
@@ -15,14 +15,48 @@
  */
 
 #pragma once
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Same as qemu_pipe_open_ns, but connects to the unix socket named by the
+// QEMU_PIPE_STANDIN_SOCKET environment variable if it is set. This allows to
+// run HALs against a stand-in for the emulator's host services off-device,
+// nothing on the device sets the variable.
+int qemud_pipe_open_ns(const char* ns, const char* name, int flags);
+
 int qemud_channel_open(const char* name);
 int qemud_channel_send(int pipe, const void* msg, int size);
 int qemud_channel_recv(int pipe, void* msg, int maxsize);
 
+// Memory shared with the other end of a pipe to move bulk data (e.g. camera
+// frames) without copying it through the pipe. The pipe stays the control
+// channel: requests and replies on it are the doorbells telling which part
+// of the memory to fill or to read.
+struct qemud_shm {
+    void* addr;
+    size_t size;
+    size_t head;    // see qemud_shm_reserve
+};
+
+// Creates and maps `size` bytes of shared memory (memfd) and sends its file
+// descriptor over `pipe` along with `msg` (`msgsize` bytes written as is,
+// the framing is up to the caller). File descriptors can be passed only
+// over unix sockets (see qemud_pipe_open_ns), this fails with EOPNOTSUPP
+// for goldfish pipes and the caller keeps transferring data through `pipe`.
+// Returns 0 on success, -1 and sets errno on failure.
+int qemud_shm_attach(int pipe, size_t size, const void* msg, int msgsize,
+                     struct qemud_shm* shm);
+
+// Returns the offset of `len` bytes following the ones reserved last,
+// wrapping around to the start of the memory if they do not fit (a ring).
+// Returns -1 if `len` is larger than the memory.
+long qemud_shm_reserve(struct qemud_shm* shm, size_t len);
+
+void qemud_shm_release(struct qemud_shm* shm);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
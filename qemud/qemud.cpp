@@ -18,15 +18,78 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <qemud.h>
 #include <qemu_pipe_bp.h>
 #include <unistd.h>
 
 #include <arpa/inet.h>
 
+static const char kStandinSocketEnv[] = "QEMU_PIPE_STANDIN_SOCKET";
+
+// The service name is sent the same way the goldfish pipe device expects
+// it: "pipe:<ns>:<name>" including the trailing NUL byte. O_CLOEXEC and
+// O_NONBLOCK in `flags` apply as they do to the pipe, the handshake itself
+// is written blocking.
+static int standin_pipe_open(const char* socketPath,
+                             const char* ns, const char* name, int flags) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    const int fd = socket(AF_UNIX,
+                          SOCK_STREAM | ((flags & O_CLOEXEC) ? SOCK_CLOEXEC : 0),
+                          0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    char buf[256];
+    const int len = ns ? snprintf(buf, sizeof(buf), "pipe:%s:%s", ns, name)
+                       : snprintf(buf, sizeof(buf), "pipe:%s", name);
+    if ((len < 0) || (len >= (int)sizeof(buf)) ||
+            qemu_pipe_write_fully(fd, buf, len + 1)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((flags & O_NONBLOCK) &&
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
+        const int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+
+    return fd;
+}
+
+int qemud_pipe_open_ns(const char* ns, const char* name, int flags) {
+    const char* socketPath = getenv(kStandinSocketEnv);
+    if (socketPath && *socketPath) {
+        return standin_pipe_open(socketPath, ns, name, flags);
+    } else {
+        return qemu_pipe_open_ns(ns, name, flags);
+    }
+}
+
 int qemud_channel_open(const char*  name) {
-    return qemu_pipe_open_ns("qemud", name, O_RDWR);
+    return qemud_pipe_open_ns("qemud", name, O_RDWR);
 }
 
 int qemud_channel_send(int pipe, const void* msg, int size) {
@@ -78,3 +141,102 @@ int qemud_channel_recv(int pipe, void* msg, int maxsize) {
 
     return size;
 }
+
+// The file descriptor goes with the first bytes of `msg`.
+static int send_with_fd(int pipe, const void* msg, int msgsize, int fd) {
+    union {
+        struct cmsghdr header;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov;
+    iov.iov_base = (void*)msg;
+    iov.iov_len = msgsize;
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t n;
+    do {
+        n = sendmsg(pipe, &mh, MSG_NOSIGNAL);
+    } while ((n < 0) && (errno == EINTR));
+    if (n <= 0) {
+        return -1;
+    }
+
+    return (n < msgsize) ? qemu_pipe_write_fully(pipe, (const char*)msg + n, msgsize - n) : 0;
+}
+
+int qemud_shm_attach(int pipe, size_t size, const void* msg, int msgsize,
+                     struct qemud_shm* shm) {
+    struct stat st;
+    if (fstat(pipe, &st)) {
+        return -1;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    const int fd = memfd_create("qemud_shm", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (ftruncate(fd, size)) {
+        close(fd);
+        return -1;
+    }
+
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    // The other end keeps its own reference
+    const int r = send_with_fd(pipe, msg, msgsize, fd);
+    close(fd);
+    if (r) {
+        munmap(addr, size);
+        return -1;
+    }
+
+    shm->addr = addr;
+    shm->size = size;
+    shm->head = 0;
+    return 0;
+}
+
+long qemud_shm_reserve(struct qemud_shm* shm, size_t len) {
+    if (len > shm->size) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if ((shm->size - shm->head) < len) {
+        shm->head = 0;
+    }
+
+    const size_t offset = shm->head;
+    shm->head += len;
+    return offset;
+}
+
+void qemud_shm_release(struct qemud_shm* shm) {
+    if (shm->addr) {
+        munmap(shm->addr, shm->size);
+    }
+    memset(shm, 0, sizeof(*shm));
+}
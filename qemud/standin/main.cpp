@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A stand-in for the emulator's host services (qemud and the other qemu
+ * pipes) listening on a unix socket. HALs built with libqemud.ranchu connect
+ * to it instead of the goldfish pipe when QEMU_PIPE_STANDIN_SOCKET is set.
+ * See README.md for the scenario format.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "scenario.h"
+#include "services.h"
+
+namespace {
+using namespace standin;
+
+volatile sig_atomic_t gQuit = 0;
+
+void onSignal(int) {
+    gQuit = 1;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --socket PATH [--scenario FILE] [--duration MS]\n"
+            "  --socket    unix socket to listen on, set QEMU_PIPE_STANDIN_SOCKET\n"
+            "              to the same path for the HALs\n"
+            "  --scenario  timed events, see README.md\n"
+            "  --duration  exit after MS milliseconds\n",
+            argv0);
+}
+
+int listenOn(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path is too long: '%s'\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path);
+    if ((bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) ||
+            (listen(fd, 16) < 0)) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Reads "pipe:<name>\0", the way the goldfish pipe device is told what to
+// connect to.
+bool readPipeName(const int fd, std::string* name) {
+    static const std::string_view kPrefix = "pipe:";
+    std::string s;
+
+    for (char c; s.size() < 256; ) {
+        const ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n != 1) {
+            return false;
+        } else if (c == 0) {
+            if (s.compare(0, kPrefix.size(), kPrefix) != 0) {
+                return false;
+            }
+            *name = s.substr(kPrefix.size());
+            return true;
+        } else {
+            s.push_back(c);
+        }
+    }
+
+    return false;
+}
+
+void printStats(const ServiceStats* stats) {
+    printf("%-26s %12s %12s %12s\n", "service", "connections", "received", "sent");
+    for (int i = 0; i < static_cast<int>(Service::COUNT); ++i) {
+        printf("%-26s %12llu %12llu %12llu\n",
+               getServiceName(static_cast<Service>(i)),
+               static_cast<unsigned long long>(stats[i].connections.load()),
+               static_cast<unsigned long long>(stats[i].received.load()),
+               static_cast<unsigned long long>(stats[i].sent.load()));
+    }
+    fflush(stdout);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    static const struct option kOptions[] = {
+        {"socket", required_argument, nullptr, 's'},
+        {"scenario", required_argument, nullptr, 'c'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    const char* socketPath = nullptr;
+    const char* scenarioPath = nullptr;
+    long long durationMs = -1;
+
+    for (int opt; (opt = getopt_long(argc, argv, "s:c:d:h", kOptions, nullptr)) != -1; ) {
+        switch (opt) {
+        case 's': socketPath = optarg; break;
+        case 'c': scenarioPath = optarg; break;
+        case 'd': durationMs = atoll(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (!socketPath) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static Scenario scenario;
+    if (scenarioPath) {
+        std::ifstream in(scenarioPath);
+        std::string error;
+        if (!in) {
+            fprintf(stderr, "could not open '%s'\n", scenarioPath);
+            return 1;
+        } else if (!scenario.parse(in, &error)) {
+            fprintf(stderr, "%s: %s\n", scenarioPath, error.c_str());
+            return 1;
+        }
+    }
+    scenario.addDefaults();
+
+    const int listenFd = listenOn(socketPath);
+    if (listenFd < 0) {
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    static ServiceStats stats[static_cast<int>(Service::COUNT)];
+    scenario.startT = Clock::now();
+
+    while (!gQuit) {
+        int timeoutMs = 1000;
+        if (durationMs >= 0) {
+            const auto left = scenario.startT + std::chrono::milliseconds(durationMs) -
+                              Clock::now();
+            timeoutMs = std::min<long long>(
+                timeoutMs,
+                std::chrono::duration_cast<std::chrono::milliseconds>(left).count());
+            if (timeoutMs <= 0) {
+                break;
+            }
+        }
+
+        struct pollfd pfd = {.fd = listenFd, .events = POLLIN, .revents = 0};
+        if (poll(&pfd, 1, timeoutMs) <= 0) {
+            continue;
+        }
+
+        const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        // Threads outlive the loop, `scenario` and `stats` are static
+        std::thread([fd]() {
+            std::string name;
+            if (!readPipeName(fd, &name)) {
+                fprintf(stderr, "a client did not send a pipe name\n");
+            } else if (!serve(fd, name, scenario, stats)) {
+                fprintf(stderr, "unknown service: '%s'\n", name.c_str());
+            }
+            close(fd);
+        }).detach();
+    }
+
+    close(listenFd);
+    unlink(socketPath);
+    printStats(stats);
+    return 0;
+}
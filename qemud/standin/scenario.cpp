@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include "scenario.h"
+
+namespace standin {
+namespace {
+// Used for whatever the scenario does not set, close to what the
+// emulator reports for a device lying on a table.
+const char* const kDefaults[] = {
+    "0 gps location 37.4220 -122.0841 5",
+    "0 sensor acceleration 0 9.81 0",
+    "0 sensor gyroscope 0 0 0",
+    "0 sensor magnetic 0 5.9 -48.4",
+    "0 sensor orientation 0 0 0",
+    "0 sensor temperature 25",
+    "0 sensor proximity 1",
+    "0 sensor light 40",
+    "0 sensor pressure 1013.25",
+    "0 sensor humidity 40",
+    "0 sensor rotation 0 0 0",
+    "0 sensor mask 511",
+    "0 camera webcam0 dir=front framedims=640x480,1280x720",
+};
+
+bool parseLine(const std::string& line, const int lineNo, Event* event, std::string* error) {
+    std::istringstream in(line);
+    long long timeMs;
+    if (!(in >> timeMs) || (timeMs < 0)) {
+        *error = "line " + std::to_string(lineNo) + ": bad time";
+        return false;
+    }
+    if (!(in >> event->service >> event->key)) {
+        *error = "line " + std::to_string(lineNo) + ": expected '<service> <key>'";
+        return false;
+    }
+
+    event->time = std::chrono::milliseconds(timeMs);
+    event->values.clear();
+    for (std::string v; in >> v; ) {
+        event->values.push_back(std::move(v));
+    }
+    event->line = lineNo;
+    return true;
+}
+}  // namespace
+
+bool Scenario::parse(std::istream& in, std::string* error) {
+    int lineNo = 0;
+    for (std::string line; std::getline(in, line); ) {
+        ++lineNo;
+        const size_t comment = line.find('#');
+        if (comment != line.npos) {
+            line.resize(comment);
+        }
+        if (line.find_first_not_of(" \t\r") == line.npos) {
+            continue;
+        }
+
+        Event event;
+        if (!parseLine(line, lineNo, &event, error)) {
+            return false;
+        }
+        events.push_back(std::move(event));
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const Event& a, const Event& b) { return a.time < b.time; });
+    return true;
+}
+
+void Scenario::addDefaults() {
+    const bool hasCameras =
+        std::any_of(events.begin(), events.end(),
+                    [](const Event& e) { return e.service == "camera"; });
+
+    std::vector<Event> defaults;
+    for (const char* line : kDefaults) {
+        Event event;
+        std::string unused;
+        parseLine(line, 0, &event, &unused);
+        if (!hasCameras || (event.service != "camera")) {
+            defaults.push_back(std::move(event));
+        }
+    }
+
+    // Defaults go first to let the scenario's events at t=0 win
+    events.insert(events.begin(),
+                  std::make_move_iterator(defaults.begin()),
+                  std::make_move_iterator(defaults.end()));
+}
+
+const Event* Scenario::findLatest(const std::string_view service,
+                                  const std::string_view key,
+                                  const std::chrono::milliseconds t) const {
+    const Event* result = nullptr;
+    for (const Event& e : events) {
+        if (e.time > t) {
+            break;
+        } else if ((e.service == service) && (e.key == key)) {
+            result = &e;
+        }
+    }
+    return result;
+}
+
+std::vector<const Event*> Scenario::select(const std::string_view service) const {
+    std::vector<const Event*> result;
+    for (const Event& e : events) {
+        if (e.service == service) {
+            result.push_back(&e);
+        }
+    }
+    return result;
+}
+
+}  // namespace standin
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <chrono>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace standin {
+
+using Clock = std::chrono::steady_clock;
+
+// One line of a scenario file: "<time_ms> <service> <key> [values...]",
+// e.g. "2000 sensor acceleration 0 9.81 0".
+struct Event {
+    std::chrono::milliseconds time;
+    std::string service;
+    std::string key;
+    std::vector<std::string> values;
+    int line;
+};
+
+// Events sorted by time, the order of the file is kept for equal times.
+// Time is counted from the daemon start, not from the connection, so runs
+// with the same scenario produce the same data at the same moments.
+struct Scenario {
+    bool parse(std::istream& in, std::string* error);
+    void addDefaults();
+
+    // The last event for (service, key) at or before `t`, or null
+    const Event* findLatest(std::string_view service, std::string_view key,
+                            std::chrono::milliseconds t) const;
+    std::vector<const Event*> select(std::string_view service) const;
+
+    Clock::time_point startT = Clock::now();
+    std::vector<Event> events;
+};
+
+}  // namespace standin
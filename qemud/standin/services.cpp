@@ -0,0 +1,712 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "services.h"
+
+namespace standin {
+namespace {
+using namespace std::chrono_literals;
+using std::chrono::milliseconds;
+
+constexpr uint32_t kV4l2PixFmtYuv420 = 0x32315559;  // 'YU12'
+constexpr uint32_t kV4l2PixFmtRgb32 = 0x34424752;   // 'RGB4'
+
+struct Connection {
+    Connection(const int fd, const Scenario& scenario, ServiceStats& stats)
+            : fd(fd), scenario(scenario), stats(stats) {}
+
+    milliseconds now() const {
+        return toScenarioTime(Clock::now());
+    }
+
+    Clock::time_point toTimePoint(const milliseconds t) const {
+        return scenario.startT + t;
+    }
+
+    milliseconds toScenarioTime(const Clock::time_point t) const {
+        return std::chrono::duration_cast<milliseconds>(t - scenario.startT);
+    }
+
+    // The first multiple of `period` (counted from the scenario start) after now
+    Clock::time_point nextTick(const milliseconds period) const {
+        const auto n = now() / period + 1;
+        return toTimePoint(n * period);
+    }
+
+    // Returns 1 if there is something to read, 0 on timeout and -1 if the
+    // client is gone.
+    int waitUntil(const Clock::time_point deadline) const {
+        while (true) {
+            const Clock::time_point now = Clock::now();
+            if (deadline <= now) {
+                return 0;
+            }
+            const auto left = std::chrono::ceil<milliseconds>(deadline - now);
+
+            struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+            const int r = poll(&pfd, 1, std::min<int64_t>(left.count(), INT_MAX));
+            if (r > 0) {
+                return (pfd.revents & POLLIN) ? 1 : -1;
+            } else if ((r < 0) && (errno != EINTR)) {
+                return -1;
+            }
+        }
+    }
+
+    bool readFully(void* buf, size_t size) const {
+        char* p = static_cast<char*>(buf);
+        while (size > 0) {
+            const ssize_t n = read(fd, p, size);
+            if (n > 0) {
+                p += n;
+                size -= n;
+            } else if ((n == 0) || (errno != EINTR)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Reads one byte and the file descriptor sent along with it (SCM_RIGHTS)
+    // if there is one, `*passedFd` is left as is otherwise.
+    bool readByteAndFd(char* ch, int* passedFd) const {
+        union {
+            struct cmsghdr header;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = {.iov_base = ch, .iov_len = 1};
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control.buf;
+        mh.msg_controllen = sizeof(control.buf);
+
+        while (true) {
+            const ssize_t n = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+            if (n == 1) {
+                break;
+            } else if ((n == 0) || (errno != EINTR)) {
+                return false;
+            }
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh); cmsg;
+                cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+                if (*passedFd >= 0) {
+                    close(*passedFd);
+                }
+                memcpy(passedFd, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+        return true;
+    }
+
+    bool writeFully(const void* buf, size_t size) const {
+        const char* p = static_cast<const char*>(buf);
+        while (size > 0) {
+            const ssize_t n = write(fd, p, size);
+            if (n > 0) {
+                p += n;
+                size -= n;
+            } else if ((n == 0) || (errno != EINTR)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // qemud messages have a 4 hex digits length prefix
+    bool qemudRecv(std::string* msg) {
+        char header[5] = {0};
+        unsigned size;
+        if (!readFully(header, 4) || (sscanf(header, "%04x", &size) != 1)) {
+            return false;
+        }
+        msg->resize(size);
+        if (!readFully(msg->data(), size)) {
+            return false;
+        }
+        ++stats.received;
+        return true;
+    }
+
+    bool qemudSend(const std::string_view msg) {
+        char header[5];
+        snprintf(header, sizeof(header), "%04zx", msg.size());
+        if (!writeFully(header, 4) || !writeFully(msg.data(), msg.size())) {
+            return false;
+        }
+        ++stats.sent;
+        return true;
+    }
+
+    bool rawSend(const std::string_view msg) {
+        if (!writeFully(msg.data(), msg.size())) {
+            return false;
+        }
+        ++stats.sent;
+        return true;
+    }
+
+    const int fd;
+    const Scenario& scenario;
+    ServiceStats& stats;
+};
+
+double getValue(const Event* e, const size_t i, const double defaultValue) {
+    return (e && (i < e->values.size())) ? strtod(e->values[i].c_str(), nullptr)
+                                         : defaultValue;
+}
+
+void appendNmeaChecksum(std::string* sentence) {
+    uint8_t checksum = 0;
+    for (size_t i = 1; i < sentence->size(); ++i) {
+        checksum ^= static_cast<uint8_t>((*sentence)[i]);
+    }
+
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+    *sentence += tail;
+}
+
+// ddmm.mmmm for latitudes and dddmm.mmmm for longitudes
+std::string formatNmeaAngle(const double degrees, const int degreeDigits,
+                            const char positive, const char negative) {
+    const double a = std::fabs(degrees);
+    const int d = static_cast<int>(a);
+    const double m = (a - d) * 60.0;
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%0*d%07.4f,%c",
+             degreeDigits, d, m, (degrees >= 0) ? positive : negative);
+    return buf;
+}
+
+// NMEA at 1Hz: GPGGA first (altitude and satellites), then GPRMC
+void serveGps(Connection& c) {
+    for (Clock::time_point tick = c.nextTick(1000ms);; ) {
+        const int r = c.waitUntil(tick);
+        if (r < 0) {
+            return;
+        } else if (r > 0) {
+            char buf[64];  // the HAL does not send anything, drain it
+            if (read(c.fd, buf, sizeof(buf)) <= 0) {
+                return;
+            }
+            continue;
+        }
+
+        const milliseconds t = c.toScenarioTime(tick);
+        tick += 1000ms;
+
+        const Event* location = c.scenario.findLatest("gps", "location", t);
+        const int satellites = getValue(c.scenario.findLatest("gps", "satellites", t), 0, 6);
+        if (!location || (satellites <= 0)) {
+            continue;  // no signal
+        }
+
+        const time_t utc = time(nullptr);
+        struct tm tm;
+        gmtime_r(&utc, &tm);
+        char hhmmss[8];
+        char ddmmyy[8];
+        strftime(hhmmss, sizeof(hhmmss), "%H%M%S", &tm);
+        strftime(ddmmyy, sizeof(ddmmyy), "%d%m%y", &tm);
+
+        const std::string lat = formatNmeaAngle(getValue(location, 0, 0), 2, 'N', 'S');
+        const std::string lon = formatNmeaAngle(getValue(location, 1, 0), 3, 'E', 'W');
+        char fields[128];
+
+        snprintf(fields, sizeof(fields), "$GPGGA,%s,%s,%s,1,%d,,%.1f,M,0.,M,,,",
+                 hhmmss, lat.c_str(), lon.c_str(), satellites, getValue(location, 2, 0));
+        std::string gga = fields;
+        appendNmeaChecksum(&gga);
+
+        snprintf(fields, sizeof(fields), "$GPRMC,%s,A,%s,%s,%.1f,%.1f,%s,0.0,E",
+                 hhmmss, lat.c_str(), lon.c_str(),
+                 getValue(c.scenario.findLatest("gps", "speed", t), 0, 0),
+                 getValue(c.scenario.findLatest("gps", "bearing", t), 0, 0),
+                 ddmmyy);
+        std::string rmc = fields;
+        appendNmeaChecksum(&rmc);
+
+        if (!c.rawSend(gga) || !c.rawSend(rmc)) {
+            return;
+        }
+    }
+}
+
+// "set:" uses the sensor names, the reports use shorter ones for some
+std::string getSensorReportName(std::string name) {
+    static const std::string_view kField = "-field";
+    const size_t i = name.find(kField);
+    if (i != name.npos) {
+        name.erase(i, kField.size());
+    }
+    return name;
+}
+
+void serveSensors(Connection& c) {
+    std::set<std::string> enabled;
+    milliseconds interval = 200ms;
+    std::optional<std::pair<int64_t, Clock::time_point>> guestTime;
+
+    for (Clock::time_point tick = c.nextTick(interval);; ) {
+        const int r = c.waitUntil(tick);
+        if (r < 0) {
+            return;
+        } else if (r > 0) {
+            std::string msg;
+            if (!c.qemudRecv(&msg)) {
+                return;
+            }
+
+            char name[64];
+            int on;
+            long long value;
+            if (msg == "list-sensors") {
+                const int mask = getValue(c.scenario.findLatest("sensor", "mask", c.now()),
+                                          0, 0);
+                if (!c.qemudSend(std::to_string(mask))) {
+                    return;
+                }
+            } else if (sscanf(msg.c_str(), "set:%63[^:]:%d", name, &on) == 2) {
+                if (on) {
+                    enabled.insert(getSensorReportName(name));
+                } else {
+                    enabled.erase(getSensorReportName(name));
+                }
+            } else if (sscanf(msg.c_str(), "set-delay:%lld", &value) == 1) {
+                interval = milliseconds(std::max(1LL, value));
+                tick = c.nextTick(interval);
+            } else if (sscanf(msg.c_str(), "time:%lld", &value) == 1) {
+                guestTime = {value, Clock::now()};
+            } else {
+                fprintf(stderr, "sensors: unexpected message '%s'\n", msg.c_str());
+            }
+            continue;
+        }
+
+        const milliseconds t = c.toScenarioTime(tick);
+        tick += interval;
+        if (enabled.empty()) {
+            continue;
+        }
+
+        for (const std::string& name : enabled) {
+            const Event* e = c.scenario.findLatest("sensor", name, t);
+            if (!e) {
+                continue;
+            }
+
+            std::string msg = name;
+            for (const std::string& v : e->values) {
+                msg += ':';
+                msg += v;
+            }
+            if (!c.qemudSend(msg)) {
+                return;
+            }
+        }
+
+        if (guestTime.has_value()) {
+            const int64_t guestNs = guestTime->first +
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - guestTime->second).count();
+            if (!c.qemudSend("guest-sync:" + std::to_string(guestNs / 1000))) {
+                return;
+            }
+        }
+        if (!c.qemudSend("sync:" + std::to_string(t.count() * 1000))) {
+            return;
+        }
+    }
+}
+
+void serveBootProperties(Connection& c) {
+    std::string msg;
+    if (!c.qemudRecv(&msg) || (msg != "list")) {
+        return;
+    }
+
+    for (const Event* e : c.scenario.select("property")) {
+        if (e->time > c.now()) {
+            break;
+        }
+        const std::string value = e->values.empty() ? "" : e->values.front();
+        if (!c.qemudSend(e->key + "=" + value)) {
+            return;
+        }
+    }
+
+    c.qemudSend(std::string_view("", 1));  // a lone NUL byte ends the list
+}
+
+void serveFingerprint(Connection& c) {
+    std::string msg;
+    if (!c.qemudRecv(&msg) || (msg != "listen")) {
+        return;
+    }
+
+    for (const Event* e : c.scenario.select("fingerprint")) {
+        if (e->time < c.now()) {
+            continue;  // happened before the client was listening
+        }
+        if (c.waitUntil(c.toTimePoint(e->time)) != 0) {
+            return;  // the client does not send anything after "listen"
+        }
+
+        const std::string event = (e->key == "on") ?
+            ("on:" + (e->values.empty() ? std::string("1") : e->values.front())) : e->key;
+        if (!c.qemudSend(event)) {
+            return;
+        }
+    }
+
+    char unused;
+    c.waitUntil(Clock::time_point::max());
+    c.readFully(&unused, 1);
+}
+
+// `passedFd` receives the file descriptor sent with the query, if any
+bool readCameraQuery(Connection& c, std::string* query, int* passedFd) {
+    query->clear();
+    for (char ch; c.readByteAndFd(&ch, passedFd); ) {
+        if (ch) {
+            query->push_back(ch);
+        } else {
+            ++c.stats.received;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Replies are "ok", "ok:<data>" or "ko:<message>" with a NUL byte at the
+// end and an 8 hex digits length prefix.
+bool sendCameraReply(Connection& c, std::string reply) {
+    reply.push_back(0);
+    char header[9];
+    snprintf(header, sizeof(header), "%08zx", reply.size());
+    return c.writeFully(header, 8) && c.rawSend(reply);
+}
+
+void serveCameraFactory(Connection& c) {
+    std::string query;
+    int passedFd = -1;
+    while (readCameraQuery(c, &query, &passedFd)) {
+        if (passedFd >= 0) {
+            close(passedFd);
+            passedFd = -1;
+        }
+
+        if (query != "list") {
+            if (!sendCameraReply(c, "ko:unknown query")) {
+                return;
+            }
+            continue;
+        }
+
+        std::string reply = "ok:";
+        int channel = 0;
+        for (const Event* e : c.scenario.select("camera")) {
+            reply += "name=" + e->key + " channel=" + std::to_string(channel++) +
+                     " pix=" + std::to_string(kV4l2PixFmtYuv420);
+            for (const std::string& v : e->values) {
+                reply += " " + v;
+            }
+            reply += "\n";
+        }
+
+        if (!sendCameraReply(c, std::move(reply))) {
+            return;
+        }
+    }
+}
+
+std::optional<std::string_view> getQueryParam(const std::string_view query,
+                                              const std::string_view key) {
+    for (size_t i = query.find(' '); i != query.npos; ) {
+        const size_t next = query.find(' ', i + 1);
+        const std::string_view param = query.substr(i + 1, next - i - 1);
+        if ((param.size() > key.size()) && (param[key.size()] == '=') &&
+                (param.compare(0, key.size(), key) == 0)) {
+            return param.substr(key.size() + 1);
+        }
+        i = next;
+    }
+    return std::nullopt;
+}
+
+// The same frames on every run: diagonal stripes moving one pixel a frame
+bool renderCameraFrame(const std::string_view query, const uint64_t frameNo,
+                       uint8_t* shm, const size_t shmSize) {
+    const auto dim = getQueryParam(query, "dim");
+    const auto pix = getQueryParam(query, "pix");
+    const auto offset = getQueryParam(query, "shmoffset");
+    unsigned width, height;
+    if (!dim || !pix || !offset ||
+            (sscanf(std::string(*dim).c_str(), "%ux%u", &width, &height) != 2)) {
+        return false;
+    }
+
+    const uint32_t pixelFormat = strtoul(std::string(*pix).c_str(), nullptr, 10);
+    const size_t start = strtoull(std::string(*offset).c_str(), nullptr, 10);
+    const size_t nPixels = size_t(width) * height;
+    const size_t frameSize = (pixelFormat == kV4l2PixFmtYuv420) ? (nPixels * 3 / 2) :
+                             (pixelFormat == kV4l2PixFmtRgb32) ? (nPixels * 4) : 0;
+    if (!frameSize || (start > shmSize) || (frameSize > (shmSize - start))) {
+        return false;
+    }
+
+    uint8_t* p = shm + start;
+    for (unsigned y = 0; y < height; ++y) {
+        for (unsigned x = 0; x < width; ++x) {
+            const uint8_t luma = ((x + y + frameNo) & 32) ? 192 : 64;
+            if (pixelFormat == kV4l2PixFmtYuv420) {
+                *p++ = luma;
+            } else {
+                *p++ = luma;
+                *p++ = luma;
+                *p++ = luma;
+                *p++ = 255;
+            }
+        }
+    }
+    if (pixelFormat == kV4l2PixFmtYuv420) {
+        memset(p, 128, nPixels / 2);
+    }
+
+    return true;
+}
+
+// Frames are written by the host into memory shared with the guest. Over
+// the goldfish pipe it is the guest's address space ("offset="), there is
+// no access to it here: these frame queries only take the time they are
+// told to take ("camera-latency frame <ms>") and the buffers keep what they
+// had. Memory passed with the "shm size=<bytes>" query ("shmoffset=") gets
+// test frames.
+void serveCameraDevice(Connection& c) {
+    std::string query;
+    int passedFd = -1;
+    uint8_t* shm = nullptr;
+    size_t shmSize = 0;
+    uint64_t frameNo = 0;
+
+    while (readCameraQuery(c, &query, &passedFd)) {
+        const std::string verb = query.substr(0, query.find(' '));
+        if (verb == "shm") {
+            const auto size = getQueryParam(query, "size");
+            if (shm) {
+                munmap(shm, shmSize);
+                shm = nullptr;
+            }
+            if (size && (passedFd >= 0)) {
+                shmSize = strtoull(std::string(*size).c_str(), nullptr, 10);
+                void* addr = mmap(nullptr, shmSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                  passedFd, 0);
+                shm = (addr == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(addr);
+            }
+            if (passedFd >= 0) {
+                close(passedFd);
+                passedFd = -1;
+            }
+
+            if (!sendCameraReply(c, shm ? "ok" : "ko:no memory")) {
+                break;
+            }
+            continue;
+        } else if ((verb != "connect") && (verb != "start") && (verb != "stop") &&
+                (verb != "disconnect") && (verb != "frame")) {
+            if (!sendCameraReply(c, "ko:unknown query")) {
+                break;
+            }
+            continue;
+        }
+
+        const Clock::time_point receivedT = Clock::now();
+        bool ok = true;
+        if ((verb == "frame") && getQueryParam(query, "shmoffset")) {
+            ok = shm && renderCameraFrame(query, frameNo++, shm, shmSize);
+        }
+
+        const milliseconds latency(static_cast<int64_t>(
+            getValue(c.scenario.findLatest("camera-latency", verb, c.now()), 0, 0)));
+        std::this_thread::sleep_until(receivedT + latency);
+
+        if (!sendCameraReply(c, ok ? "ok" : "ko:bad frame query")) {
+            break;
+        }
+    }
+
+    if (shm) {
+        munmap(shm, shmSize);
+    }
+    if (passedFd >= 0) {
+        close(passedFd);
+    }
+}
+
+void serveFakeRotatingCameraSensor(Connection& c) {
+    for (;;) {
+        uint32_t len;
+        if (!c.readFully(&len, sizeof(len)) || (len > 64)) {
+            return;
+        }
+        char cmd[64];
+        if (!c.readFully(cmd, len)) {
+            return;
+        }
+        ++c.stats.received;
+
+        const milliseconds t = c.now();
+        float values[9];
+        const char* const kSensors[] = {"acceleration", "magnetic", "rotation"};
+        for (int i = 0; i < 3; ++i) {
+            const Event* e = c.scenario.findLatest("sensor", kSensors[i], t);
+            for (int j = 0; j < 3; ++j) {
+                values[i * 3 + j] = getValue(e, j, 0);
+            }
+        }
+
+        len = sizeof(values);
+        if (!c.writeFully(&len, sizeof(len)) ||
+                !c.rawSend(std::string_view(reinterpret_cast<const char*>(values),
+                                            sizeof(values)))) {
+            return;
+        }
+    }
+}
+
+// "heartbeat", "bootcomplete" and friends, only counted
+void serveMisc(Connection& c) {
+    for (;;) {
+        int32_t len;
+        if (!c.readFully(&len, sizeof(len)) || (len < 0) || (len > 4096)) {
+            return;
+        }
+        std::string msg(len, 0);
+        if (!c.readFully(msg.data(), len)) {
+            return;
+        }
+        ++c.stats.received;
+
+        len = 0;
+        if (!c.writeFully(&len, sizeof(len))) {
+            return;
+        }
+        ++c.stats.sent;
+    }
+}
+
+bool parsePipeName(const std::string_view pipeName, Service* service,
+                   std::string_view* params) {
+    static const struct {
+        std::string_view name;
+        Service service;
+    } kServices[] = {
+        {"qemud:gps", Service::GPS},
+        {"qemud:sensors", Service::SENSORS},
+        {"qemud:boot-properties", Service::BOOT_PROPERTIES},
+        {"qemud:fingerprintlisten", Service::FINGERPRINT},
+        {"qemud:camera", Service::CAMERA},
+        {"FakeRotatingCameraSensor", Service::FAKE_ROTATING_CAMERA_SENSOR},
+        {"QemuMiscPipe", Service::MISC},
+    };
+
+    for (const auto& s : kServices) {
+        if (pipeName == s.name) {
+            *service = s.service;
+            *params = {};
+            return true;
+        } else if ((pipeName.size() > s.name.size()) &&
+                   (pipeName.substr(0, s.name.size()) == s.name) &&
+                   (pipeName[s.name.size()] == ':')) {
+            *service = s.service;
+            *params = pipeName.substr(s.name.size() + 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+}  // namespace
+
+const char* getServiceName(const Service service) {
+    switch (service) {
+    case Service::GPS: return "gps";
+    case Service::SENSORS: return "sensors";
+    case Service::BOOT_PROPERTIES: return "boot-properties";
+    case Service::FINGERPRINT: return "fingerprintlisten";
+    case Service::CAMERA: return "camera";
+    case Service::FAKE_ROTATING_CAMERA_SENSOR: return "FakeRotatingCameraSensor";
+    case Service::MISC: return "QemuMiscPipe";
+    default: return "?";
+    }
+}
+
+bool serve(const int fd, const std::string_view pipeName, const Scenario& scenario,
+           ServiceStats* stats) {
+    Service service;
+    std::string_view params;
+    if (!parsePipeName(pipeName, &service, &params)) {
+        return false;
+    }
+
+    ServiceStats& serviceStats = stats[static_cast<int>(service)];
+    ++serviceStats.connections;
+    Connection c(fd, scenario, serviceStats);
+
+    switch (service) {
+    case Service::GPS: serveGps(c); break;
+    case Service::SENSORS: serveSensors(c); break;
+    case Service::BOOT_PROPERTIES: serveBootProperties(c); break;
+    case Service::FINGERPRINT: serveFingerprint(c); break;
+    case Service::CAMERA:
+        if (params.empty()) {
+            serveCameraFactory(c);
+        } else {
+            serveCameraDevice(c);
+        }
+        break;
+    case Service::FAKE_ROTATING_CAMERA_SENSOR: serveFakeRotatingCameraSensor(c); break;
+    case Service::MISC: serveMisc(c); break;
+    default: break;
+    }
+
+    return true;
+}
+
+}  // namespace standin
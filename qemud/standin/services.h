@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include "scenario.h"
+
+namespace standin {
+
+struct ServiceStats {
+    std::atomic<uint64_t> connections{0};
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> sent{0};
+};
+
+enum class Service {
+    GPS, SENSORS, BOOT_PROPERTIES, FINGERPRINT, CAMERA, FAKE_ROTATING_CAMERA_SENSOR,
+    MISC, COUNT
+};
+
+const char* getServiceName(Service service);
+
+// Serves one connection until the client closes it. `pipeName` is what the
+// client sent after "pipe:", e.g. "qemud:camera:name=webcam0".
+// Returns false if nothing serves `pipeName`.
+bool serve(int fd, std::string_view pipeName, const Scenario& scenario,
+           ServiceStats* stats);
+
+}  // namespace standin
@@ -8,7 +8,8 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
-	rild_goldfish.c
+	rild_goldfish.c \
+	ril_trace.c
 
 LOCAL_SHARED_LIBRARIES := \
 	libcutils \
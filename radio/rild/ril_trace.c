@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "RILD"
+#include <log/log.h>
+
+#include "ril_trace.h"
+
+#define MAX_REQUEST         256     /* larger request numbers share the last slot */
+#define MAX_UNSOL           64      /* counted from RIL_UNSOL_RESPONSE_BASE */
+#define MAX_PENDING         256     /* requests in flight */
+#define HISTOGRAM_BUCKETS   16      /* <1ms, <2ms, <4ms, ... <16s, the rest */
+
+struct request_stats {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t cancelled;
+    uint64_t totalUs;
+    uint64_t maxUs;
+    uint64_t histogram[HISTOGRAM_BUCKETS];
+};
+
+struct unsol_stats {
+    uint64_t count;
+    uint64_t countAtLastDump;
+};
+
+struct pending_request {
+    RIL_Token token;    /* NULL if the slot is free */
+    int request;
+    uint64_t startUs;
+};
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct request_stats s_requests[MAX_REQUEST];     /* protected by s_mutex */
+static struct unsol_stats s_unsols[MAX_UNSOL];           /* protected by s_mutex */
+static struct pending_request s_pending[MAX_PENDING];    /* protected by s_mutex */
+static uint64_t s_untracked;                            /* protected by s_mutex */
+static uint64_t s_startUs;
+static uint64_t s_lastDumpUs;                           /* protected by s_mutex */
+
+static const struct RIL_Env *s_vendorEnv;   /* libril's, called by the vendor RIL */
+static const RIL_RadioFunctions *s_vendorFuncs;
+static struct RIL_Env s_tracedEnv;
+static RIL_RadioFunctions s_tracedFuncs;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int request_slot(int request) {
+    return (request >= 0 && request < MAX_REQUEST) ? request : (MAX_REQUEST - 1);
+}
+
+static int unsol_slot(int unsolResponse) {
+    const int i = unsolResponse - RIL_UNSOL_RESPONSE_BASE;
+    return (i >= 0 && i < MAX_UNSOL) ? i : (MAX_UNSOL - 1);
+}
+
+static int histogram_bucket(uint64_t us) {
+    int i = 0;
+    for (uint64_t limitUs = 1000; (us >= limitUs) && (i < HISTOGRAM_BUCKETS - 1); limitUs *= 2) {
+        ++i;
+    }
+    return i;
+}
+
+/* Returns the slot of `token` or of a free one if `token` is NULL, or -1. */
+static int find_pending_locked(RIL_Token token) {
+    for (int i = 0; i < MAX_PENDING; ++i) {
+        if (s_pending[i].token == token) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void dump_stats(void) {
+    const uint64_t now = now_us();
+
+    pthread_mutex_lock(&s_mutex);
+
+    RLOGI("ril_trace: %.1fs since start, %" PRIu64 " requests were not tracked",
+          (now - s_startUs) / 1e6, s_untracked);
+
+    for (int r = 0; r < MAX_REQUEST; ++r) {
+        const struct request_stats *s = &s_requests[r];
+        if (!s->count && !s->cancelled) {
+            continue;
+        }
+
+        char histogram[HISTOGRAM_BUCKETS * 12];
+        size_t len = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            const int n = snprintf(histogram + len, sizeof(histogram) - len,
+                                   " %" PRIu64, s->histogram[i]);
+            if (n < 0 || (size_t)n >= sizeof(histogram) - len) {
+                break;
+            }
+            len += n;
+        }
+
+        RLOGI("ril_trace: request %d%s: count=%" PRIu64 " errors=%" PRIu64
+              " cancelled=%" PRIu64 " avg=%.3fms max=%.3fms ms<1,2,4..:%s",
+              r, (r == MAX_REQUEST - 1) ? "+" : "", s->count, s->errors, s->cancelled,
+              s->count ? (s->totalUs / 1e3 / s->count) : 0.0, s->maxUs / 1e3, histogram);
+    }
+
+    const double sinceLastDumpS = (now - s_lastDumpUs) / 1e6;
+    for (int u = 0; u < MAX_UNSOL; ++u) {
+        struct unsol_stats *s = &s_unsols[u];
+        if (!s->count) {
+            continue;
+        }
+
+        RLOGI("ril_trace: unsol %d%s: count=%" PRIu64 " %.2f/s, since the last dump %"
+              PRIu64 " %.2f/s",
+              RIL_UNSOL_RESPONSE_BASE + u, (u == MAX_UNSOL - 1) ? "+" : "",
+              s->count, s->count / ((now - s_startUs) / 1e6),
+              s->count - s->countAtLastDump,
+              (s->count - s->countAtLastDump) / sinceLastDumpS);
+        s->countAtLastDump = s->count;
+    }
+
+    for (int i = 0; i < MAX_PENDING; ++i) {
+        const struct pending_request *p = &s_pending[i];
+        if (p->token) {
+            RLOGI("ril_trace: in flight: request %d token %p for %.3fms",
+                  p->request, p->token, (now - p->startUs) / 1e3);
+        }
+    }
+
+    s_lastDumpUs = now;
+    pthread_mutex_unlock(&s_mutex);
+}
+
+static void *dump_thread(void *arg) {
+    const sigset_t *signals = (const sigset_t *)arg;
+
+    while (1) {
+        int sig;
+        if (sigwait(signals, &sig) == 0) {
+            dump_stats();
+        }
+    }
+
+    return NULL;
+}
+
+static void traced_on_request(int request, void *data, size_t datalen, RIL_Token t
+#if defined(ANDROID_MULTI_SIM)
+                            , RIL_SOCKET_ID socket_id
+#endif
+                            ) {
+    pthread_mutex_lock(&s_mutex);
+    const int i = find_pending_locked(NULL);
+    if (i >= 0) {
+        s_pending[i].token = t;
+        s_pending[i].request = request;
+        s_pending[i].startUs = now_us();
+    } else {
+        ++s_untracked;
+    }
+    pthread_mutex_unlock(&s_mutex);
+
+#if defined(ANDROID_MULTI_SIM)
+    s_vendorFuncs->onRequest(request, data, datalen, t, socket_id);
+#else
+    s_vendorFuncs->onRequest(request, data, datalen, t);
+#endif
+}
+
+static void traced_on_cancel(RIL_Token t) {
+    pthread_mutex_lock(&s_mutex);
+    const int i = t ? find_pending_locked(t) : -1;
+    if (i >= 0) {
+        ++s_requests[request_slot(s_pending[i].request)].cancelled;
+        s_pending[i].token = NULL;
+    }
+    pthread_mutex_unlock(&s_mutex);
+
+    s_vendorFuncs->onCancel(t);
+}
+
+static void traced_on_request_complete(RIL_Token t, RIL_Errno e,
+                                    void *response, size_t responselen) {
+    const uint64_t now = now_us();
+
+    pthread_mutex_lock(&s_mutex);
+    const int i = t ? find_pending_locked(t) : -1;
+    if (i >= 0) {
+        struct request_stats *s = &s_requests[request_slot(s_pending[i].request)];
+        const uint64_t us = now - s_pending[i].startUs;
+
+        ++s->count;
+        if (e != RIL_E_SUCCESS) {
+            ++s->errors;
+        }
+        s->totalUs += us;
+        if (us > s->maxUs) {
+            s->maxUs = us;
+        }
+        ++s->histogram[histogram_bucket(us)];
+
+        s_pending[i].token = NULL;
+    }
+    pthread_mutex_unlock(&s_mutex);
+
+    s_vendorEnv->OnRequestComplete(t, e, response, responselen);
+}
+
+#if defined(ANDROID_MULTI_SIM)
+static void traced_on_unsolicited_response(int unsolResponse, const void *data,
+                                        size_t datalen, RIL_SOCKET_ID socket_id) {
+#else
+static void traced_on_unsolicited_response(int unsolResponse, const void *data,
+                                        size_t datalen) {
+#endif
+    pthread_mutex_lock(&s_mutex);
+    ++s_unsols[unsol_slot(unsolResponse)].count;
+    pthread_mutex_unlock(&s_mutex);
+
+#if defined(ANDROID_MULTI_SIM)
+    s_vendorEnv->OnUnsolicitedResponse(unsolResponse, data, datalen, socket_id);
+#else
+    s_vendorEnv->OnUnsolicitedResponse(unsolResponse, data, datalen);
+#endif
+}
+
+const struct RIL_Env *ril_trace_wrap_env(const struct RIL_Env *env) {
+    static sigset_t signals;
+    pthread_t thread;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL) ||
+            pthread_create(&thread, NULL, dump_thread, &signals)) {
+        RLOGE("ril_trace: could not start the dump thread, not tracing");
+        return env;
+    }
+    pthread_detach(thread);
+
+    s_startUs = now_us();
+    s_lastDumpUs = s_startUs;
+    s_vendorEnv = env;
+    s_tracedEnv = *env;
+    s_tracedEnv.OnRequestComplete = traced_on_request_complete;
+    s_tracedEnv.OnUnsolicitedResponse = traced_on_unsolicited_response;
+
+    RLOGI("ril_trace: tracing requests, send SIGUSR1 to dump the statistics");
+    return &s_tracedEnv;
+}
+
+const RIL_RadioFunctions *ril_trace_wrap_funcs(const RIL_RadioFunctions *funcs) {
+    if (!funcs || !s_vendorEnv) {
+        return funcs;
+    }
+
+    s_vendorFuncs = funcs;
+    s_tracedFuncs = *funcs;
+    s_tracedFuncs.onRequest = traced_on_request;
+    if (funcs->onCancel) {
+        s_tracedFuncs.onCancel = traced_on_cancel;
+    }
+
+    return &s_tracedFuncs;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <telephony/ril.h>
+
+/*
+ * Sits between libril and the vendor RIL: measures how long each request
+ * takes from its dispatch to RIL_onRequestComplete (per request type, as a
+ * histogram), counts unsolicited responses and keeps the requests still in
+ * flight. SIGUSR1 dumps all of it into the log.
+ */
+
+/*
+ * Returns the env to pass to RIL_Init. Must be called before rild starts
+ * its threads: it blocks SIGUSR1 for them and starts the thread dumping
+ * the statistics.
+ */
+const struct RIL_Env *ril_trace_wrap_env(const struct RIL_Env *env);
+
+/* Returns the functions to pass to RIL_register. */
+const RIL_RadioFunctions *ril_trace_wrap_funcs(const RIL_RadioFunctions *funcs);
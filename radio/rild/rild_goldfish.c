@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <string.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -34,6 +35,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <libril/ril_ex.h>
+#include "ril_trace.h"
 
 #if defined(PRODUCT_COMPATIBLE_PROPERTY)
 #define LIB_PATH_PROPERTY   "vendor.rild.libpath"
@@ -43,6 +45,8 @@
 #define LIB_ARGS_PROPERTY   "rild.libargs"
 #endif
 #define MAX_LIB_ARGS        16
+// time the requests and count the unsolicited responses, see ril_trace.h
+#define TRACE_PROPERTY      "vendor.qemu.rild.trace"
 
 static void usage(const char *argv0) {
     fprintf(stderr, "Usage: %s -l <ril impl library> [-- <args for impl library>]\n", argv0);
@@ -113,6 +117,9 @@ int main(int argc, char **argv) {
 
     // functions returned by ril init function in vendor ril
     const RIL_RadioFunctions *funcs;
+    // env passed to the vendor ril, wrapped by ril_trace if tracing
+    const struct RIL_Env *rilEnv = &s_rilEnv;
+    const bool tracing = property_get_bool(TRACE_PROPERTY, false);
     // lib path from rild.libpath property (if it's read)
     char libPath[PROPERTY_VALUE_MAX];
     // flat to indicate if -- parameters are present
@@ -175,6 +182,11 @@ int main(int argc, char **argv) {
 
     RLOGI("dlopen good: %s", rilLibPath);
 
+    // before any thread is started
+    if (tracing) {
+        rilEnv = ril_trace_wrap_env(&s_rilEnv);
+    }
+
     RIL_startEventLoop();
 
     rilInit =
@@ -215,9 +227,13 @@ int main(int argc, char **argv) {
     // Make sure there's a reasonable argv[0]
     rilArgv[0] = argv[0];
 
-    funcs = rilInit(&s_rilEnv, argc, rilArgv);
+    funcs = rilInit(rilEnv, argc, rilArgv);
     RLOGD("RIL_Init rilInit completed");
 
+    if (tracing) {
+        funcs = ril_trace_wrap_funcs(funcs);
+    }
+
     RIL_register(funcs);
 
     RLOGD("RIL_Init RIL_register completed");
@@ -17,6 +17,7 @@
 #pragma once
 #include <android-base/unique_fd.h>
 #include <V2_1/SubHal.h>
+#include <memaccount.h>
 #include <atomic>
 #include <functional>
 #include <condition_variable>
@@ -96,6 +97,18 @@ private:
         float lastWristTiltMeasurement = -1;
     };
 
+    // The step detector, step counter and significant motion sensors are
+    // computed from the accelerometer, see multihal_sensors_activity.cpp.
+    struct ActivityState {
+        float gravity = 0;      // a slow average of |acceleration|
+        float signal = 0;       // |acceleration| - gravity, smoothed
+        int64_t lastSampleNs = -1;
+        int64_t lastStepNs = -1;
+        uint64_t stepCount = 0; // since boot, while the step counter is active
+        int significantMotionSteps = 0;
+        bool aboveThreshold = false;
+    };
+
     bool isSensorHandleValid(int sensorHandle) const;
     bool isSensorActive(int sensorHandle) const {
         return m_activeSensorsMask & (1u << sensorHandle);  // m_mtx required
@@ -108,6 +121,15 @@ private:
     static bool setSensorsUpdateIntervalMs(SensorsTransport& st, uint32_t value);
     void parseQemuSensorEventLocked(QemuSensorsProtocolState* state);
     void postSensorEventLocked(const Event& event);
+    void setOperationModeLocked(OperationMode mode);
+    void queueInjectedEventLocked(const Event& event);
+    void deliverInjectedEventsLocked(int64_t nowNs);
+    void updateQueuesChargeLocked();
+    void processActivitySensorsLocked(const ahs10::Vec3& accel, int64_t timestampNs);
+    void onStepLocked(int64_t timestampNs);
+    void postActivityEventLocked(const SensorInfo& sensor, const Event& event);
+    void flushActivityFifoLocked();
+    void updateSensorsUpdateIntervalLocked();
     void doPostSensorEventLocked(const SensorInfo& sensor, const Event& event);
     void setAdditionalInfoFrames();
     void sendAdditionalInfoReport(int sensorHandle);
@@ -153,15 +175,41 @@ private:
     struct BatchInfo {
         Event       event;
         int64_t     samplingPeriodNs = 0;
+        int64_t     maxReportLatencyNs = 0;
         int         generation = 0;
     };
 
+    // DATA_INJECTION, delivered in the timestamp order
+    struct InjectedEvent {
+        Event       event;
+        uint64_t    seq = 0;    // keeps the order of events with equal timestamps
+
+        bool operator<(const InjectedEvent &rhs) const {
+            // m_injectedEvents.top() is the earliest event
+            return (event.timestamp == rhs.event.timestamp) ?
+                (seq > rhs.seq) : (event.timestamp > rhs.event.timestamp);
+        }
+    };
+
     QemuSensorsProtocolState                m_protocolState;
     std::priority_queue<BatchEventRef>      m_batchQueue;
     std::vector<BatchInfo>                  m_batchInfo;
     std::condition_variable                 m_batchUpdated;
     std::thread                             m_batchThread;
     std::atomic<bool>                       m_batchRunning = true;
+    std::priority_queue<InjectedEvent>      m_injectedEvents;
+    std::vector<Event>                      m_injectedEventsBatch;
+    uint64_t                                m_injectedEventsSeq = 0;
+
+    // events of the activity sensors wait here up to their maxReportLatencyNs
+    ActivityState                           m_activityState;
+    std::vector<Event>                      m_activityFifo;
+    int64_t                                 m_activityFifoDeadlineNs = INT64_MAX;
+    bool                                    m_activityFifoWakeup = false;
+
+    // "sensors.queues", see `updateQueuesChargeLocked`
+    memaccount::Charge                      m_injectedEventsCharge;
+    memaccount::Charge                      m_eventBatchesCharge;
 
     mutable std::mutex                      m_mtx;
 
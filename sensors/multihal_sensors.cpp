@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cinttypes>
 #include <cstdint>
+#include <android-base/strings.h>
 #include <log/log.h>
 #include <utils/SystemClock.h>
 #include <multihal_sensors.h>
@@ -30,6 +33,8 @@ using ahs10::AdditionalInfoType;
 
 namespace {
 constexpr int64_t kMaxSamplingPeriodNs = 1000000000;
+constexpr int64_t kActivitySensorsSamplingPeriodNs = 20000000;  // 50Hz
+constexpr size_t kMaxInjectedEvents = 65536;
 
 struct SensorsTransportStub : public SensorsTransport {
     int Send(const void*, int) override { return -1; }
@@ -40,12 +45,66 @@ struct SensorsTransportStub : public SensorsTransport {
 };
 
 const SensorsTransportStub g_sensorsTransportStub;
+
+memaccount::Counter g_sensorQueuesMemory("sensors.queues");
+
+// One event per line: "<sensorHandle> <timestampNs> <value>...", timestamps
+// are relative to the start of the replay, lines starting with '#' are
+// ignored.
+bool parseInjectionTrace(const std::string& content, const int64_t startNs,
+                         std::vector<Event>* events, int* errorLine) {
+    int lineNumber = 0;
+    for (const std::string& line : ::android::base::Split(content, "\n")) {
+        ++lineNumber;
+        const std::string trimmed = ::android::base::Trim(line);
+        if (trimmed.empty() || (trimmed[0] == '#')) {
+            continue;
+        }
+
+        std::vector<std::string> fields = ::android::base::Split(trimmed, " \t");
+        fields.erase(std::remove(fields.begin(), fields.end(), ""), fields.end());
+        if ((fields.size() < 3) || (fields.size() > (2 + 16))) {
+            *errorLine = lineNumber;
+            return false;
+        }
+        const size_t nValues = fields.size() - 2;
+
+        Event event;
+        int64_t timestampNs;
+        if ((sscanf(fields[0].c_str(), "%d", &event.sensorHandle) != 1) ||
+                (sscanf(fields[1].c_str(), "%" SCNd64, &timestampNs) != 1)) {
+            *errorLine = lineNumber;
+            return false;
+        }
+
+        const SensorInfo* sensor = getSensorInfoByHandle(event.sensorHandle);
+        if (!sensor) {
+            *errorLine = lineNumber;
+            return false;
+        }
+
+        event.sensorType = sensor->type;
+        event.timestamp = startNs + timestampNs;
+        for (size_t i = 0; i < nValues; ++i) {
+            if (sscanf(fields[i + 2].c_str(), "%f", &event.u.data[i]) != 1) {
+                *errorLine = lineNumber;
+                return false;
+            }
+        }
+
+        events->push_back(event);
+    }
+
+    return true;
 }
+}  // namespace
 
 MultihalSensors::MultihalSensors(SensorsTransportFactory stf)
         : m_sensorsTransportFactory(std::move(stf))
         , m_sensorsTransport(const_cast<SensorsTransportStub*>(&g_sensorsTransportStub))
-        , m_batchInfo(getSensorNumber()) {
+        , m_batchInfo(getSensorNumber())
+        , m_injectedEventsCharge(g_sensorQueuesMemory)
+        , m_eventBatchesCharge(g_sensorQueuesMemory) {
     {
         const auto st = m_sensorsTransportFactory();
 
@@ -68,7 +127,11 @@ MultihalSensors::MultihalSensors(SensorsTransportFactory stf)
         LOG_ALWAYS_FATAL_IF(sscanf(buffer, "%u", &hostSensorsMask) != 1,
                             "%s:%d: Can't parse qemud response", __func__, __LINE__);
 
-        m_availableSensorsMask = hostSensorsMask & ((1u << getSensorNumber()) - 1);
+        m_availableSensorsMask =
+            hostSensorsMask & ((1u << getSensorNumber()) - 1) & ~kActivitySensorsMask;
+        if (m_availableSensorsMask & (1u << kSensorHandleAccelerometer)) {
+            m_availableSensorsMask |= kActivitySensorsMask;
+        }
 
         ALOGI("%s:%d: host sensors mask=%x, available sensors mask=%x",
               __func__, __LINE__, hostSensorsMask, m_availableSensorsMask);
@@ -97,9 +160,56 @@ const std::string MultihalSensors::getName() {
     return "hal_sensors_2_1_impl_ranchu";
 }
 
+// `lshal debug <instance> inject "$(cat <trace file>)"` queues all events
+// from the trace (see `parseInjectionTrace`) at once, it requires the
+// DATA_INJECTION mode. The trace comes as arguments (one or more lines
+// each), the HAL does not open files and `fd` is only for the output.
+// `lshal debug <instance> memory` prints the memory held by the HAL.
 Return<void> MultihalSensors::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) {
-    (void)fd;
-    (void)args;
+    if ((fd.getNativeHandle() == nullptr) || (fd->numFds < 1)) {
+        return {};
+    }
+    const int out = fd->data[0];
+
+    if ((args.size() == 1) && (args[0] == "memory")) {
+        memaccount::dump(out);
+        return {};
+    } else if ((args.size() < 2) || (args[0] != "inject")) {
+        dprintf(out, "usage: inject <trace lines>... | memory\n");
+        return {};
+    }
+
+    std::string content;
+    for (size_t i = 1; i < args.size(); ++i) {
+        content += args[i];
+        content += '\n';
+    }
+
+    std::vector<Event> events;
+    int errorLine = 0;
+    if (!parseInjectionTrace(content, ::android::elapsedRealtimeNano(), &events, &errorLine)) {
+        dprintf(out, "line %d: could not parse\n", errorLine);
+        return {};
+    }
+    for (const Event& event : events) {
+        if (!isSensorHandleValid(event.sensorHandle)) {
+            dprintf(out, "sensorHandle=%d is not available\n", event.sensorHandle);
+            return {};
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    if (m_opMode != OperationMode::DATA_INJECTION) {
+        dprintf(out, "the DATA_INJECTION mode is not enabled\n");
+    } else if ((m_injectedEvents.size() + events.size()) > kMaxInjectedEvents) {
+        dprintf(out, "too many events: %zu\n", events.size());
+    } else {
+        for (const Event& event : events) {
+            queueInjectedEventLocked(event);
+        }
+        dprintf(out, "queued %zu events\n", events.size());
+    }
+
     return {};
 }
 
@@ -123,11 +233,25 @@ Return<Result> MultihalSensors::setOperationMode(const OperationMode mode) {
     if (m_activeSensorsMask) {
         return Result::INVALID_OPERATION;
     } else {
-        m_opMode = mode;
+        setOperationModeLocked(mode);
         return Result::OK;
     }
 }
 
+void MultihalSensors::setOperationModeLocked(const OperationMode mode) {
+    if (mode == m_opMode) {
+        return;
+    }
+
+    m_opMode = mode;
+    m_injectedEvents = {};
+    m_injectedEventsCharge.set(0);
+
+    // The host stream is off while injecting. The listener thread enables
+    // or disables the host sensors according to m_opMode when it restarts.
+    qemuSensorThreadSendCommand(kCMD_RESTART);
+}
+
 Return<Result> MultihalSensors::activate(const int32_t sensorHandle,
                                          const bool enabled) {
     if (!isSensorHandleValid(sensorHandle)) {
@@ -140,9 +264,16 @@ Return<Result> MultihalSensors::activate(const int32_t sensorHandle,
     if (enabled) {
         const SensorInfo* sensor = getSensorInfoByHandle(sensorHandle);
         LOG_ALWAYS_FATAL_IF(!sensor);
-        if (sensor->flags & static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE)) {
+        if (m_opMode == OperationMode::DATA_INJECTION) {
+            // all events come from injectSensorData_2_1
+        } else if (sensor->flags & static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE)) {
             doPostSensorEventLocked(*sensor,
                                     activationOnChangeSensorEvent(sensorHandle, *sensor));
+        } else if (kActivitySensorsMask & (1u << sensorHandle)) {
+            // events are generated from the accelerometer
+            if (sensorHandle == kSensorHandleSignificantMotion) {
+                m_activityState.significantMotionSteps = 0;
+            }
         } else {
             if (batchInfo.samplingPeriodNs <= 0) {
                 return Result::BAD_VALUE;
@@ -160,8 +291,16 @@ Return<Result> MultihalSensors::activate(const int32_t sensorHandle,
         sendAdditionalInfoReport(sensorHandle);
         m_activeSensorsMask = m_activeSensorsMask | (1u << sensorHandle);
     } else {
+        if (kActivitySensorsMask & (1u << sensorHandle)) {
+            flushActivityFifoLocked();
+        }
         m_activeSensorsMask = m_activeSensorsMask & ~(1u << sensorHandle);
     }
+
+    // the activity sensors need the accelerometer at kActivitySensorsSamplingPeriodNs
+    if ((kActivitySensorsMask & (1u << sensorHandle)) && (m_opMode == OperationMode::NORMAL)) {
+        updateSensorsUpdateIntervalLocked();
+    }
     return Result::OK;
 }
 
@@ -187,6 +326,10 @@ Event MultihalSensors::activationOnChangeSensorEvent(const int32_t sensorHandle,
         payload->scalar = m_protocolState.kSensorNoValue;
         break;
 
+    case SensorType::STEP_COUNTER:
+        payload->stepCount = m_activityState.stepCount;
+        break;
+
     case SensorType::HEART_RATE:
         // Heart rate sensor's first data after activation should be
         // SENSOR_STATUS_UNRELIABLE.
@@ -231,8 +374,6 @@ Event MultihalSensors::activationOnChangeSensorEvent(const int32_t sensorHandle,
 Return<Result> MultihalSensors::batch(const int32_t sensorHandle,
                                       const int64_t samplingPeriodNs,
                                       const int64_t maxReportLatencyNs) {
-    (void)maxReportLatencyNs;
-
     if (!isSensorHandleValid(sensorHandle)) {
         return Result::BAD_VALUE;
     }
@@ -245,30 +386,41 @@ Return<Result> MultihalSensors::batch(const int32_t sensorHandle,
     }
 
     std::unique_lock<std::mutex> lock(m_mtx);
+    m_batchInfo[sensorHandle].samplingPeriodNs = samplingPeriodNs;
+    // only the activity sensors have FIFOs
+    m_batchInfo[sensorHandle].maxReportLatencyNs =
+        sensor->fifoMaxEventCount ? maxReportLatencyNs : 0;
+
     if (m_opMode == OperationMode::NORMAL) {
-        m_batchInfo[sensorHandle].samplingPeriodNs = samplingPeriodNs;
-
-        auto minSamplingPeriodNs = kMaxSamplingPeriodNs;
-        auto activeSensorsMask = m_activeSensorsMask;
-        for (const auto& b : m_batchInfo) {
-            if (activeSensorsMask & 1) {
-                const auto periodNs = b.samplingPeriodNs;
-                if ((periodNs > 0) && (periodNs < minSamplingPeriodNs)) {
-                    minSamplingPeriodNs = periodNs;
-                }
-            }
+        updateSensorsUpdateIntervalLocked();
+    }
 
-            activeSensorsMask >>= 1;
-        }
+    return Result::OK;
+}
 
-        const uint32_t sensorsUpdateIntervalMs = std::max(1, int(minSamplingPeriodNs / 1000000));
-        m_protocolState.sensorsUpdateIntervalMs = sensorsUpdateIntervalMs;
-        if (!setSensorsUpdateIntervalMs(*m_sensorsTransport, sensorsUpdateIntervalMs)) {
-            qemuSensorThreadSendCommand(kCMD_RESTART);
+void MultihalSensors::updateSensorsUpdateIntervalLocked() {
+    auto minSamplingPeriodNs = kMaxSamplingPeriodNs;
+    if (m_activeSensorsMask & kActivitySensorsMask) {
+        minSamplingPeriodNs = kActivitySensorsSamplingPeriodNs;
+    }
+
+    auto activeSensorsMask = m_activeSensorsMask;
+    for (const auto& b : m_batchInfo) {
+        if (activeSensorsMask & 1) {
+            const auto periodNs = b.samplingPeriodNs;
+            if ((periodNs > 0) && (periodNs < minSamplingPeriodNs)) {
+                minSamplingPeriodNs = periodNs;
+            }
         }
+
+        activeSensorsMask >>= 1;
     }
 
-    return Result::OK;
+    const uint32_t sensorsUpdateIntervalMs = std::max(1, int(minSamplingPeriodNs / 1000000));
+    m_protocolState.sensorsUpdateIntervalMs = sensorsUpdateIntervalMs;
+    if (!setSensorsUpdateIntervalMs(*m_sensorsTransport, sensorsUpdateIntervalMs)) {
+        qemuSensorThreadSendCommand(kCMD_RESTART);
+    }
 }
 
 Return<Result> MultihalSensors::flush(const int32_t sensorHandle) {
@@ -279,11 +431,20 @@ Return<Result> MultihalSensors::flush(const int32_t sensorHandle) {
     const SensorInfo* sensor = getSensorInfoByHandle(sensorHandle);
     LOG_ALWAYS_FATAL_IF(!sensor);
 
+    if (sensor->flags & static_cast<uint32_t>(SensorFlagBits::ONE_SHOT_MODE)) {
+        return Result::BAD_VALUE;
+    }
+
     std::unique_lock<std::mutex> lock(m_mtx);
     if (!isSensorActive(sensorHandle)) {
         return Result::BAD_VALUE;
     }
 
+    // the FIFO is shared, this flushes the other activity sensors too
+    if (kActivitySensorsMask & (1u << sensorHandle)) {
+        flushActivityFifoLocked();
+    }
+
     Event event;
     event.sensorHandle = sensorHandle;
     event.sensorType = SensorType::META_DATA;
@@ -312,18 +473,85 @@ Return<Result> MultihalSensors::injectSensorData_2_1(const Event& event) {
     if (sensor->type != event.sensorType) {
         return Result::BAD_VALUE;
     }
+    if (m_injectedEvents.size() >= kMaxInjectedEvents) {
+        return Result::NO_MEMORY;
+    }
 
-    doPostSensorEventLocked(*sensor, event);
+    queueInjectedEventLocked(event);
     return Result::OK;
 }
 
 Return<Result> MultihalSensors::initialize(const sp<IHalProxyCallback>& halProxyCallback) {
     std::unique_lock<std::mutex> lock(m_mtx);
-    m_opMode = OperationMode::NORMAL;
+    setOperationModeLocked(OperationMode::NORMAL);
     m_halProxyCallback = halProxyCallback;
     return Result::OK;
 }
 
+// Injected events are delivered by batchThread when their timestamps come,
+// like the host samples in m_batchQueue. All events due by then are posted
+// at once in the timestamp order.
+void MultihalSensors::queueInjectedEventLocked(const Event& event) {
+    InjectedEvent injected;
+    injected.event = event;
+    injected.seq = ++m_injectedEventsSeq;
+    m_injectedEvents.push(injected);
+    m_injectedEventsCharge.set(m_injectedEvents.size() * sizeof(InjectedEvent));
+
+    // batchThread waits for the earliest event
+    if (m_injectedEvents.top().seq == injected.seq) {
+        m_batchUpdated.notify_one();
+    }
+}
+
+void MultihalSensors::deliverInjectedEventsLocked(const int64_t nowNs) {
+    std::vector<Event>& events = m_injectedEventsBatch;
+    bool isWakeupEvent = false;
+
+    events.clear();
+    while (!m_injectedEvents.empty() && (nowNs >= m_injectedEvents.top().event.timestamp)) {
+        const Event& event = m_injectedEvents.top().event;
+        const SensorInfo* sensor = getSensorInfoByHandle(event.sensorHandle);
+        LOG_ALWAYS_FATAL_IF(!sensor);
+
+        isWakeupEvent = isWakeupEvent ||
+            (sensor->flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP));
+        events.push_back(event);
+
+        if ((event.sensorHandle == kSensorHandleAccelerometer) &&
+                (m_activeSensorsMask & kActivitySensorsMask)) {
+            processActivitySensorsLocked(event.u.vec3, event.timestamp);
+        }
+
+        m_injectedEvents.pop();
+    }
+    m_injectedEventsCharge.set(m_injectedEvents.size() * sizeof(InjectedEvent));
+
+    if (!events.empty()) {
+        m_halProxyCallback->postEvents(
+            events, m_halProxyCallback->createScopedWakelock(isWakeupEvent));
+        events.clear();
+    }
+
+    updateQueuesChargeLocked();
+}
+
+// The batches keep their capacity for the next events unless the
+// "sensors.queues" memory budget is exceeded.
+void MultihalSensors::updateQueuesChargeLocked() {
+    if (m_eventBatchesCharge.isOverBudget()) {
+        if (m_injectedEventsBatch.empty()) {
+            std::vector<Event>().swap(m_injectedEventsBatch);
+        }
+        if (m_activityFifo.empty()) {
+            std::vector<Event>().swap(m_activityFifo);
+        }
+    }
+
+    m_eventBatchesCharge.set(
+        (m_injectedEventsBatch.capacity() + m_activityFifo.capacity()) * sizeof(Event));
+}
+
 void MultihalSensors::postSensorEventLocked(const Event& event) {
     const SensorInfo* sensor = getSensorInfoByHandle(event.sensorHandle);
     LOG_ALWAYS_FATAL_IF(!sensor);
@@ -414,8 +642,17 @@ void MultihalSensors::qemuSensorListenerThread() {
             *st, ::android::elapsedRealtimeNano()));
         LOG_ALWAYS_FATAL_IF(!setSensorsUpdateIntervalMs(
             *st, m_protocolState.sensorsUpdateIntervalMs));
+
+        bool hostStream;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            hostStream = (m_opMode == OperationMode::NORMAL);
+        }
+
+        // Not under m_mtx, it blocks on the host. If the mode changes
+        // meanwhile, kCMD_RESTART comes and this is sent again.
         LOG_ALWAYS_FATAL_IF(!setAllSensorsReporting(
-            *st, m_availableSensorsMask, true));
+            *st, m_availableSensorsMask & ~kActivitySensorsMask, hostStream));
 
         {
             std::unique_lock<std::mutex> lock(m_mtx);
@@ -438,15 +675,22 @@ void MultihalSensors::qemuSensorListenerThread() {
 void MultihalSensors::batchThread() {
     while (m_batchRunning) {
         std::unique_lock<std::mutex> lock(m_mtx);
-        if (m_batchQueue.empty()) {
+        if (m_batchQueue.empty() && m_injectedEvents.empty()) {
             m_batchUpdated.wait(lock);
         } else {
-            const int64_t d =
-                m_batchQueue.top().timestamp - ::android::elapsedRealtimeNano();
+            int64_t nextNs = INT64_MAX;
+            if (!m_batchQueue.empty()) {
+                nextNs = m_batchQueue.top().timestamp;
+            }
+            if (!m_injectedEvents.empty()) {
+                nextNs = std::min(nextNs, m_injectedEvents.top().event.timestamp);
+            }
+            const int64_t d = nextNs - ::android::elapsedRealtimeNano();
             m_batchUpdated.wait_for(lock, std::chrono::nanoseconds(d));
         }
 
         const int64_t nowNs = ::android::elapsedRealtimeNano();
+        deliverInjectedEventsLocked(nowNs);
         while (!m_batchQueue.empty() && (nowNs >= m_batchQueue.top().timestamp)) {
             BatchEventRef evRef = m_batchQueue.top();
             m_batchQueue.pop();
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <log/log.h>
+#include <math.h>
+#include <multihal_sensors.h>
+#include "sensor_list.h"
+
+namespace goldfish {
+using ahs21::SensorType;
+using ahs10::SensorFlagBits;
+
+namespace {
+constexpr float kGravityTimeConstantS = 1.0;
+constexpr float kSignalTimeConstantS = 0.04;
+// A step is a peak of |acceleration| above gravity, the hysteresis rejects
+// the noise around the peak.
+constexpr float kStepThreshold = 1.2;       // m/s^2
+constexpr float kStepResetThreshold = 0.4;  // m/s^2
+constexpr int64_t kMinStepIntervalNs = 250000000;  // 4 steps per second
+constexpr int kSignificantMotionSteps = 8;
+
+float smoothingFactor(const float dtS, const float timeConstantS) {
+    return std::min(1.0f, dtS / timeConstantS);
+}
+
+}  // namespace
+
+void MultihalSensors::processActivitySensorsLocked(const ahs10::Vec3& accel,
+                                                   const int64_t timestampNs) {
+    ActivityState& state = m_activityState;
+    const float magnitude = sqrtf(accel.x * accel.x + accel.y * accel.y + accel.z * accel.z);
+
+    if (state.lastSampleNs < 0) {
+        state.gravity = magnitude;
+        state.signal = 0;
+    } else {
+        const float dtS = std::clamp((timestampNs - state.lastSampleNs) / 1e9f, 0.0f, 1.0f);
+        state.gravity += (magnitude - state.gravity) *
+                         smoothingFactor(dtS, kGravityTimeConstantS);
+        state.signal += ((magnitude - state.gravity) - state.signal) *
+                        smoothingFactor(dtS, kSignalTimeConstantS);
+    }
+    state.lastSampleNs = timestampNs;
+
+    if (state.aboveThreshold) {
+        if (state.signal < kStepResetThreshold) {
+            state.aboveThreshold = false;
+        }
+    } else if (state.signal > kStepThreshold) {
+        state.aboveThreshold = true;
+        if ((state.lastStepNs < 0) || ((timestampNs - state.lastStepNs) >= kMinStepIntervalNs)) {
+            state.lastStepNs = timestampNs;
+            onStepLocked(timestampNs);
+        }
+    }
+
+    if (!m_activityFifo.empty() && (timestampNs >= m_activityFifoDeadlineNs)) {
+        flushActivityFifoLocked();
+    }
+}
+
+void MultihalSensors::onStepLocked(const int64_t timestampNs) {
+    Event event;
+    event.timestamp = timestampNs;
+
+    if (isSensorActive(kSensorHandleStepDetector)) {
+        event.sensorHandle = kSensorHandleStepDetector;
+        event.sensorType = SensorType::STEP_DETECTOR;
+        event.u.scalar = 1.0;
+        postActivityEventLocked(*getSensorInfoByHandle(kSensorHandleStepDetector), event);
+    }
+
+    if (isSensorActive(kSensorHandleStepCounter)) {
+        event.sensorHandle = kSensorHandleStepCounter;
+        event.sensorType = SensorType::STEP_COUNTER;
+        event.u.stepCount = ++m_activityState.stepCount;
+        postActivityEventLocked(*getSensorInfoByHandle(kSensorHandleStepCounter), event);
+    }
+
+    if (isSensorActive(kSensorHandleSignificantMotion) &&
+            (++m_activityState.significantMotionSteps >= kSignificantMotionSteps)) {
+        event.sensorHandle = kSensorHandleSignificantMotion;
+        event.sensorType = SensorType::SIGNIFICANT_MOTION;
+        event.u.scalar = 1.0;
+
+        // one-shot sensors are not batched and deactivate themselves
+        flushActivityFifoLocked();
+        doPostSensorEventLocked(*getSensorInfoByHandle(kSensorHandleSignificantMotion),
+                                event);
+        m_activeSensorsMask = m_activeSensorsMask & ~(1u << kSensorHandleSignificantMotion);
+
+        // the accelerometer might not be needed this often any more
+        if (m_opMode == OperationMode::NORMAL) {
+            updateSensorsUpdateIntervalLocked();
+        }
+    }
+}
+
+void MultihalSensors::postActivityEventLocked(const SensorInfo& sensor, const Event& event) {
+    const int64_t maxReportLatencyNs = m_batchInfo[event.sensorHandle].maxReportLatencyNs;
+
+    if ((maxReportLatencyNs <= 0) && m_activityFifo.empty()) {
+        doPostSensorEventLocked(sensor, event);
+        return;
+    }
+
+    m_activityFifo.push_back(event);
+    updateQueuesChargeLocked();
+    m_activityFifoDeadlineNs = std::min(m_activityFifoDeadlineNs,
+                                        event.timestamp + std::max(int64_t(0),
+                                                                   maxReportLatencyNs));
+    m_activityFifoWakeup = m_activityFifoWakeup ||
+        (sensor.flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP));
+
+    if ((m_activityFifo.size() >= kActivitySensorsFifoSize) ||
+            (event.timestamp >= m_activityFifoDeadlineNs)) {
+        flushActivityFifoLocked();
+    }
+}
+
+void MultihalSensors::flushActivityFifoLocked() {
+    if (m_activityFifo.empty()) {
+        return;
+    }
+
+    m_halProxyCallback->postEvents(
+        m_activityFifo,
+        m_halProxyCallback->createScopedWakelock(m_activityFifoWakeup));
+
+    m_activityFifo.clear();
+    m_activityFifoDeadlineNs = INT64_MAX;
+    m_activityFifoWakeup = false;
+    updateQueuesChargeLocked();
+}
+
+}  // namespace goldfish
@@ -134,6 +134,9 @@ void MultihalSensors::parseQemuSensorEventLocked(QemuSensorsProtocolState* state
             event.sensorHandle = kSensorHandleAccelerometer;
             event.sensorType = SensorType::ACCELEROMETER;
             postSensorEventLocked(event);
+            if (m_activeSensorsMask & kActivitySensorsMask) {
+                processActivitySensorsLocked(*vec3, event.timestamp);
+            }
             parsed = true;
         }
     } else if (const char* values = testPrefix(buf, end, "acceleration-uncalibrated", ':')) {
@@ -41,6 +41,9 @@ const char* const kQemuSensorName[] = {
     "rgbc-light",
     "wrist-tilt",
     "acceleration-uncalibrated",
+    nullptr,  // step detector, see kActivitySensorsMask
+    nullptr,  // step counter
+    nullptr,  // significant motion
 };
 
 const SensorInfo kAllSensors[] = {
@@ -358,6 +361,59 @@ const SensorInfo kAllSensors[] = {
         .flags = SensorFlagBits::DATA_INJECTION |
                  SensorFlagBits::ADDITIONAL_INFO |
                  SensorFlagBits::CONTINUOUS_MODE
+    },
+    {
+        .sensorHandle = kSensorHandleStepDetector,
+        .name = "Goldfish Step detector",
+        .vendor = kAospVendor,
+        .version = 1,
+        .type = SensorType::STEP_DETECTOR,
+        .typeAsString = "android.sensor.step_detector",
+        .maxRange = 1.0,
+        .resolution = 1.0,
+        .power = 3.0,
+        .minDelay = 0,
+        .fifoReservedEventCount = 0,
+        .fifoMaxEventCount = kActivitySensorsFifoSize,
+        .requiredPermission = "",
+        .maxDelay = 0,
+        .flags = static_cast<uint32_t>(SensorFlagBits::SPECIAL_REPORTING_MODE)
+    },
+    {
+        .sensorHandle = kSensorHandleStepCounter,
+        .name = "Goldfish Step counter",
+        .vendor = kAospVendor,
+        .version = 1,
+        .type = SensorType::STEP_COUNTER,
+        .typeAsString = "android.sensor.step_counter",
+        .maxRange = 4294967295.0,
+        .resolution = 1.0,
+        .power = 3.0,
+        .minDelay = 0,
+        .fifoReservedEventCount = 0,
+        .fifoMaxEventCount = kActivitySensorsFifoSize,
+        .requiredPermission = "",
+        .maxDelay = 0,
+        .flags = SensorFlagBits::ON_CHANGE_MODE |
+                 SensorFlagBits::WAKE_UP
+    },
+    {
+        .sensorHandle = kSensorHandleSignificantMotion,
+        .name = "Goldfish Significant motion sensor",
+        .vendor = kAospVendor,
+        .version = 1,
+        .type = SensorType::SIGNIFICANT_MOTION,
+        .typeAsString = "android.sensor.significant_motion",
+        .maxRange = 1.0,
+        .resolution = 1.0,
+        .power = 3.0,
+        .minDelay = -1,
+        .fifoReservedEventCount = 0,
+        .fifoMaxEventCount = 0,
+        .requiredPermission = "",
+        .maxDelay = 0,
+        .flags = SensorFlagBits::ONE_SHOT_MODE |
+                 SensorFlagBits::WAKE_UP
     }};
 
 constexpr int kSensorNumber = sizeof(kAllSensors) / sizeof(kAllSensors[0]);
@@ -39,6 +39,16 @@ constexpr int kSensorHandleHingeAngle2 = 13;
 constexpr int kSensorHandleHeartRate = 14;
 constexpr int kSensorHandleWristTilt = 16;
 constexpr int kSensorHandleAccelerometerUncalibrated = 17;
+constexpr int kSensorHandleStepDetector = 18;
+constexpr int kSensorHandleStepCounter = 19;
+constexpr int kSensorHandleSignificantMotion = 20;
+
+// These sensors are computed from the accelerometer in the HAL, the host does
+// not know about them.
+constexpr uint32_t kActivitySensorsMask = (1u << kSensorHandleStepDetector) |
+                                          (1u << kSensorHandleStepCounter) |
+                                          (1u << kSensorHandleSignificantMotion);
+constexpr uint32_t kActivitySensorsFifoSize = 256;
 
 int getSensorNumber();
 bool isSensorHandleValid(int h);
@@ -16,6 +16,8 @@
 
 #include "info.h"
 
+#include "log.h"
+
 #include <sys/stat.h>
 
 #include <string>
@@ -29,17 +31,27 @@ Info::Info() {
         std::string test_path = std::string("/sys/class/net/") + name;
         struct stat ignored_statbuf;
         if (stat(test_path.c_str(), &ignored_statbuf) == 0) {
-            mInterfaces.emplace_back(mNetlink, name);
+            mInterfaces.emplace_back(mNetlink, mKeepaliveOffload, name);
             auto handle = reinterpret_cast<wifi_interface_handle>(&mInterfaces.back());
             mInterfaceHandles.emplace_back(handle);
         }
     }
 }
 
+// The event loop holds handlers calling into the offloads and the interfaces,
+// they are destroyed before mNetlink.
+Info::~Info() {
+    mNetlink.clearHandlers();
+}
+
 bool Info::init() {
     if (!mNetlink.init()) {
         return false;
     }
+    if (!mKeepaliveOffload.init(mNetlink)) {
+        // Not fatal, the framework falls back to sending keepalives itself
+        ALOGW("Keepalive offload is not available");
+    }
     for (auto& iface : mInterfaces) {
         if (!iface.init()) {
             return false;
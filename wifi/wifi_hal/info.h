@@ -20,12 +20,14 @@
 #include <vector>
 #include <hardware_legacy/wifi_hal.h>
 #include "interface.h"
+#include "keepaliveoffload.h"
 #include "netlink.h"
 
 class Info {
 public:
     using StopHandler = std::function<void ()>;
     Info();
+    ~Info();
 
     bool init();
     void eventLoop();
@@ -33,7 +35,9 @@ public:
     wifi_error getInterfaces(int* num, wifi_interface_handle** interfaces);
 
 private:
+    // Outlives the objects below, see `~Info`
     Netlink mNetlink;
+    KeepaliveOffload mKeepaliveOffload;
     std::vector<wifi_interface_handle> mInterfaceHandles;
     std::vector<Interface> mInterfaces;
 };
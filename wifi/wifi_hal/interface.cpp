@@ -16,9 +16,11 @@
 
 #include "interface.h"
 
+#include "keepaliveoffload.h"
 #include "log.h"
 #include "netlink.h"
 #include "netlinkmessage.h"
+#include "rssimonitor.h"
 
 #include <linux/rtnetlink.h>
 
@@ -51,24 +53,36 @@ constexpr size_t arraySize(const T (&)[N]) {
     return N;
 }
 
-Interface::Interface(Netlink& netlink, const char* name)
+Interface::Interface(Netlink& netlink,
+                     KeepaliveOffload& keepaliveOffload,
+                     const char* name)
     : mNetlink(netlink)
+    , mKeepaliveOffload(keepaliveOffload)
     , mName(name)
-    , mInterfaceIndex(0) {
+    , mInterfaceIndex(0)
+    , mRssiMonitor(std::make_unique<RssiMonitor>()) {
 }
 
 Interface::Interface(Interface&& other) noexcept
     : mNetlink(other.mNetlink)
+    , mKeepaliveOffload(other.mKeepaliveOffload)
     , mName(std::move(other.mName))
-    , mInterfaceIndex(other.mInterfaceIndex) {
+    , mInterfaceIndex(other.mInterfaceIndex)
+    , mRssiMonitor(std::move(other.mRssiMonitor)) {
 }
 
+// Defined here where RssiMonitor is a complete type
+Interface::~Interface() = default;
+
 bool Interface::init() {
     mInterfaceIndex = if_nametoindex(mName.c_str());
     if (mInterfaceIndex == 0) {
         ALOGE("Unable to get interface index for %s", mName.c_str());
         return false;
     }
+    if (!mRssiMonitor->init(mNetlink, mInterfaceIndex)) {
+        ALOGW("RSSI monitoring is not available on %s", mName.c_str());
+    }
     return true;
 }
 
@@ -77,6 +91,12 @@ wifi_error Interface::getSupportedFeatureSet(feature_set* set) {
         return WIFI_ERROR_INVALID_ARGS;
     }
     *set = 0;
+    if (mKeepaliveOffload.isAvailable()) {
+        *set |= WIFI_FEATURE_MKEEP_ALIVE;
+    }
+    if (mRssiMonitor->isAvailable()) {
+        *set |= WIFI_FEATURE_RSSI_MONITOR;
+    }
     return WIFI_SUCCESS;
 }
 
@@ -270,22 +290,38 @@ Interface::getWakeReasonStats(WLAN_DRIVER_WAKE_REASON_CNT* wakeReasonCount) {
     return WIFI_SUCCESS;
 }
 
-wifi_error Interface::startSendingOffloadedPacket(wifi_request_id /*id*/,
-                                                  u16 /*ether_type*/,
-                                                  u8 * /*ip_packet*/,
-                                                  u16 /*ip_packet_len*/,
-                                                  u8 * /*src_mac_addr*/,
-                                                  u8 * /*dst_mac_addr*/,
-                                                  u32 /*period_msec*/) {
-    // Drop the packet and pretend everything is fine. Currentlty this is only
-    // used for keepalive packets to allow the CPU to go to sleep and let the
-    // hardware send keepalive packets on its own. By dropping this we lose the
-    // keepalive packets but networking will still be fine.
-    return WIFI_SUCCESS;
+wifi_error Interface::startSendingOffloadedPacket(wifi_request_id id,
+                                                  u16 ether_type,
+                                                  u8 *ip_packet,
+                                                  u16 ip_packet_len,
+                                                  u8 *src_mac_addr,
+                                                  u8 *dst_mac_addr,
+                                                  u32 period_msec) {
+    // This is used for keepalive packets to allow the CPU to go to sleep and
+    // let the hardware send keepalive packets on its own.
+    return mKeepaliveOffload.start(mInterfaceIndex,
+                                   id,
+                                   ether_type,
+                                   ip_packet,
+                                   ip_packet_len,
+                                   src_mac_addr,
+                                   dst_mac_addr,
+                                   period_msec);
 }
 
-wifi_error Interface::stopSendingOffloadedPacket(wifi_request_id /*id*/) {
-    return WIFI_SUCCESS;
+wifi_error Interface::stopSendingOffloadedPacket(wifi_request_id id) {
+    return mKeepaliveOffload.stop(mInterfaceIndex, id);
+}
+
+wifi_error Interface::startRssiMonitoring(wifi_request_id id,
+                                          s8 maxRssi,
+                                          s8 minRssi,
+                                          wifi_rssi_event_handler handler) {
+    return mRssiMonitor->start(id, maxRssi, minRssi, handler);
+}
+
+wifi_error Interface::stopRssiMonitoring(wifi_request_id id) {
+    return mRssiMonitor->stop(id);
 }
 
 void Interface::onLinkStatsReply(wifi_request_id requestId,
@@ -16,17 +16,23 @@
 
 #pragma once
 
+#include <memory>
 #include <stdint.h>
 #include <string>
 #include <hardware_legacy/wifi_hal.h>
 
+class KeepaliveOffload;
 class Netlink;
 class NetlinkMessage;
+class RssiMonitor;
 
 class Interface {
 public:
-    Interface(Netlink& netlink, const char* name);
+    Interface(Netlink& netlink,
+              KeepaliveOffload& keepaliveOffload,
+              const char* name);
     Interface(Interface&& other) noexcept;
+    ~Interface();
 
     bool init();
 
@@ -78,6 +84,11 @@ public:
                                            u8 *dst_mac_addr,
                                            u32 period_msec);
     wifi_error stopSendingOffloadedPacket(wifi_request_id id);
+    wifi_error startRssiMonitoring(wifi_request_id id,
+                                   s8 maxRssi,
+                                   s8 minRssi,
+                                   wifi_rssi_event_handler handler);
+    wifi_error stopRssiMonitoring(wifi_request_id id);
 
 private:
     Interface(const Interface&) = delete;
@@ -88,7 +99,9 @@ private:
                           const NetlinkMessage& reply);
 
     Netlink& mNetlink;
+    KeepaliveOffload& mKeepaliveOffload;
     std::string mName;
     uint32_t mInterfaceIndex;
+    std::unique_ptr<RssiMonitor> mRssiMonitor;
 };
 
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "keepaliveoffload.h"
+
+#include "log.h"
+#include "netlink.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// The framework uses a handful of slots per interface, this is only here to
+// put an upper bound on the memory used by a misbehaving client.
+static const size_t kMaxPackets = 64;
+
+static void closeIfOpen(int* fd) {
+    if (*fd != -1) {
+        ::close(*fd);
+        *fd = -1;
+    }
+}
+
+static struct timespec toTimespec(std::chrono::steady_clock::time_point t) {
+    using namespace std::chrono;
+    const auto ns = duration_cast<nanoseconds>(t.time_since_epoch()).count();
+
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+KeepaliveOffload::KeepaliveOffload()
+    : mTimerFd(-1)
+    , mSocket(-1) {
+}
+
+KeepaliveOffload::~KeepaliveOffload() {
+    closeIfOpen(&mTimerFd);
+    closeIfOpen(&mSocket);
+}
+
+bool KeepaliveOffload::init(Netlink& netlink) {
+    // steady_clock is CLOCK_MONOTONIC, the timer has to use the same clock
+    // since the deadlines are absolute.
+    mTimerFd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (mTimerFd == -1) {
+        ALOGE("Failed to create keepalive timer: %s", strerror(errno));
+        return false;
+    }
+
+    // Protocol 0 means that nothing is ever received on this socket, it's only
+    // used for sending complete Ethernet frames.
+    mSocket = ::socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (mSocket == -1) {
+        ALOGE("Failed to create keepalive socket: %s", strerror(errno));
+        closeIfOpen(&mTimerFd);
+        return false;
+    }
+
+    if (!netlink.addFileDescriptor(mTimerFd, [this](int fd) { onTimer(fd); })) {
+        ALOGE("Failed to add keepalive timer to the event loop");
+        closeIfOpen(&mTimerFd);
+        closeIfOpen(&mSocket);
+        return false;
+    }
+    return true;
+}
+
+bool KeepaliveOffload::isAvailable() const {
+    return mTimerFd != -1 && mSocket != -1;
+}
+
+wifi_error KeepaliveOffload::start(uint32_t interfaceIndex,
+                                   wifi_request_id id,
+                                   uint16_t etherType,
+                                   const uint8_t* ipPacket,
+                                   uint16_t ipPacketLength,
+                                   const uint8_t* srcMacAddress,
+                                   const uint8_t* dstMacAddress,
+                                   uint32_t periodMs) {
+    if (!isAvailable()) {
+        return WIFI_ERROR_NOT_SUPPORTED;
+    }
+    if (ipPacket == nullptr || ipPacketLength == 0 ||
+        ipPacketLength > ETH_DATA_LEN || srcMacAddress == nullptr ||
+        dstMacAddress == nullptr || periodMs == 0) {
+        return WIFI_ERROR_INVALID_ARGS;
+    }
+
+    Packet packet;
+    packet.frame.resize(ETH_HLEN + ipPacketLength);
+    auto header = reinterpret_cast<struct ethhdr*>(packet.frame.data());
+    memcpy(header->h_dest, dstMacAddress, ETH_ALEN);
+    memcpy(header->h_source, srcMacAddress, ETH_ALEN);
+    header->h_proto = htons(etherType);
+    memcpy(packet.frame.data() + ETH_HLEN, ipPacket, ipPacketLength);
+    packet.period = std::chrono::milliseconds(periodMs);
+    // The caller has just sent this packet itself, the first offloaded one is
+    // due one period later.
+    packet.deadline = Clock::now() + packet.period;
+
+    std::unique_lock<std::mutex> lock(mPacketsMutex);
+    const Key key(interfaceIndex, id);
+    auto existing = mPackets.find(key);
+    if (existing != mPackets.end()) {
+        // Starting the same id again replaces the packet
+        existing->second = std::move(packet);
+    } else if (mPackets.size() >= kMaxPackets) {
+        return WIFI_ERROR_TOO_MANY_REQUESTS;
+    } else {
+        mPackets.emplace(key, std::move(packet));
+    }
+    updateTimerLocked();
+    return WIFI_SUCCESS;
+}
+
+wifi_error KeepaliveOffload::stop(uint32_t interfaceIndex, wifi_request_id id) {
+    if (!isAvailable()) {
+        return WIFI_ERROR_NOT_SUPPORTED;
+    }
+
+    std::unique_lock<std::mutex> lock(mPacketsMutex);
+    if (mPackets.erase(Key(interfaceIndex, id)) == 0) {
+        return WIFI_ERROR_INVALID_ARGS;
+    }
+    updateTimerLocked();
+    return WIFI_SUCCESS;
+}
+
+void KeepaliveOffload::onTimer(int fd) {
+    uint64_t expirations = 0;
+    // The timer is non-blocking, if it was re-armed after it became readable
+    // there is nothing to read and the packets are just not due yet.
+    while (::read(fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+    }
+
+    std::unique_lock<std::mutex> lock(mPacketsMutex);
+    sendDuePacketsLocked(Clock::now());
+    updateTimerLocked();
+}
+
+void KeepaliveOffload::sendDuePacketsLocked(Clock::time_point now) {
+    std::vector<struct sockaddr_ll> addresses;
+    std::vector<struct iovec> iovecs;
+    addresses.reserve(mPackets.size());
+    iovecs.reserve(mPackets.size());
+
+    for (auto& entry : mPackets) {
+        Packet& packet = entry.second;
+        if (packet.deadline > now) {
+            continue;
+        }
+
+        struct sockaddr_ll address;
+        memset(&address, 0, sizeof(address));
+        address.sll_family = AF_PACKET;
+        address.sll_ifindex = entry.first.first;
+        address.sll_halen = ETH_ALEN;
+        memcpy(address.sll_addr, packet.frame.data(), ETH_ALEN);
+        addresses.push_back(address);
+
+        struct iovec iov;
+        iov.iov_base = packet.frame.data();
+        iov.iov_len = packet.frame.size();
+        iovecs.push_back(iov);
+
+        packet.deadline += packet.period;
+        if (packet.deadline <= now) {
+            // We were not running for more than a period (e.g. the system was
+            // suspended), don't send a burst to catch up.
+            packet.deadline = now + packet.period;
+        }
+    }
+
+    // Send all the packets that are due with a single system call
+    std::vector<struct mmsghdr> messages(addresses.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        memset(&messages[i], 0, sizeof(messages[i]));
+        messages[i].msg_hdr.msg_name = &addresses[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    while (sent < messages.size()) {
+        int status = ::sendmmsg(mSocket,
+                                messages.data() + sent,
+                                messages.size() - sent,
+                                0);
+        if (status < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // A keepalive that can't be sent is lost just like it would be
+            // over the air, try the next one.
+            ALOGW("Failed to send keepalive packet: %s", strerror(errno));
+            ++sent;
+        } else {
+            sent += status;
+        }
+    }
+}
+
+void KeepaliveOffload::updateTimerLocked() {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+
+    if (!mPackets.empty()) {
+        Clock::time_point next = Clock::time_point::max();
+        for (const auto& entry : mPackets) {
+            next = std::min(next, entry.second.deadline);
+        }
+        spec.it_value = toTimespec(next);
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            // A zero value disarms the timer
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+
+    if (::timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        ALOGE("Failed to set keepalive timer: %s", strerror(errno));
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include <hardware_legacy/wifi_hal.h>
+
+class Netlink;
+
+// Sends keepalive packets on behalf of the framework the same way WiFi
+// firmware would. All packets on all interfaces share a single timerfd that
+// is serviced by the netlink event loop and a single packet socket, so the
+// number of concurrent keepalives doesn't change the number of wakeups per
+// period.
+class KeepaliveOffload {
+public:
+    KeepaliveOffload();
+    ~KeepaliveOffload();
+
+    bool init(Netlink& netlink);
+    bool isAvailable() const;
+
+    wifi_error start(uint32_t interfaceIndex,
+                     wifi_request_id id,
+                     uint16_t etherType,
+                     const uint8_t* ipPacket,
+                     uint16_t ipPacketLength,
+                     const uint8_t* srcMacAddress,
+                     const uint8_t* dstMacAddress,
+                     uint32_t periodMs);
+    wifi_error stop(uint32_t interfaceIndex, wifi_request_id id);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Key = std::pair<uint32_t, wifi_request_id>;
+
+    struct Packet {
+        std::vector<uint8_t> frame;  // Ethernet header followed by the payload
+        Clock::duration period;
+        Clock::time_point deadline;
+    };
+
+    KeepaliveOffload(const KeepaliveOffload&) = delete;
+    KeepaliveOffload& operator=(const KeepaliveOffload&) = delete;
+
+    void onTimer(int fd);
+    void sendDuePacketsLocked(Clock::time_point now);
+    void updateTimerLocked();
+
+    int mTimerFd;
+    int mSocket;
+    std::mutex mPacketsMutex;
+    // Map interface index and request id to the packet being sent
+    std::map<Key, Packet> mPackets;
+};
@@ -27,6 +27,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <vector>
+
 static const size_t kControlRead = 0;
 static const size_t kControlWrite = 1;
 
@@ -95,15 +97,20 @@ void Netlink::stop(StopHandler handler) {
 }
 
 bool Netlink::eventLoop() {
-    struct pollfd fds[2];
-    memset(fds, 0, sizeof(fds));
+    std::vector<struct pollfd> fds(2 + mFdHandlers.size());
     fds[0].fd = mSocket;
     fds[0].events = POLLIN;
     fds[1].fd = mControlPipe[kControlRead];
     fds[1].events = POLLIN;
+    size_t index = 2;
+    for (const auto& fdHandler : mFdHandlers) {
+        fds[index].fd = fdHandler.first;
+        fds[index].events = POLLIN;
+        ++index;
+    }
 
     for (;;) {
-        int status = ::poll(fds, 2, -1);
+        int status = ::poll(fds.data(), fds.size(), -1);
         if (status == 0) {
             // Timeout, not really supposed to happen
             ALOGW("poll encountered a timeout despite infinite timeout");
@@ -143,6 +150,11 @@ bool Netlink::eventLoop() {
                     }
                     return true;
                 }
+            } else {
+                auto handler = mFdHandlers.find(fd.fd);
+                if (handler != mFdHandlers.end()) {
+                    handler->second(fd.fd);
+                }
             }
         }
     }
@@ -181,6 +193,21 @@ bool Netlink::sendMessage(const NetlinkMessage& message,
     }
 }
 
+bool Netlink::addFileDescriptor(int fd, FdHandler handler) {
+    if (fd == -1 || fd == mSocket || !handler) {
+        return false;
+    }
+    return mFdHandlers.emplace(fd, handler).second;
+}
+
+void Netlink::clearHandlers() {
+    {
+        std::unique_lock<std::mutex> lock(mHandlersMutex);
+        mHandlers.clear();
+    }
+    mFdHandlers.clear();
+}
+
 bool Netlink::readNetlinkMessage(int fd) {
     char buffer[8 * 1024];
     for (;;) {
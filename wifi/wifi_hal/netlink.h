@@ -28,6 +28,7 @@ class Netlink {
 public:
     using ReplyHandler = std::function<void (const NetlinkMessage&)>;
     using StopHandler = std::function<void ()>;
+    using FdHandler = std::function<void (int)>;
     Netlink();
     ~Netlink();
 
@@ -39,6 +40,13 @@ public:
     uint32_t getSequenceNumber();
 
     bool sendMessage(const NetlinkMessage& message, ReplyHandler handler);
+
+    // Poll |fd| in the event loop as well and call |handler| when it becomes
+    // readable. This must be called before the event loop is started.
+    bool addFileDescriptor(int fd, FdHandler handler);
+    // Forget all handlers so that none of them is called after this returns.
+    // The owner calls this before destroying the objects the handlers use.
+    void clearHandlers();
 private:
     Netlink(const Netlink&) = delete;
     Netlink& operator=(const Netlink&) = delete;
@@ -56,5 +64,7 @@ private:
     std::mutex mHandlersMutex;
     std::mutex mStopHandlerMutex;
     StopHandler mStopHandler;
+    // Map file descriptor to the handler called when it's readable
+    std::unordered_map<int, FdHandler> mFdHandlers;
 };
 
@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rssimonitor.h"
+
+#include "log.h"
+#include "netlink.h"
+
+#include <linux/if_ether.h>
+#include <linux/nl80211.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/genl/genl.h>
+#include <string.h>
+
+namespace {
+
+struct StationInfo {
+    uint32_t interfaceIndex;
+    bool found;
+    u8 bssid[ETH_ALEN];
+    int32_t rssi;
+};
+
+// Returns the interface index attribute since everything here needs it
+struct nlattr* parseAttributes(struct nl_msg* message,
+                               struct nlattr** attributes) {
+    auto header = static_cast<struct genlmsghdr*>(nlmsg_data(nlmsg_hdr(message)));
+    nla_parse(attributes, NL80211_ATTR_MAX,
+              genlmsg_attrdata(header, 0), genlmsg_attrlen(header, 0),
+              nullptr);
+    return attributes[NL80211_ATTR_IFINDEX];
+}
+
+// A station mode interface has a single station, the access point
+int onStationMessage(struct nl_msg* message, void* arg) {
+    auto info = static_cast<StationInfo*>(arg);
+    struct nlattr* attributes[NL80211_ATTR_MAX + 1];
+    struct nlattr* interfaceIndex = parseAttributes(message, attributes);
+    if (interfaceIndex == nullptr ||
+        nla_get_u32(interfaceIndex) != info->interfaceIndex ||
+        attributes[NL80211_ATTR_MAC] == nullptr ||
+        attributes[NL80211_ATTR_STA_INFO] == nullptr) {
+        return NL_SKIP;
+    }
+
+    struct nlattr* stationInfo[NL80211_STA_INFO_MAX + 1];
+    if (nla_parse_nested(stationInfo, NL80211_STA_INFO_MAX,
+                         attributes[NL80211_ATTR_STA_INFO], nullptr) != 0 ||
+        stationInfo[NL80211_STA_INFO_SIGNAL] == nullptr) {
+        return NL_SKIP;
+    }
+
+    memcpy(info->bssid, nla_data(attributes[NL80211_ATTR_MAC]), ETH_ALEN);
+    info->rssi = static_cast<int8_t>(nla_get_u8(stationInfo[NL80211_STA_INFO_SIGNAL]));
+    info->found = true;
+    return NL_SKIP;
+}
+
+int onWiphyMessage(struct nl_msg* message, void* arg) {
+    auto thresholdList = static_cast<bool*>(arg);
+    struct nlattr* attributes[NL80211_ATTR_MAX + 1];
+    parseAttributes(message, attributes);
+    struct nlattr* features = attributes[NL80211_ATTR_EXT_FEATURES];
+    if (features == nullptr) {
+        return NL_SKIP;
+    }
+    // A bitmap indexed by the extended feature
+    const int byte = NL80211_EXT_FEATURE_CQM_RSSI_LIST / 8;
+    const int bit = NL80211_EXT_FEATURE_CQM_RSSI_LIST % 8;
+    if (byte < nla_len(features)) {
+        auto data = static_cast<const uint8_t*>(nla_data(features));
+        *thresholdList = (data[byte] & (1 << bit)) != 0;
+    }
+    return NL_SKIP;
+}
+
+int onRequestFinished(struct nl_msg* /*message*/, void* arg) {
+    *static_cast<int*>(arg) = 0;
+    return NL_STOP;
+}
+
+int onRequestError(struct sockaddr_nl* /*address*/,
+                   struct nlmsgerr* error,
+                   void* arg) {
+    *static_cast<int*>(arg) = error->error;
+    return NL_STOP;
+}
+
+// Send |message|, which is freed, and call |handler| for every message of the
+// reply. Waits until the reply is complete, a dump ends with NLMSG_DONE and
+// anything else with an acknowledgement.
+bool sendRequest(struct nl_sock* socket,
+                 struct nl_msg* message,
+                 nl_recvmsg_msg_cb_t handler,
+                 void* arg) {
+    struct nl_cb* callbacks = nl_cb_alloc(NL_CB_DEFAULT);
+    if (callbacks == nullptr) {
+        nlmsg_free(message);
+        return false;
+    }
+    int result = 1;
+    nl_cb_set(callbacks, NL_CB_VALID, NL_CB_CUSTOM, handler, arg);
+    nl_cb_set(callbacks, NL_CB_FINISH, NL_CB_CUSTOM, onRequestFinished, &result);
+    nl_cb_set(callbacks, NL_CB_ACK, NL_CB_CUSTOM, onRequestFinished, &result);
+    nl_cb_err(callbacks, NL_CB_CUSTOM, onRequestError, &result);
+
+    int status = nl_send_auto(socket, message);
+    nlmsg_free(message);
+    while (status >= 0 && result > 0) {
+        status = nl_recvmsgs(socket, callbacks);
+    }
+    nl_cb_put(callbacks);
+
+    if (status < 0) {
+        ALOGE("nl80211 request failed: %s", nl_geterror(status));
+        return false;
+    }
+    if (result < 0) {
+        ALOGE("nl80211 request failed: %s", strerror(-result));
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+RssiMonitor::RssiMonitor()
+    : mInterfaceIndex(0)
+    , mFamily(-1)
+    , mEventSocket(nullptr)
+    , mCommandSocket(nullptr)
+    , mThresholdList(false)
+    , mExiting(false)
+    , mEventPending(false)
+    , mEventHasRssi(false)
+    , mEventRssi(0)
+    , mMonitoring(false)
+    , mGeneration(0)
+    , mId(0)
+    , mMaxRssi(0)
+    , mMinRssi(0)
+    , mHandler{} {
+}
+
+RssiMonitor::~RssiMonitor() {
+    if (mReportThread.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mExiting = true;
+            mCondition.notify_all();
+        }
+        mReportThread.join();
+    }
+    if (mEventSocket != nullptr) {
+        nl_socket_free(mEventSocket);
+    }
+    if (mCommandSocket != nullptr) {
+        nl_socket_free(mCommandSocket);
+    }
+}
+
+bool RssiMonitor::init(Netlink& netlink, uint32_t interfaceIndex) {
+    mInterfaceIndex = interfaceIndex;
+
+    mCommandSocket = nl_socket_alloc();
+    mEventSocket = nl_socket_alloc();
+    if (mCommandSocket == nullptr || mEventSocket == nullptr) {
+        ALOGE("Failed to allocate nl80211 sockets");
+        return false;
+    }
+    if (genl_connect(mCommandSocket) != 0 || genl_connect(mEventSocket) != 0) {
+        ALOGE("Failed to connect nl80211 sockets");
+        return false;
+    }
+
+    int family = genl_ctrl_resolve(mCommandSocket, NL80211_GENL_NAME);
+    if (family < 0) {
+        ALOGE("nl80211 is not available");
+        return false;
+    }
+    // CQM events are sent to the MLME group
+    int group = genl_ctrl_resolve_grp(mCommandSocket,
+                                      NL80211_GENL_NAME,
+                                      NL80211_MULTICAST_GROUP_MLME);
+    if (group < 0 || nl_socket_add_membership(mEventSocket, group) != 0) {
+        ALOGE("Failed to join the nl80211 MLME group");
+        return false;
+    }
+
+    // Events are not replies, they don't have a sequence number to check
+    nl_socket_disable_seq_check(mEventSocket);
+    nl_socket_modify_cb(mEventSocket, NL_CB_VALID, NL_CB_CUSTOM,
+                        &RssiMonitor::onEventMessage, this);
+    if (nl_socket_set_nonblocking(mEventSocket) != 0) {
+        ALOGE("Failed to make the nl80211 event socket non-blocking");
+        return false;
+    }
+
+    if (!netlink.addFileDescriptor(nl_socket_get_fd(mEventSocket),
+                                   [this](int /*fd*/) {
+            nl_recvmsgs_default(mEventSocket);
+        })) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mCommandMutex);
+    mFamily = family;
+    mThresholdList = supportsThresholdListLocked();
+    mReportThread = std::thread(&RssiMonitor::reportThread, this);
+    return true;
+}
+
+bool RssiMonitor::isAvailable() const {
+    return mFamily >= 0;
+}
+
+wifi_error RssiMonitor::start(wifi_request_id id,
+                              s8 maxRssi,
+                              s8 minRssi,
+                              wifi_rssi_event_handler handler) {
+    if (!isAvailable()) {
+        return WIFI_ERROR_NOT_SUPPORTED;
+    }
+    if (maxRssi < minRssi || handler.on_rssi_threshold_breached == nullptr) {
+        return WIFI_ERROR_INVALID_ARGS;
+    }
+
+    std::unique_lock<std::mutex> commandLock(mCommandMutex);
+    // The thresholds depend on where the signal is now unless the kernel
+    // takes the whole list. Without a station the signal is assumed to be in
+    // range, the thresholds move with the first event.
+    u8 bssid[ETH_ALEN];
+    int32_t rssi = minRssi;
+    if (!mThresholdList) {
+        getStationLocked(bssid, &rssi);
+    }
+    const bool armed = armLocked(rssi, minRssi, maxRssi);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    ++mGeneration;
+    mMonitoring = armed;
+    if (!armed) {
+        return WIFI_ERROR_UNKNOWN;
+    }
+    mId = id;
+    mMaxRssi = maxRssi;
+    mMinRssi = minRssi;
+    mHandler = handler;
+    mEventPending = false;
+    return WIFI_SUCCESS;
+}
+
+wifi_error RssiMonitor::stop(wifi_request_id id) {
+    if (!isAvailable()) {
+        return WIFI_ERROR_NOT_SUPPORTED;
+    }
+
+    std::unique_lock<std::mutex> commandLock(mCommandMutex);
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mMonitoring || id != mId) {
+            return WIFI_ERROR_INVALID_ARGS;
+        }
+        ++mGeneration;
+        mMonitoring = false;
+        mHandler = wifi_rssi_event_handler{};
+    }
+    // A single zero threshold turns the monitor off
+    const int32_t off = 0;
+    return setThresholdsLocked(&off, 1, 0) ? WIFI_SUCCESS : WIFI_ERROR_UNKNOWN;
+}
+
+int RssiMonitor::onEventMessage(struct nl_msg* message, void* arg) {
+    static_cast<RssiMonitor*>(arg)->onEvent(message);
+    return NL_OK;
+}
+
+void RssiMonitor::onEvent(struct nl_msg* message) {
+    auto header = static_cast<struct genlmsghdr*>(nlmsg_data(nlmsg_hdr(message)));
+    if (header->cmd != NL80211_CMD_NOTIFY_CQM) {
+        return;
+    }
+    struct nlattr* attributes[NL80211_ATTR_MAX + 1];
+    struct nlattr* interfaceIndex = parseAttributes(message, attributes);
+    if (interfaceIndex == nullptr ||
+        nla_get_u32(interfaceIndex) != mInterfaceIndex ||
+        attributes[NL80211_ATTR_CQM] == nullptr) {
+        return;
+    }
+    struct nlattr* cqm[NL80211_ATTR_CQM_MAX + 1];
+    if (nla_parse_nested(cqm, NL80211_ATTR_CQM_MAX,
+                         attributes[NL80211_ATTR_CQM], nullptr) != 0 ||
+        cqm[NL80211_ATTR_CQM_RSSI_THRESHOLD_EVENT] == nullptr) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!mMonitoring) {
+        return;
+    }
+    // Only the latest level matters if the report thread is behind
+    mEventHasRssi = cqm[NL80211_ATTR_CQM_RSSI_LEVEL] != nullptr;
+    if (mEventHasRssi) {
+        mEventRssi = static_cast<int32_t>(
+            nla_get_u32(cqm[NL80211_ATTR_CQM_RSSI_LEVEL]));
+    }
+    mEventPending = true;
+    mCondition.notify_all();
+}
+
+void RssiMonitor::reportThread() {
+    for (;;) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return mEventPending || mExiting; });
+        if (mExiting) {
+            return;
+        }
+        mEventPending = false;
+        if (!mMonitoring) {
+            continue;
+        }
+        const uint32_t generation = mGeneration;
+        const bool eventHasRssi = mEventHasRssi;
+        const int32_t eventRssi = mEventRssi;
+        const s8 minRssi = mMinRssi;
+        const s8 maxRssi = mMaxRssi;
+        const wifi_request_id id = mId;
+        const wifi_rssi_event_handler handler = mHandler;
+        lock.unlock();
+
+        // Older kernels don't include the level in the event, the station
+        // has it as well as the BSSID that the framework wants.
+        u8 bssid[ETH_ALEN];
+        int32_t rssi = 0;
+        {
+            std::unique_lock<std::mutex> commandLock(mCommandMutex);
+            if (!getStationLocked(bssid, &rssi)) {
+                continue;
+            }
+            if (eventHasRssi) {
+                rssi = eventRssi;
+            }
+            // start and stop hold mCommandMutex too, if one of them ran since
+            // the event its thresholds stay.
+            lock.lock();
+            const bool current = generation == mGeneration;
+            lock.unlock();
+            if (!current) {
+                continue;
+            }
+            if (!mThresholdList) {
+                armLocked(rssi, minRssi, maxRssi);
+            }
+        }
+
+        // Crossing back into the range is an event too but the framework
+        // only wants to hear about leaving it.
+        if (rssi >= minRssi && rssi <= maxRssi) {
+            continue;
+        }
+        handler.on_rssi_threshold_breached(id, bssid, static_cast<s8>(rssi));
+    }
+}
+
+bool RssiMonitor::supportsThresholdListLocked() {
+    struct nl_msg* message = nlmsg_alloc();
+    if (message == nullptr) {
+        return false;
+    }
+    // The extended features are only sent in a split dump, which the
+    // interface index limits to this interface's wiphy.
+    genlmsg_put(message, NL_AUTO_PORT, NL_AUTO_SEQ, mFamily, 0, NLM_F_DUMP,
+                NL80211_CMD_GET_WIPHY, 0);
+    nla_put_u32(message, NL80211_ATTR_IFINDEX, mInterfaceIndex);
+    nla_put_flag(message, NL80211_ATTR_SPLIT_WIPHY_DUMP);
+
+    bool thresholdList = false;
+    if (!sendRequest(mCommandSocket, message, onWiphyMessage, &thresholdList)) {
+        return false;
+    }
+    return thresholdList;
+}
+
+bool RssiMonitor::getStationLocked(u8* bssid, int32_t* rssi) {
+    struct nl_msg* message = nlmsg_alloc();
+    if (message == nullptr) {
+        return false;
+    }
+    genlmsg_put(message, NL_AUTO_PORT, NL_AUTO_SEQ, mFamily, 0, NLM_F_DUMP,
+                NL80211_CMD_GET_STATION, 0);
+    nla_put_u32(message, NL80211_ATTR_IFINDEX, mInterfaceIndex);
+
+    StationInfo info;
+    memset(&info, 0, sizeof(info));
+    info.interfaceIndex = mInterfaceIndex;
+    if (!sendRequest(mCommandSocket, message, onStationMessage, &info)) {
+        return false;
+    }
+    if (!info.found) {
+        ALOGW("Not connected, no station to report");
+        return false;
+    }
+    memcpy(bssid, info.bssid, ETH_ALEN);
+    *rssi = info.rssi;
+    return true;
+}
+
+// The framework wants to hear when the signal drops below minRssi or rises
+// above maxRssi, every time it happens.
+bool RssiMonitor::armLocked(int32_t rssi, s8 minRssi, s8 maxRssi) {
+    if (mThresholdList) {
+        // The kernel reports whenever the signal moves from one band between
+        // two thresholds to another, the bands are below, within and above
+        // the range. The threshold is the first level of the upper band.
+        const int32_t thresholds[] = {minRssi, maxRssi + 1};
+        return setThresholdsLocked(thresholds, 2, 0);
+    }
+
+    // With a single threshold the kernel reports a low event when the signal
+    // drops below threshold - hysteresis and a high event when it rises above
+    // threshold + hysteresis. After that it only reports again once the signal
+    // moved by the hysteresis from the last event, setting the threshold
+    // again starts over. So the window is centered on the band the signal is
+    // in and moved along after every event.
+    int32_t low;
+    int32_t high;
+    if (rssi < minRssi) {
+        low = INT8_MIN;
+        high = minRssi - 1;
+        // Only an even width can be expressed, widen away from the range
+        if ((high - low) % 2 != 0) {
+            low -= 1;
+        }
+    } else if (rssi > maxRssi) {
+        low = maxRssi + 1;
+        high = INT8_MAX;
+        if ((high - low) % 2 != 0) {
+            high += 1;
+        }
+    } else {
+        low = minRssi;
+        high = maxRssi;
+        // Only an even width can be expressed, so the window leaves out the
+        // top level of the range, or the bottom one while the signal is at
+        // the top. Reaching the level left out is an in range event that
+        // moves the window over, every level outside the range is an event.
+        if ((high - low) % 2 != 0) {
+            if (rssi < high) {
+                high -= 1;
+            } else {
+                low += 1;
+            }
+        }
+    }
+    const int32_t threshold = (low + high) / 2;
+    return setThresholdsLocked(&threshold, 1, (high - low) / 2);
+}
+
+bool RssiMonitor::setThresholdsLocked(const int32_t* thresholds,
+                                      size_t count,
+                                      uint32_t hysteresis) {
+    struct nl_msg* message = nlmsg_alloc();
+    if (message == nullptr) {
+        return false;
+    }
+    genlmsg_put(message, NL_AUTO_PORT, NL_AUTO_SEQ, mFamily, 0, 0,
+                NL80211_CMD_SET_CQM, 0);
+    nla_put_u32(message, NL80211_ATTR_IFINDEX, mInterfaceIndex);
+    struct nlattr* cqm = nla_nest_start(message, NL80211_ATTR_CQM);
+    // A single threshold or, with NL80211_EXT_FEATURE_CQM_RSSI_LIST, a sorted
+    // list of them
+    nla_put(message, NL80211_ATTR_CQM_RSSI_THOLD,
+            count * sizeof(thresholds[0]), thresholds);
+    nla_put_u32(message, NL80211_ATTR_CQM_RSSI_HYST, hysteresis);
+    nla_nest_end(message, cqm);
+
+    // This waits for the acknowledgement and frees the message
+    int status = nl_send_sync(mCommandSocket, message);
+    if (status < 0) {
+        ALOGE("Failed to set CQM RSSI thresholds: %s", nl_geterror(status));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <hardware_legacy/wifi_hal.h>
+
+class Netlink;
+struct nl_msg;
+struct nl_sock;
+
+// Reports when the signal strength of the current connection leaves a range.
+// The range is handed to the kernel as nl80211 connection quality monitor
+// (CQM) thresholds so that nothing has to poll the signal, the kernel sends an
+// event when a threshold is crossed and that event is read by the netlink
+// event loop. Looking up the station for the report involves a request that
+// can wait on the wireless stack so that is done on a thread of its own, and
+// without holding the lock the event loop takes.
+class RssiMonitor {
+public:
+    RssiMonitor();
+    ~RssiMonitor();
+
+    bool init(Netlink& netlink, uint32_t interfaceIndex);
+    bool isAvailable() const;
+
+    wifi_error start(wifi_request_id id,
+                     s8 maxRssi,
+                     s8 minRssi,
+                     wifi_rssi_event_handler handler);
+    wifi_error stop(wifi_request_id id);
+
+private:
+    RssiMonitor(const RssiMonitor&) = delete;
+    RssiMonitor& operator=(const RssiMonitor&) = delete;
+
+    static int onEventMessage(struct nl_msg* message, void* arg);
+    void onEvent(struct nl_msg* message);
+    void reportThread();
+    // These send requests on mCommandSocket, mCommandMutex must be held
+    bool supportsThresholdListLocked();
+    bool getStationLocked(u8* bssid, int32_t* rssi);
+    bool armLocked(int32_t rssi, s8 minRssi, s8 maxRssi);
+    bool setThresholdsLocked(const int32_t* thresholds,
+                             size_t count,
+                             uint32_t hysteresis);
+
+    uint32_t mInterfaceIndex;
+    int mFamily;
+    struct nl_sock* mEventSocket;
+    std::thread mReportThread;
+
+    // Taken before mMutex if both are needed. The event loop only takes
+    // mMutex, so it never waits for a request to the wireless stack.
+    std::mutex mCommandMutex;
+    struct nl_sock* mCommandSocket;
+    // The kernel takes a list of thresholds and moves between them itself
+    bool mThresholdList;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mExiting;
+    // Set by the event loop for the report thread
+    bool mEventPending;
+    bool mEventHasRssi;
+    int32_t mEventRssi;
+    bool mMonitoring;
+    // Changes with every start and stop, a report for an event from before
+    // that is dropped
+    uint32_t mGeneration;
+    wifi_request_id mId;
+    s8 mMaxRssi;
+    s8 mMinRssi;
+    wifi_rssi_event_handler mHandler;
+};
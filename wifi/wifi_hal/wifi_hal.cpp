@@ -396,6 +396,27 @@ wifi_error wifi_stop_sending_offloaded_packet(wifi_request_id id,
     return asInterface(handle)->stopSendingOffloadedPacket(id);
 }
 
+wifi_error wifi_start_rssi_monitoring(wifi_request_id id,
+                                      wifi_interface_handle handle,
+                                      s8 max_rssi,
+                                      s8 min_rssi,
+                                      wifi_rssi_event_handler eh) {
+    if (handle == nullptr) {
+        return WIFI_ERROR_INVALID_ARGS;
+    }
+
+    return asInterface(handle)->startRssiMonitoring(id, max_rssi, min_rssi, eh);
+}
+
+wifi_error wifi_stop_rssi_monitoring(wifi_request_id id,
+                                     wifi_interface_handle handle) {
+    if (handle == nullptr) {
+        return WIFI_ERROR_INVALID_ARGS;
+    }
+
+    return asInterface(handle)->stopRssiMonitoring(id);
+}
+
 wifi_error init_wifi_vendor_hal_func_table(wifi_hal_fn* fn)
 {
     if (fn == NULL) {
@@ -437,6 +458,8 @@ wifi_error init_wifi_vendor_hal_func_table(wifi_hal_fn* fn)
     fn->wifi_start_sending_offloaded_packet
         = wifi_start_sending_offloaded_packet;
     fn->wifi_stop_sending_offloaded_packet = wifi_stop_sending_offloaded_packet;
+    fn->wifi_start_rssi_monitoring = wifi_start_rssi_monitoring;
+    fn->wifi_stop_rssi_monitoring = wifi_stop_rssi_monitoring;
 
     // These function will either return WIFI_ERROR_NOT_SUPPORTED or do nothing
     notSupported(fn->wifi_set_nodfs_flag);
@@ -459,8 +482,6 @@ wifi_error init_wifi_vendor_hal_func_table(wifi_hal_fn* fn)
     notSupported(fn->wifi_reset_epno_list);
     notSupported(fn->wifi_get_firmware_memory_dump);
     notSupported(fn->wifi_reset_log_handler);
-    notSupported(fn->wifi_start_rssi_monitoring);
-    notSupported(fn->wifi_stop_rssi_monitoring);
     notSupported(fn->wifi_set_packet_filter);
 
     return WIFI_SUCCESS;